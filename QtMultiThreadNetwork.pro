@@ -1,7 +1,7 @@
 
 TEMPLATE = subdirs
 CONFIG -= ordered
-SUBDIRS += qmultithreadnetwork samples
+SUBDIRS += qmultithreadnetwork samples test
 qmultithreadnetwork.file = source/QMultiThreadNetwork.pro
 samples.depends = qmultithreadnetwork
 
@@ -4,12 +4,13 @@ echo "<br>[PHP] <br>";
 //var_dump($_SERVER['REQUEST_METHOD']);
 //echo " <br>";
 
-$fileInfo = $_FILES["sendfile"];
+// 保存一个上传的文件. $name: 保存的文件名，为空时使用上传的文件名
+function save_uploaded_file($fileInfo, $name){
+$targetpath = $_POST["path"];
 echo "Upload file: ".$fileInfo["name"]." <br>";
 echo "Size: ".($fileInfo["size"] / 1024)." kB <br>";
 //echo "Temp file: ".$fileInfo["tmp_name"]." <br>";
-$targetname = $_POST["filename"];
-$targetpath = $_POST["path"];
+$targetname = $name;
 //echo "Target file: ".$targetpath."/".$targetname." <br>";
 
 if ($fileInfo["error"] > 0){
@@ -59,4 +60,18 @@ else{
 		echo "Upload failed. File cannot be larger than 512MB <br>";  
 	}
 }
+}
+
+// sendfile: 单个文件；sendfile[]: 多个文件(RequestTask::eTypeFormUpload)，文件名可带相对路径
+$files = $_FILES["sendfile"];
+if (is_array($files["name"])){
+	for($i = 0; $i < count($files["name"]); $i++){
+		$fileInfo = array("name" => $files["name"][$i], "type" => $files["type"][$i], "tmp_name" => $files["tmp_name"][$i],
+			"error" => $files["error"][$i], "size" => $files["size"][$i]);
+		save_uploaded_file($fileInfo, "");
+	}
+}
+else{
+	save_uploaded_file($files, $_POST["filename"]);
+}
 ?>
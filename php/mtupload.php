@@ -0,0 +1,96 @@
+<?php
+ // 分块上传(RequestTask::eTypeMTUpload)的测试服务端
+ // 上传块: PUT/POST mtupload.php?filename=a/b.zip&uploadid=xxx&part=0&parts=4  (Content-Range: bytes 0-8388607/30000000)
+ // 提交:   POST mtupload.php?filename=a/b.zip&uploadid=xxx&commit=1&parts=4&size=30000000
+ header("content-type:text/html;charset:utf-8");
+
+ $rootPath = "../";
+ $targetfile = $_GET["filename"];
+ $uploadid = preg_replace("/[^0-9A-Za-z\-]/", "", $_GET["uploadid"]);
+ $parts = intval($_GET["parts"]);
+ if(strlen($targetfile) <= 0 || strlen($uploadid) <= 0 || $parts <= 0){
+	 http_response_code(400);
+	 echo "Bad request. <br>";
+	 exit;
+ }
+ $partDir = $rootPath.".mtupload/".$uploadid;
+ if(!file_exists($partDir)){
+	 mkdir($partDir, 0777, true);
+ }
+
+ if(!isset($_GET["commit"])){
+	 // 保存一块，同一块重传时覆盖
+	 $part = intval($_GET["part"]);
+	 if($part < 0 || $part >= $parts){
+		 http_response_code(400);
+		 echo "Invalid part ".$part." <br>";
+		 exit;
+	 }
+	 $in = fopen("php://input", "rb");
+	 $out = fopen($partDir."/".$part, "wb");
+	 $size = ($in != FALSE && $out != FALSE) ? stream_copy_to_stream($in, $out) : FALSE;
+	 if($in != FALSE) fclose($in);
+	 if($out != FALSE) fclose($out);
+	 if($size === FALSE){
+		 http_response_code(500);
+		 echo "Part ".$part." upload failed. <br>";
+		 exit;
+	 }
+	 // 检查长度与Content-Range一致
+	 if(isset($_SERVER["HTTP_CONTENT_RANGE"])
+		 && preg_match("/bytes (\d+)-(\d+)\/(\d+)/", $_SERVER["HTTP_CONTENT_RANGE"], $m)
+		 && $size != $m[2] - $m[1] + 1){
+		 unlink($partDir."/".$part);
+		 http_response_code(400);
+		 echo "Part ".$part." size mismatch. <br>";
+		 exit;
+	 }
+	 echo "Part ".$part." upload success. <br>";
+	 exit;
+ }
+
+ // 提交：按顺序合并所有块
+ $targetpath = $rootPath;
+ if(strripos($targetfile, "\\")){
+	 $targetpath = $rootPath.substr($targetfile, 0, strripos($targetfile, "\\"));
+ }
+ else if(strripos($targetfile, "/")){
+	 $targetpath = $rootPath.substr($targetfile, 0, strripos($targetfile, "/"));
+ }
+ if(strlen($targetpath) > 0 && !file_exists($targetpath)){
+	 mkdir($targetpath, 0777, true);
+ }
+ for($i = 0; $i < $parts; $i++){
+	 if(!file_exists($partDir."/".$i)){
+		 http_response_code(409);
+		 echo "Part ".$i." is missing. <br>";
+		 exit;
+	 }
+ }
+ $filename = $rootPath.$targetfile;
+ $out = fopen($filename.".part", "wb");
+ for($i = 0; $out != FALSE && $i < $parts; $i++){
+	 $in = fopen($partDir."/".$i, "rb");
+	 stream_copy_to_stream($in, $out);
+	 fclose($in);
+ }
+ if($out == FALSE){
+	 http_response_code(500);
+	 echo $targetfile." commit failed. <br>";
+	 exit;
+ }
+ fclose($out);
+ clearstatcache();
+ if(isset($_GET["size"]) && filesize($filename.".part") != intval($_GET["size"])){
+	 unlink($filename.".part");
+	 http_response_code(409);
+	 echo $targetfile." size mismatch. <br>";
+	 exit;
+ }
+ rename($filename.".part", $filename);
+ for($i = 0; $i < $parts; $i++){
+	 unlink($partDir."/".$i);
+ }
+ rmdir($partDir);
+ echo $targetfile." upload success. <br>";
+?>
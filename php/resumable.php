@@ -0,0 +1,84 @@
+<?php
+ // 断点续传上传(RequestTask::bResumableUpload)的测试服务端
+ // 查询: HEAD resumable.php?filename=a/b.zip&uploadid=xxx&size=30000000  -> 响应头 Upload-Offset: 已收到的字节数
+ // 上传: PUT/POST resumable.php?filename=a/b.zip&uploadid=xxx&size=30000000  (Content-Range: bytes 1000-29999999/30000000)
+ //	 起始位置与已收到的字节数不一致时返回409；收齐后移动到filename
+ $rootPath = "../";
+ $targetfile = $_GET["filename"];
+ $uploadid = preg_replace("/[^0-9A-Za-z\-]/", "", $_GET["uploadid"]);
+ $size = intval($_GET["size"]);
+ if(strlen($targetfile) <= 0 || strlen($uploadid) <= 0 || $size < 0){
+	 http_response_code(400);
+	 echo "Bad request. <br>";
+	 exit;
+ }
+ $stateDir = $rootPath.".resumable";
+ if(!file_exists($stateDir)){
+	 mkdir($stateDir, 0777, true);
+ }
+ $tempfile = $stateDir."/".$uploadid;
+ clearstatcache();
+ $offset = file_exists($tempfile) ? filesize($tempfile) : 0;
+
+ if($_SERVER["REQUEST_METHOD"] == "HEAD"){
+	 header("Upload-Offset: ".$offset);
+	 exit;
+ }
+
+ // 解析Content-Range: "bytes start-end/total" 或 "bytes */total"
+ $start = 0;
+ if(isset($_SERVER["HTTP_CONTENT_RANGE"])){
+	 if(preg_match("/bytes (\d+)-(\d+)\/(\d+)/", $_SERVER["HTTP_CONTENT_RANGE"], $m)){
+		 $start = intval($m[1]);
+	 }
+	 else if(preg_match("/bytes \*\/(\d+)/", $_SERVER["HTTP_CONTENT_RANGE"], $m)){
+		 $start = intval($m[1]);
+	 }
+ }
+ if($start != $offset){
+	 header("Upload-Offset: ".$offset);
+	 http_response_code(409);
+	 echo "Offset mismatch, server has ".$offset." bytes. <br>";
+	 exit;
+ }
+
+ // 追加数据，连接中断时已收到的部分保留在临时文件中
+ ignore_user_abort(true);
+ $in = fopen("php://input", "rb");
+ $out = fopen($tempfile, "ab");
+ if($in == FALSE || $out == FALSE){
+	 http_response_code(500);
+	 echo "Open file failed. <br>";
+	 exit;
+ }
+ stream_copy_to_stream($in, $out);
+ fclose($in);
+ fclose($out);
+ clearstatcache();
+ $offset = filesize($tempfile);
+ header("Upload-Offset: ".$offset);
+ if($offset < $size){
+	 http_response_code(409);
+	 echo "Incomplete, server has ".$offset." bytes. <br>";
+	 exit;
+ }
+ if($offset > $size){
+	 unlink($tempfile);
+	 http_response_code(400);
+	 echo "Too much data. <br>";
+	 exit;
+ }
+
+ $targetpath = $rootPath;
+ if(strripos($targetfile, "\\")){
+	 $targetpath = $rootPath.substr($targetfile, 0, strripos($targetfile, "\\"));
+ }
+ else if(strripos($targetfile, "/")){
+	 $targetpath = $rootPath.substr($targetfile, 0, strripos($targetfile, "/"));
+ }
+ if(strlen($targetpath) > 0 && !file_exists($targetpath)){
+	 mkdir($targetpath, 0777, true);
+ }
+ rename($tempfile, $rootPath.$targetfile);
+ echo $targetfile." upload success. <br>";
+?>
@@ -4,7 +4,7 @@
 
 TEMPLATE = lib
 TARGET = QMultiThreadNetwork
-QT += network
+QT += network zlib-private
 QT -= gui
 CONFIG += qt thread
 CONFIG += debug_and_release
@@ -16,6 +16,17 @@ INCLUDEPATH += . \
 DEFINES += UNICODE QT_MTNETWORK_LIB
 staticlib: DEFINES += QT_MTNETWORK_STATIC
 
+# zstd压缩(可选)：qmake "CONFIG+=zstd"
+zstd {
+    DEFINES += QT_MTNETWORK_ZSTD
+    LIBS += -lzstd
+}
+# brotli解压(可选)：qmake "CONFIG+=brotli"
+brotli {
+    DEFINES += QT_MTNETWORK_BROTLI
+    LIBS += -lbrotlidec
+}
+
 # Input
 HEADERS += $$PWD/inc/classmemorytracer.h \
            $$PWD/inc/Log4cplusWrapper.h \
@@ -28,7 +39,24 @@ HEADERS += $$PWD/inc/classmemorytracer.h \
            networkdownloadrequest.h \
            networkuploadrequest.h \
            networkcommonrequest.h \
-           networkrunnable.h
+           networkrunnable.h \
+           networkfileinfocache.h \
+           networkdiskwriter.h \
+           networkbufferpool.h \
+           networkchecksum.h \
+           networkfilerangedevice.h \
+           networkmtuploadrequest.h \
+           networkformuploadrequest.h \
+           networkcompressor.h \
+           networkrequesttemplate.h \
+           networktlssessioncache.h \
+           networkcookiejar.h \
+           networkcredentialstore.h \
+           networkredirectcache.h \
+           networkaccessmanager.h \
+           networkstatistics.h \
+           networkmetricsexporter.h \
+           networktracer.h
 
 SOURCES += dllmain.cpp \
            classmemorytracer.cpp \
@@ -39,7 +67,24 @@ SOURCES += dllmain.cpp \
            networkuploadrequest.cpp \
            networkrunnable.cpp \
            networkreply.cpp \
-           networkmanager.cpp
+           networkmanager.cpp \
+           networkfileinfocache.cpp \
+           networkdiskwriter.cpp \
+           networkbufferpool.cpp \
+           networkchecksum.cpp \
+           networkfilerangedevice.cpp \
+           networkmtuploadrequest.cpp \
+           networkformuploadrequest.cpp \
+           networkcompressor.cpp \
+           networkrequesttemplate.cpp \
+           networktlssessioncache.cpp \
+           networkcookiejar.cpp \
+           networkcredentialstore.cpp \
+           networkredirectcache.cpp \
+           networkaccessmanager.cpp \
+           networkstatistics.cpp \
+           networkmetricsexporter.cpp \
+           networktracer.cpp
 
 greaterThan(QT_MAJOR_VERSION, 4) {
     TARGET_ARCH=$${QT_ARCH}
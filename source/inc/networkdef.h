@@ -4,8 +4,18 @@
 #include <QUrl>
 #include <QEvent>
 #include <QMap>
+#include <QList>
+#include <QPair>
+#include <QStringList>
 #include <QByteArray>
 #include <QVariant>
+#include <QNetworkProxy>
+#ifndef QT_NO_SSL
+#include <QSslConfiguration>
+#endif
+#include <memory>
+
+class QIODevice;
 
 #pragma pack(push, _CRT_PACKING)
 
@@ -30,10 +40,98 @@ enum RequestType
     eTypeDelete = 6,
     // HEAD方式请求（支持http(s)）
     eTypeHead = 7,
+    // Multi-Part Upload（支持http(s)）
+    eTypeMTUpload = 8,
+    // multipart/form-data多文件上传（支持http(s)）
+    eTypeFormUpload = 9,
 
     eTypeUnknown = -1,
 };
 
+// 下载内容的校验算法
+enum HashAlgorithm
+{
+    eHashNone = 0,
+    eHashSha256 = 1,
+    // CRC32C(Castagnoli)
+    eHashCrc32c = 2,
+};
+
+// 请求失败的类型
+enum RequestErrorType
+{
+    eErrorNone = 0,
+    // 网络、文件等一般错误
+    eErrorGeneral = 1,
+    // 下载内容的大小或摘要与期望的不一致(RequestTask::eHashAlgorithm/iExpectedSize)
+    eErrorIntegrity = 2,
+};
+
+// 请求体的压缩格式(Content-Encoding)
+enum ContentEncoding
+{
+    eEncodingIdentity = 0,
+    eEncodingGzip = 1,
+    eEncodingDeflate = 2,
+    // 需要编译时开启zstd(qmake CONFIG+=zstd)
+    eEncodingZstd = 3,
+};
+
+// 下载文件的持久化策略
+enum DurabilityPolicy
+{
+    // 不主动刷新，由操作系统回写
+    eDurabilityNone = 0,
+    // 下载结束时把文件数据刷新到磁盘(fdatasync/FlushFileBuffers)后再提交
+    eDurabilitySyncOnClose = 1,
+    // 下载过程中定期刷新已写入的数据，结束时再刷新一次
+    eDurabilityWriteBehind = 2,
+};
+
+//请求各阶段的时间 (RequestTask::timing)
+//	 时间为单调时钟(std::chrono::steady_clock)的微秒数，只用于计算时间差；0表示没有经过该阶段.
+//	 一个任务发出多个请求时(重定向、多线程下载/上传)，连接、TLS、首字节取最早的一次，最后一个字节取最晚的一次.
+//	 Qt不提供DNS解析的时间，包含在iConnectStartUs到iTlsDoneUs/iRequestSentUs之间.
+struct RequestTiming
+{
+    // 加入线程池队列
+    qint64 iEnqueueUs;
+    // 开始在工作线程中执行
+    qint64 iDispatchUs;
+    // 开始连接：发出第一个请求(Qt 6.3及以上为socket开始连接)
+    qint64 iConnectStartUs;
+    // TLS握手完成(https新连接)
+    qint64 iTlsDoneUs;
+    // 请求发送完：请求体发送完(Qt 6.3及以上为requestSent()，Qt 6.3以下没有请求体时为0)
+    qint64 iRequestSentUs;
+    // 收到响应头(首字节)
+    qint64 iFirstByteUs;
+    // 最后一个响应接收完
+    qint64 iLastByteUs;
+    // 结果交给调用者(主线程)
+    qint64 iDeliveredUs;
+    // 发送/接收的字节数(不含HTTP头，接收的是压缩的字节数)
+    qint64 iBytesSent;
+    qint64 iBytesReceived;
+    // 发出的请求数(包括重定向、分块、多个下载通道)
+    int nRequests;
+
+    RequestTiming()
+    {
+        iEnqueueUs = 0;
+        iDispatchUs = 0;
+        iConnectStartUs = 0;
+        iTlsDoneUs = 0;
+        iRequestSentUs = 0;
+        iFirstByteUs = 0;
+        iLastByteUs = 0;
+        iDeliveredUs = 0;
+        iBytesSent = 0;
+        iBytesReceived = 0;
+        nRequests = 0;
+    }
+};
+
 //请求结构
 struct RequestTask
 {
@@ -50,11 +148,21 @@ struct RequestTask
     QUrl url;
 
     // case eTypeDownload:	下载的文件存放的本地目录. (绝对路径 or 相对路径)
-    // case eTypeUpload：	待上传的文件路径. (绝对路径 or 相对路径)
+    // case eTypeUpload/eTypeMTUpload：	待上传的文件路径. (绝对路径 or 相对路径)
     // case eTypePost：		post的参数. 如："a=b&c=d".
     // case eTypePut：		put的数据流.
+    // 注：eTypePost/eTypePut设置了bytesReqBody或pReqBodyDevice时忽略strReqArg
     QString strReqArg;
 
+    // eTypePost/eTypePut的二进制请求体，不为空时代替strReqArg(不做编码转换). 注：QByteArray是隐式共享的，
+    //	 任务在线程间传递、失败重试时都不复制数据.
+    QByteArray bytesReqBody;
+    // eTypePost/eTypePut的流式请求体，不为空时代替bytesReqBody/strReqArg，由QNetworkAccessManager边读边发送.
+    //	 未打开时以只读方式打开. 设备在工作线程中被读取，请求结束前调用者不要访问它，且不要有其他线程的parent
+    //	 (如QFile、QBuffer). 可随机访问的设备每次发送(重定向、失败重试)前回到开头；顺序设备(isSequential())只能发送一次，
+    //	 失败后不重试. 流式请求体不压缩(eRequestEncoding被忽略)，没有设置Content-Length时按size()发送.
+    std::shared_ptr<QIODevice> pReqBodyDevice;
+
     // case eTypeDownload: 若指定了strSaveFileName，则保存的文件名是strSaveFileName;否则，根据url.
     QString strSaveFileName;
 
@@ -62,6 +170,10 @@ struct RequestTask
     //void QNetworkRequest::setRawHeader(const QByteArray &headerName, const QByteArray &value);
     QMap<QByteArray, QByteArray> mapRawHeader;
 
+    // 请求模板id(NetworkManager::addRequestTemplate()的返回值)，0表示使用默认模板(NetworkManager::setDefaultRequestTemplate())，默认为0.
+    //	 url是相对url时相对模板的baseUrl解析；模板的header、TLS配置、超时和代理作为默认值，mapRawHeader中同名的header优先.
+    quint32 uiTemplateId;
+
     // 是否显示进度，默认为false.
     bool bShowProgress;
 
@@ -77,12 +189,102 @@ struct RequestTask
     // 上传文件使用PUT方式，否则POST方式，仅HTTP(s)有效，默认为true.
     bool bUploadUsePut;
 
+    // 断点续传上传(需服务器支持，参考php/resumable.php)，默认为false. 注：eType为eTypeUpload并且是http(s)时有效
+    //	 先用HEAD请求(url附加uploadid/size参数)从响应头Upload-Offset获取服务器已收到的字节数，再从该位置
+    //	 带Content-Range上传剩余部分. 上传id保存在本地状态文件中，进程重启后对同一文件、同一url的上传可以继续.
+    //	 上传中断时重新查询位置后继续，最多nUploadPartRetry次.
+    bool bResumableUpload;
+
+    // QNetworkReply的读缓冲区上限(字节)，默认为512KB，0表示不限制. 注：下载(eTypeDownload/eTypeMTDownload)时有效
+    //	 缓冲区满时暂停从socket读取，每个下载(通道)占用的内存有上限.
+    qint64 iReadBufferSize;
+
+    // 分块上传(需服务器支持，参考php/mtupload.php) 注：eType为eTypeMTUpload时有效
+    //	 文件按iUploadPartSize分成多块，由nUploadThreadCount个连接同时上传. 每块是一个PUT/POST请求，
+    //	 url上附加uploadid/part/parts参数，并带Content-Range头；出错的块单独重试，最多nUploadPartRetry次.
+    //	 全部上传后再发送一个提交请求(url附加uploadid/commit/parts/size参数)，由服务器按顺序合并.
+    // 每块的大小(默认8MB)
+    qint64 iUploadPartSize;
+    // 同时上传的连接数(默认是4)(取值范围1-6)
+    quint16 nUploadThreadCount;
+    // 每块失败后的重试次数(默认是3)
+    quint16 nUploadPartRetry;
+
+    // 多文件表单上传 注：eType为eTypeFormUpload时有效
+    //	 以multipart/form-data格式在一个请求中上传listFormFile中的文件(为空时上传strReqArg目录下的所有文件)和mapFormField中的表单字段.
+    //	 文件在发送到该文件时才打开，发送完即关闭. iFormBundleSize大于0时，按该大小把文件打包成多个请求(每个请求都带mapFormField)，
+    //	 由nUploadThreadCount个连接同时上传，失败的请求单独重试nUploadPartRetry次.
+    QStringList listFormFile;
+    QMap<QString, QString> mapFormField;
+    // 文件字段的名称(默认是"sendfile[]")，文件名为相对strReqArg目录的路径或文件名
+    QString strFormFileField;
+    // 每个请求的最大文件总大小(超过该大小的文件单独一个请求)，0表示所有文件在一个请求中上传(默认是0)
+    qint64 iFormBundleSize;
+
     // 单文件多线程下载模式(需服务器支持) 注：eType为eTypeMTDownload时有效
     //	 多线程下载模式下，一个文件由多个下载通道同时下载.
     //	 需要先获取http head的Content-Length，所以需要服务器的支持.
     // n个下载通道(默认是5)(取值范围2-10)
     quint16 nDownloadThreadCount;
 
+    // 自动选择下载通道数，默认为false. 注：eType为eTypeMTDownload时有效
+    //	 先用2个通道下载并测量总下载速度，每增加一个通道若仍能明显提升总速度则继续增加(最多10个)，
+    //	 否则停止增加，若速度反而下降则减少一个通道. 开启后nDownloadThreadCount被忽略.
+    bool bAutoDownloadThreadCount;
+
+    // 不单独发送HEAD请求获取文件大小，默认为false. 注：eType为eTypeMTDownload时有效
+    //	 第一个通道直接用Range: bytes=0-请求整个文件，从响应的Content-Range获取文件大小后，
+    //	 再把剩余部分分给其他通道. 省去HEAD请求的往返时间. (保存的文件名不考虑重定向后的url)
+    bool bSkipFileSizeRequest;
+
+    // 智能下载模式，默认为false. 注：eType为eTypeDownload且为http(s)时有效，仅Windows有效(其他平台按单通道下载)
+    //	 先按普通下载请求文件，若响应头的Content-Length不小于iAutoMTDownloadMinSize并且Accept-Ranges: bytes，
+    //	 则自动把剩余部分分给多个下载通道(nDownloadThreadCount/bAutoDownloadThreadCount)；否则按单通道下载.
+    //	 (同bSkipFileSizeRequest，保存的文件名不考虑重定向后的url)
+    bool bAutoMTDownload;
+    // 智能下载模式下，启用多通道下载的最小文件大小(默认10MB)
+    qint64 iAutoMTDownloadMinSize;
+
+    // 多线程下载的镜像地址(与url是同一个文件)，默认为空. 注：多通道下载时有效
+    //	 下载通道按各镜像测得的速度分配到url和各镜像上；某个镜像出错时丢弃该镜像，其未下载的部分交给其他镜像.
+    //	 各镜像返回的文件大小和ETag必须与url一致，否则视为出错.
+    QList<QUrl> listMirrorUrl;
+
+    // 下载到内存，默认为false. 注：eType为eTypeMTDownload时有效
+    //	 不创建本地文件(strReqArg/strSaveFileName被忽略)，按文件大小预先分配一块内存，各下载通道直接写入各自的区间，
+    //	 下载的内容在bytesContent中返回. 适用于下载后直接解析的中等大小的数据(不超过1GB).
+    bool bDownloadToMemory;
+
+    // 使用内存映射文件，默认为false. 注：eType为eTypeMTDownload并且是64位程序时有效(多线程下载只支持win32)
+    //	 按文件大小扩展本地文件后映射整个文件，各下载通道把数据直接读入各自的映射区间，不再调用写文件，并定时刷新到磁盘.
+    //	 文件大小未知、大于iMemoryMapMaxSize或映射失败时，仍由写文件线程按位置写入.
+    bool bMemoryMappedFile;
+    // 使用内存映射文件的最大文件大小(默认4GB)
+    qint64 iMemoryMapMaxSize;
+
+    // 下载内容的校验算法，默认为eHashNone. 注：下载(eTypeDownload/eTypeMTDownload)时有效
+    //	 在下载过程中增量计算摘要，不用下载后再读一遍文件(多线程下载的CRC32C按通道分别计算后合并；
+    //	 SHA-256在所有通道结束后对内存、映射的文件或文件计算一遍). 与期望值不一致时请求失败，eErrorType为eErrorIntegrity.
+    HashAlgorithm eHashAlgorithm;
+    // 期望的摘要(十六进制字符串，CRC32C为8位)
+    QByteArray bytesExpectedDigest;
+    // 期望的文件大小，-1表示不校验
+    qint64 iExpectedSize;
+
+    // 先下载到临时文件(文件名后加".part")，成功后再改名为目标文件，默认为true. 注：下载到本地文件时有效
+    //	 下载过程中目标文件不可见，失败时只删除临时文件；bReplaceFileIfExist为true时已存在的文件在下载成功后才被替换.
+    bool bAtomicCommit;
+    // 下载文件的持久化策略，默认为eDurabilityNone
+    DurabilityPolicy eDurability;
+
+    // 请求体的压缩格式，默认为eEncodingIdentity(不压缩). 注：http(s)的eTypePost/eTypePut/eTypeUpload时有效
+    //	 在请求所在的工作线程中压缩，并设置Content-Encoding头. 上传文件时分块压缩到临时文件，再带Content-Length从临时文件发送，
+    //	 内存占用与文件大小无关；压缩失败或没有变小时按原样上传.
+    //	 断点续传上传不压缩(服务器的位置是原始文件的位置). 不支持的格式按原样发送.
+    ContentEncoding eRequestEncoding;
+    // 请求体小于该大小时不压缩(默认1KB)
+    qint64 iCompressMinSize;
+
     // 用户自定义内容（可用于回传）
     QVariant varArg1;
     // 用户自定义内容（可用于回传）
@@ -102,6 +304,16 @@ struct RequestTask
     QByteArray bytesContent;
     // 返回的错误信息
     QString strError;
+    // 失败的类型
+    RequestErrorType eErrorType;
+
+    // 多线程下载实际使用的下载通道数 (eTypeMTDownload)
+    quint16 nActualDownloadThreadCount;
+    // 多线程下载测得的单个通道的下载速度，单位: 字节/秒 (eTypeMTDownload)
+    qint64 iChannelBytesPerSecond;
+
+    // 各阶段的时间和收发的字节数
+    RequestTiming timing;
 
     // 请求ID
     quint64 uiId;
@@ -112,6 +324,7 @@ struct RequestTask
     {
         uiId = 0;
         uiBatchId = 0;
+        uiTemplateId = 0;
         eType = eTypeUnknown;
         bFinished = false;
         bCancel = false;
@@ -121,12 +334,255 @@ struct RequestTask
         bTryAgainIfFailed = false;
         bAbortBatchWhenFailed = false;
         nDownloadThreadCount = 5;
+        bAutoDownloadThreadCount = false;
+        bSkipFileSizeRequest = false;
+        bAutoMTDownload = false;
+        iAutoMTDownloadMinSize = 10 * 1024 * 1024;
+        bDownloadToMemory = false;
+        bMemoryMappedFile = false;
+        iMemoryMapMaxSize = 4LL * 1024 * 1024 * 1024;
+        eHashAlgorithm = eHashNone;
+        iExpectedSize = -1;
+        bAtomicCommit = true;
+        eDurability = eDurabilityNone;
+        eRequestEncoding = eEncodingIdentity;
+        iCompressMinSize = 1024;
+        eErrorType = eErrorNone;
+        nActualDownloadThreadCount = 0;
+        iChannelBytesPerSecond = 0;
         bUploadUsePut = true;
+        bResumableUpload = false;
+        iReadBufferSize = 512 * 1024;
+        iUploadPartSize = 8 * 1024 * 1024;
+        nUploadThreadCount = 4;
+        nUploadPartRetry = 3;
+        strFormFileField = QStringLiteral("sendfile[]");
+        iFormBundleSize = 0;
     }
 };
 Q_DECLARE_METATYPE(RequestTask);
 typedef QVector<RequestTask> BatchRequestTask;
 
+//请求模板 (NetworkManager::addRequestTemplate())
+//	 同一服务的请求共用的设置. 模板在添加时构建一次，之后只读，被所有工作线程的请求共享；
+//	 每个请求只在模板的基础上设置自己的url和header.
+struct RequestTemplate
+{
+    // 基础url，如"https://api.example.com/v1/". RequestTask::url是相对url(如"list?page=1")时相对它解析
+    QUrl baseUrl;
+    // 默认的header
+    QMap<QByteArray, QByteArray> mapRawHeader;
+#ifndef QT_NO_SSL
+    // https的TLS配置. 为空(isNull())时按下面的eSslProtocol/bVerifyPeer创建；不为空时只使用bTlsSessionResumption
+    QSslConfiguration sslConfiguration;
+    // 允许的TLS版本，默认为TLS 1.2及以上(Qt 5.12以上并且OpenSSL支持时协商TLS 1.3，握手少一次往返)
+    QSsl::SslProtocol eSslProtocol;
+    // 验证服务器证书，默认为true
+    bool bVerifyPeer;
+#endif
+    // TLS会话恢复，默认为true. 握手后保存服务器发放的会话票据(进程内按host:port共享)，到同一服务器的新连接恢复会话
+    bool bTlsSessionResumption;
+    // 使用进程内共享的Cookie，默认为true. 一个请求收到的Cookie(如登录后的会话)对之后所有线程的请求都可见
+    bool bSharedCookies;
+    // 传输超时(ms)：超过该时长没有收发任何数据时请求失败，0表示不限制，默认为0. (Qt 5.15及以上有效)
+    int iTransferTimeout;
+    // 代理，默认为QNetworkProxy::DefaultProxy(使用QNetworkProxy::applicationProxy())
+    QNetworkProxy proxy;
+
+    RequestTemplate()
+    {
+        iTransferTimeout = 0;
+        bTlsSessionResumption = true;
+        bSharedCookies = true;
+#ifndef QT_NO_SSL
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+        eSslProtocol = QSsl::TlsV1_2OrLater;
+#else
+        eSslProtocol = QSsl::SecureProtocols;
+#endif
+        bVerifyPeer = true;
+#endif
+    }
+};
+
+//TLS握手的统计信息 (NetworkManager::tlsSessionMetrics())
+struct TlsSessionMetrics
+{
+    // 没有可用的缓存会话，完整握手的次数
+    quint64 uiFullHandshakes;
+    // 带缓存的会话票据发起握手(恢复会话)的次数. 注：服务器不接受票据时退回完整握手，Qt无法区分，仍计入这里
+    quint64 uiResumedHandshakes;
+    // 当前缓存的会话数
+    int nCachedSessions;
+
+    TlsSessionMetrics()
+    {
+        uiFullHandshakes = 0;
+        uiResumedHandshakes = 0;
+        nCachedSessions = 0;
+    }
+};
+
+//重定向缓存的统计信息 (NetworkManager::redirectCacheMetrics())
+struct RedirectCacheMetrics
+{
+    // 请求开始前查到缓存的重定向(直接请求最终url)的次数
+    quint64 uiHits;
+    // 没有缓存的重定向的次数
+    quint64 uiMisses;
+    // 保存的重定向数
+    quint64 uiInserts;
+    // 缓存满时淘汰的重定向数
+    quint64 uiEvictions;
+    // 当前缓存的重定向数
+    int nEntries;
+
+    RedirectCacheMetrics()
+    {
+        uiHits = 0;
+        uiMisses = 0;
+        uiInserts = 0;
+        uiEvictions = 0;
+        nEntries = 0;
+    }
+};
+
+//异步写文件的统计信息 (NetworkManager::diskWriterMetrics())
+struct DiskWriterMetrics
+{
+    // 当前排队等待写入的数据量(字节)和数据块数
+    qint64 iQueuedBytes;
+    int nQueueDepth;
+    // 排队数据量的峰值
+    qint64 iPeakQueuedBytes;
+    // 网络线程提交的数据块数(合并前)
+    quint64 uiSubmitCount;
+    // 实际写入的次数和字节数(合并后)
+    quint64 uiWriteCount;
+    quint64 uiBytesWritten;
+    // 写入耗时，单位: 微秒. 平均耗时 = iTotalWriteLatencyUs / uiWriteCount
+    qint64 iTotalWriteLatencyUs;
+    qint64 iMaxWriteLatencyUs;
+    // 排队数据超过上限时网络线程等待的次数和总时长(ms)
+    quint64 uiBackPressureCount;
+    qint64 iBackPressureMs;
+    // 刷新到磁盘的次数和总耗时(ms)
+    quint64 uiSyncCount;
+    qint64 iSyncMs;
+
+    DiskWriterMetrics()
+    {
+        iQueuedBytes = 0;
+        nQueueDepth = 0;
+        iPeakQueuedBytes = 0;
+        uiSubmitCount = 0;
+        uiWriteCount = 0;
+        uiBytesWritten = 0;
+        iTotalWriteLatencyUs = 0;
+        iMaxWriteLatencyUs = 0;
+        uiBackPressureCount = 0;
+        iBackPressureMs = 0;
+        uiSyncCount = 0;
+        iSyncMs = 0;
+    }
+};
+
+//请求耗时的分布(从加入队列到接收完，单位: 微秒)
+//	 对数-线性直方图：每个2的幂区间分成8个桶，分位数的误差不超过12.5%
+struct LatencySummary
+{
+    quint64 uiCount;
+    qint64 iP50Us;
+    qint64 iP90Us;
+    qint64 iP99Us;
+    qint64 iP999Us;
+    qint64 iMaxUs;
+    // 所有耗时之和. 平均耗时 = iSumUs / uiCount
+    qint64 iSumUs;
+    // 累计分布: (上界, 耗时不超过上界的请求数). 上界是2的幂减1，从约1毫秒到约19小时，
+    //	 每种请求类型的上界相同(Prometheus histogram的le)
+    QList<QPair<qint64, quint64>> listBucket;
+
+    LatencySummary()
+    {
+        uiCount = 0;
+        iP50Us = 0;
+        iP90Us = 0;
+        iP99Us = 0;
+        iP999Us = 0;
+        iMaxUs = 0;
+        iSumUs = 0;
+    }
+};
+
+//按请求类型/服务器统计的完成数
+struct RequestCountStatistics
+{
+    // 成功的请求数
+    quint64 uiCompleted;
+    // 失败的请求数(失败重试的每一次都计入)
+    quint64 uiFailed;
+    // 耗时分布(只在按请求类型统计时有效)
+    LatencySummary latency;
+
+    RequestCountStatistics()
+    {
+        uiCompleted = 0;
+        uiFailed = 0;
+    }
+};
+
+//运行时统计 (NetworkManager::statistics())
+//	 各工作线程只更新自己的计数器(无锁)，读取时合并，统计对请求的开销可以忽略.
+struct NetworkStatistics
+{
+    // 正在执行的请求数
+    int nInFlight;
+    // 在线程池队列中等待的请求数
+    int nQueued;
+    // 线程池的最大线程数
+    int nMaxThreads;
+
+    // 所有请求的成功/失败数
+    quint64 uiCompleted;
+    quint64 uiFailed;
+    // 失败后重试的次数(bTryAgainIfFailed)
+    quint64 uiRetries;
+    // 取消的请求数(stopRequest()/stopBatchRequests()/stopAllRequest())
+    quint64 uiCancellations;
+
+    // 按请求类型
+    QMap<RequestType, RequestCountStatistics> mapType;
+    // 按服务器(host)，每个线程最多统计256个服务器
+    QMap<QString, RequestCountStatistics> mapHost;
+
+    // 累计发送/接收的字节数(不含HTTP头)
+    qint64 iBytesSent;
+    qint64 iBytesReceived;
+    // 最近5秒的平均上传/下载速度，单位: 字节/秒
+    double dUploadBytesPerSecond;
+    double dDownloadBytesPerSecond;
+
+    DiskWriterMetrics diskWriter;
+    TlsSessionMetrics tlsSession;
+    RedirectCacheMetrics redirectCache;
+
+    NetworkStatistics()
+    {
+        nInFlight = 0;
+        nQueued = 0;
+        nMaxThreads = 0;
+        uiCompleted = 0;
+        uiFailed = 0;
+        uiRetries = 0;
+        uiCancellations = 0;
+        iBytesSent = 0;
+        iBytesReceived = 0;
+        dUploadBytesPerSecond = 0.0;
+        dDownloadBytesPerSecond = 0.0;
+    }
+};
+
 
 inline const QString getTypeString(const RequestType eType)
 {
@@ -173,6 +629,16 @@ inline const QString getTypeString(const RequestType eType)
         strType = QStringLiteral("HEAD");
     }
     break;
+    case eTypeMTUpload:
+    {
+        strType = QStringLiteral("MT上传");
+    }
+    break;
+    case eTypeFormUpload:
+    {
+        strType = QStringLiteral("表单上传");
+    }
+    break;
     default:
         break;
     }
@@ -21,6 +21,7 @@ That must be called in the main thread.
 
 #include <QObject>
 #include <atomic>
+#include <QNetworkCookie>
 #include "networkreply.h"
 #include "networkdef.h"
 #include "network_global.h"
@@ -63,6 +64,60 @@ public:
     bool setMaxThreadCount(int iMax);
     int maxThreadCount();
 
+    // 异步写文件的统计信息(写入耗时、排队深度等)
+    static DiskWriterMetrics diskWriterMetrics();
+
+    // 添加请求模板(基础url、默认header、TLS配置、超时、代理)，返回模板id，由RequestTask::uiTemplateId引用
+    // 模板在这里构建一次，之后被所有请求共享. 可在initialize()之前调用，unInitialize()时清除所有模板
+    static quint32 addRequestTemplate(const RequestTemplate& tmpl);
+    // 移除请求模板. 已添加的任务不受影响，移除后再添加引用它的任务会失败(返回nullptr)
+    static bool removeRequestTemplate(quint32 uiTemplateId);
+    // 设置默认模板(不引用模板的请求使用，相对url相对它的baseUrl解析). 默认: TLS 1.2及以上、验证服务器证书、TLS会话恢复
+    //	 需要兼容自签名证书等旧的行为时设置bVerifyPeer为false
+    static void setDefaultRequestTemplate(const RequestTemplate& tmpl);
+
+    // TLS握手的统计信息(完整握手/恢复会话的次数)
+    static TlsSessionMetrics tlsSessionMetrics();
+
+    // 设置认证信息(所有线程的请求共享). url: 适用的服务器和路径前缀，如"https://api.example.com/v1/"
+    //	 收到401质询时按url和realm(为空时适用于任何realm)回答；bPreemptive为true时第一个请求就带上Basic认证头，
+    //	 省去质询的往返(只用于使用Basic认证的服务，http下密码是明文). unInitialize()时清除
+    static void setCredential(const QUrl& url, const QString& strUser, const QString& strPassword,
+        bool bPreemptive = false, const QString& strRealm = QString());
+    static bool removeCredential(const QUrl& url, const QString& strRealm = QString());
+
+    // 进程内共享的Cookie(RequestTemplate::bSharedCookies)，可用于保存/恢复登录状态. unInitialize()时清除
+    static QList<QNetworkCookie> sharedCookies();
+    static void setSharedCookies(const QList<QNetworkCookie>& cookies);
+    static void clearSharedCookies();
+
+    // 重定向缓存：301/308永久保存(直到被淘汰)，之后到同一url的请求开始前直接改用最终的url.
+    //	 302/307缓存iSeconds秒，0表示不缓存(默认). 使用缓存的url请求失败时移除该缓存
+    static void setTemporaryRedirectCacheTtl(int iSeconds);
+    // 重定向缓存的统计信息(命中次数等)
+    static RedirectCacheMetrics redirectCacheMetrics();
+
+    // 运行时统计: 正在执行/排队的请求数、成功/失败/重试/取消次数、按请求类型的耗时分布(p50/p90/p99/p99.9)、
+    //	 按服务器的计数、吞吐量，以及写文件/TLS/重定向缓存的统计. 可在任何线程调用，开销很小
+    NetworkStatistics statistics();
+    // 清零请求计数和耗时分布(其他模块的统计不受影响)
+    static void resetStatistics();
+
+    // 启动Prometheus指标导出: 在独立线程中监听127.0.0.1:uiPort，GET /metrics返回statistics()的文本格式.
+    //	 uiPort为0时由系统分配(metricsExporterPort()获取). 需要先initialize()，unInitialize()时停止
+    static bool startMetricsExporter(quint16 uiPort, QString *pError = nullptr);
+    static void stopMetricsExporter();
+    // 导出服务监听的端口，未启动时返回0
+    static quint16 metricsExporterPort();
+
+    // 请求时间线: 启用后记录每个请求的排队、执行、HTTP往返(含重定向)、多线程下载分段、写文件、结果通知的区间，
+    //	 每个线程保留最近的16384个区间. 未启用时几乎没有开销
+    static void setTraceEnabled(bool bEnable);
+    static bool isTraceEnabled();
+    // 输出Chrome trace-event JSON，可用Perfetto(ui.perfetto.dev)或chrome://tracing打开. unInitialize()后仍可调用
+    static bool writeTrace(const QString& strFilePath, QString *pError = nullptr);
+    static void clearTrace();
+
 Q_SIGNALS:
     void errorMessage(const QString& error);
     void batchRequestFinished(quint64 uiBatchId, bool bAllSuccess);
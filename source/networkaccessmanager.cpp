@@ -0,0 +1,130 @@
+﻿#include "networkaccessmanager.h"
+#include <QNetworkReply>
+#include "networkstatistics.h"
+#include "networktracer.h"
+#include "networkredirectcache.h"
+
+namespace
+{
+    //只记录第一次
+    void markOnce(qint64& iTimestamp)
+    {
+        if (0 == iTimestamp)
+        {
+            iTimestamp = networkTimestampUs();
+        }
+    }
+}
+
+NetworkAccessManager::NetworkAccessManager(std::shared_ptr<RequestTiming> pTiming, QObject *parent /* = nullptr */)
+    : QNetworkAccessManager(parent)
+    , m_pTiming(pTiming)
+{
+#ifndef QT_NO_SSL
+    connect(this, SIGNAL(encrypted(QNetworkReply *)), this, SLOT(onReplyEncrypted(QNetworkReply *)));
+#endif
+    connect(this, SIGNAL(finished(QNetworkReply *)), this, SLOT(onReplyFinished(QNetworkReply *)));
+}
+
+NetworkAccessManager::~NetworkAccessManager()
+{
+}
+
+QNetworkReply *NetworkAccessManager::createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    const bool bFirst = (0 == m_pTiming->nRequests);
+    ++m_pTiming->nRequests;
+    if (bFirst)
+    {
+        //Qt 6.3以下没有socket开始连接的信号，按发出第一个请求(开始DNS解析和连接)计
+        m_pTiming->iConnectStartUs = networkTimestampUs();
+    }
+
+    QNetworkReply *pReply = QNetworkAccessManager::createRequest(op, request, outgoingData);
+    if (pReply)
+    {
+        ReplyState state;
+        state.iBytesSent = 0;
+        state.iBytesReceived = 0;
+        state.bFirst = bFirst;
+        state.iStartUs = NetworkTracer::isEnabled() ? networkTimestampUs() : 0;
+        m_hashReply.insert(pReply, state);
+
+        connect(pReply, SIGNAL(metaDataChanged()), this, SLOT(onMetaDataChanged()));
+        connect(pReply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(onDownloadProgress(qint64, qint64)));
+        connect(pReply, SIGNAL(uploadProgress(qint64, qint64)), this, SLOT(onUploadProgress(qint64, qint64)));
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+        connect(pReply, SIGNAL(socketStartedConnecting()), this, SLOT(onSocketStartedConnecting()));
+        connect(pReply, SIGNAL(requestSent()), this, SLOT(onRequestSent()));
+#endif
+    }
+    return pReply;
+}
+
+void NetworkAccessManager::onMetaDataChanged()
+{
+    markOnce(m_pTiming->iFirstByteUs);
+}
+
+void NetworkAccessManager::onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+{
+    Q_UNUSED(bytesTotal);
+    auto iter = m_hashReply.find(qobject_cast<QNetworkReply *>(sender()));
+    if (iter != m_hashReply.end() && bytesReceived > iter->iBytesReceived)
+    {
+        m_pTiming->iBytesReceived += bytesReceived - iter->iBytesReceived;
+        NetworkStatisticsCollector::addBytes(0, bytesReceived - iter->iBytesReceived);
+        iter->iBytesReceived = bytesReceived;
+    }
+}
+
+void NetworkAccessManager::onUploadProgress(qint64 bytesSent, qint64 bytesTotal)
+{
+    auto iter = m_hashReply.find(qobject_cast<QNetworkReply *>(sender()));
+    if (iter != m_hashReply.end() && bytesSent > iter->iBytesSent)
+    {
+        m_pTiming->iBytesSent += bytesSent - iter->iBytesSent;
+        NetworkStatisticsCollector::addBytes(bytesSent - iter->iBytesSent, 0);
+        iter->iBytesSent = bytesSent;
+    }
+#if QT_VERSION < QT_VERSION_CHECK(6, 3, 0)
+    //请求体发送完
+    if (bytesTotal > 0 && bytesSent >= bytesTotal)
+    {
+        markOnce(m_pTiming->iRequestSentUs);
+    }
+#endif
+}
+
+void NetworkAccessManager::onSocketStartedConnecting()
+{
+    auto iter = m_hashReply.find(qobject_cast<QNetworkReply *>(sender()));
+    if (iter != m_hashReply.end() && iter->bFirst)
+    {
+        m_pTiming->iConnectStartUs = networkTimestampUs();
+    }
+}
+
+void NetworkAccessManager::onRequestSent()
+{
+    markOnce(m_pTiming->iRequestSentUs);
+}
+
+void NetworkAccessManager::onReplyEncrypted(QNetworkReply *pReply)
+{
+    Q_UNUSED(pReply);
+    markOnce(m_pTiming->iTlsDoneUs);
+}
+
+void NetworkAccessManager::onReplyFinished(QNetworkReply *pReply)
+{
+    m_pTiming->iLastByteUs = networkTimestampUs();
+    if (NetworkTracer::isEnabled())
+    {
+        //每个HTTP往返(包括重定向的每一跳)
+        const int statusCode = pReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        NetworkTracer::addSpan(isRedirectStatus(statusCode) ? "redirect" : "http", "network",
+            m_hashReply.value(pReply).iStartUs, m_pTiming->iLastByteUs, true);
+    }
+    m_hashReply.remove(pReply);
+}
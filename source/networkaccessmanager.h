@@ -0,0 +1,54 @@
+﻿#ifndef NETWORKACCESSMANAGER_H
+#define NETWORKACCESSMANAGER_H
+
+#include <memory>
+#include <chrono>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include "networkdef.h"
+
+//RequestTiming使用的时钟：单调时钟的微秒数
+inline qint64 networkTimestampUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//记录各阶段时间的QNetworkAccessManager
+//请求通过NetworkRequest::createNetworkManager()创建它，所有reply都经过createRequest()，
+//在这里统一记录连接、TLS、首字节、结束的时间和收发的字节数，不用在每个请求类中处理.
+class NetworkAccessManager : public QNetworkAccessManager
+{
+    Q_OBJECT
+
+public:
+    //pTiming: 与NetworkRequest共享，请求结束后由NetworkRequest读取
+    explicit NetworkAccessManager(std::shared_ptr<RequestTiming> pTiming, QObject *parent = nullptr);
+    ~NetworkAccessManager();
+
+protected:
+    QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+    void onMetaDataChanged();
+    void onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
+    void onUploadProgress(qint64 bytesSent, qint64 bytesTotal);
+    void onSocketStartedConnecting();
+    void onRequestSent();
+    void onReplyEncrypted(QNetworkReply *pReply);
+    void onReplyFinished(QNetworkReply *pReply);
+
+private:
+    struct ReplyState
+    {
+        qint64 iBytesSent;
+        qint64 iBytesReceived;
+        bool bFirst;
+        qint64 iStartUs;
+    };
+
+    std::shared_ptr<RequestTiming> m_pTiming;
+    QHash<QNetworkReply*, ReplyState> m_hashReply;
+};
+
+#endif // NETWORKACCESSMANAGER_H
@@ -0,0 +1,63 @@
+﻿#include "networkbufferpool.h"
+#include <QIODevice>
+#include <QVector>
+#include <QThreadStorage>
+
+// 接收缓冲区的大小
+#define RECEIVE_BUFFER_SIZE (64 * 1024)
+// 每个线程最多缓存的缓冲区个数
+#define RECEIVE_BUFFER_POOL_SIZE 32
+
+namespace
+{
+    QThreadStorage<QVector<QByteArray>> s_pool;
+}
+
+QByteArray NetworkBufferPool::read(QIODevice *pDevice, qint64 nMaxSize)
+{
+    if (nullptr == pDevice || nMaxSize <= 0)
+    {
+        return QByteArray();
+    }
+
+    //没有被其他地方引用的缓冲区是空闲的
+    QVector<QByteArray>& pool = s_pool.localData();
+    QByteArray *pBuffer = nullptr;
+    for (int i = 0; i < pool.size(); i++)
+    {
+        if (pool[i].isDetached())
+        {
+            pBuffer = &pool[i];
+            break;
+        }
+    }
+    QByteArray bytesTemp;
+    if (nullptr == pBuffer)
+    {
+        if (pool.size() < RECEIVE_BUFFER_POOL_SIZE)
+        {
+            pool.append(QByteArray());
+            pBuffer = &pool.last();
+        }
+        else
+        {
+            //池中的缓冲区都在使用(如等待写入文件)，临时分配
+            pBuffer = &bytesTemp;
+        }
+    }
+
+    //缓冲区容量不变，resize()不会重新分配内存
+    pBuffer->resize(RECEIVE_BUFFER_SIZE);
+    const qint64 nRead = pDevice->read(pBuffer->data(), qMin<qint64>(nMaxSize, RECEIVE_BUFFER_SIZE));
+    if (nRead <= 0)
+    {
+        return QByteArray();
+    }
+    pBuffer->resize((int)nRead);
+    return *pBuffer;
+}
+
+int NetworkBufferPool::bufferSize()
+{
+    return RECEIVE_BUFFER_SIZE;
+}
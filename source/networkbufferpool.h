@@ -0,0 +1,19 @@
+﻿#ifndef NETWORKBUFFERPOOL_H
+#define NETWORKBUFFERPOOL_H
+
+#include <QByteArray>
+
+class QIODevice;
+
+//接收缓冲区池
+//每个线程有一组固定大小的缓冲区，读取网络数据时复用这些缓冲区，不再每次readAll()都分配新的内存.
+//返回的QByteArray与池中的缓冲区共享数据，不再被引用(如写入文件后)即自动回到池中.
+class NetworkBufferPool
+{
+public:
+    //从pDevice读取最多nMaxSize字节(不超过bufferSize())到当前线程池中空闲的缓冲区
+    static QByteArray read(QIODevice *pDevice, qint64 nMaxSize);
+    static int bufferSize();
+};
+
+#endif // NETWORKBUFFERPOOL_H
@@ -0,0 +1,279 @@
+﻿#include "networkchecksum.h"
+#include <string.h>
+#include <QCryptographicHash>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CRC32C_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(CRC32C_X86) && defined(__GNUC__)
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#else
+#define CRC32C_TARGET
+#endif
+
+namespace
+{
+    // CRC32C多项式(反转)
+    const quint32 CRC32C_POLY = 0x82F63B78;
+
+    struct Crc32cTable
+    {
+        quint32 table[256];
+        Crc32cTable()
+        {
+            for (quint32 i = 0; i < 256; i++)
+            {
+                quint32 crc = i;
+                for (int j = 0; j < 8; j++)
+                {
+                    crc = (crc & 1) ? ((crc >> 1) ^ CRC32C_POLY) : (crc >> 1);
+                }
+                table[i] = crc;
+            }
+        }
+    };
+    const Crc32cTable s_crc32cTable;
+
+    quint32 updateCrc32cSoftware(quint32 crc, const uchar *p, qint64 nSize)
+    {
+        while (nSize-- > 0)
+        {
+            crc = s_crc32cTable.table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#ifdef CRC32C_X86
+    bool detectSse42()
+    {
+#ifdef _MSC_VER
+        int info[4] = { 0 };
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        unsigned int a = 0, b = 0, c = 0, d = 0;
+        return __get_cpuid(1, &a, &b, &c, &d) && (c & (1 << 20)) != 0;
+#endif
+    }
+
+    CRC32C_TARGET quint32 updateCrc32cHardware(quint32 crc, const uchar *p, qint64 nSize)
+    {
+        while (nSize > 0 && ((quintptr)p & 7) != 0)
+        {
+            crc = _mm_crc32_u8(crc, *p++);
+            nSize--;
+        }
+#if defined(_M_X64) || defined(__x86_64__)
+        quint64 crc64 = crc;
+        while (nSize >= 8)
+        {
+            quint64 value;
+            memcpy(&value, p, 8);
+            crc64 = _mm_crc32_u64(crc64, value);
+            p += 8;
+            nSize -= 8;
+        }
+        crc = (quint32)crc64;
+#endif
+        while (nSize >= 4)
+        {
+            quint32 value;
+            memcpy(&value, p, 4);
+            crc = _mm_crc32_u32(crc, value);
+            p += 4;
+            nSize -= 4;
+        }
+        while (nSize-- > 0)
+        {
+            crc = _mm_crc32_u8(crc, *p++);
+        }
+        return crc;
+    }
+
+    const bool s_bHardwareCrc32c = detectSse42();
+#else
+    const bool s_bHardwareCrc32c = false;
+#endif
+
+    // GF(2)矩阵运算，用于合并CRC(同zlib的crc32_combine)
+    quint32 gf2MatrixTimes(const quint32 *mat, quint32 vec)
+    {
+        quint32 sum = 0;
+        while (vec)
+        {
+            if (vec & 1)
+            {
+                sum ^= *mat;
+            }
+            vec >>= 1;
+            mat++;
+        }
+        return sum;
+    }
+
+    void gf2MatrixSquare(quint32 *square, const quint32 *mat)
+    {
+        for (int n = 0; n < 32; n++)
+        {
+            square[n] = gf2MatrixTimes(mat, mat[n]);
+        }
+    }
+}
+
+NetworkChecksum::NetworkChecksum(HashAlgorithm eAlgorithm)
+    : m_eAlgorithm(eHashNone)
+    , m_uiCrc32c(0)
+{
+    reset(eAlgorithm);
+}
+
+NetworkChecksum::~NetworkChecksum()
+{
+}
+
+void NetworkChecksum::reset(HashAlgorithm eAlgorithm)
+{
+    m_eAlgorithm = eAlgorithm;
+    m_uiCrc32c = 0;
+    m_pHash.reset();
+    if (m_eAlgorithm == eHashSha256)
+    {
+        m_pHash.reset(new QCryptographicHash(QCryptographicHash::Sha256));
+    }
+}
+
+void NetworkChecksum::addData(const char *data, qint64 nSize)
+{
+    if (nSize <= 0)
+    {
+        return;
+    }
+    if (m_eAlgorithm == eHashCrc32c)
+    {
+        m_uiCrc32c = crc32c(m_uiCrc32c, data, nSize);
+    }
+    else if (m_pHash.get())
+    {
+        //QCryptographicHash::addData()的长度是int
+        while (nSize > 0)
+        {
+            const int nLen = (int)qMin<qint64>(nSize, 1 << 30);
+            m_pHash->addData(data, nLen);
+            data += nLen;
+            nSize -= nLen;
+        }
+    }
+}
+
+QByteArray NetworkChecksum::hexDigest() const
+{
+    if (m_eAlgorithm == eHashCrc32c)
+    {
+        return crc32cHex(m_uiCrc32c);
+    }
+    else if (m_pHash.get())
+    {
+        return m_pHash->result().toHex();
+    }
+    return QByteArray();
+}
+
+quint32 NetworkChecksum::crc32c(quint32 crc, const char *data, qint64 nSize)
+{
+    crc = ~crc;
+#ifdef CRC32C_X86
+    if (s_bHardwareCrc32c)
+    {
+        return ~updateCrc32cHardware(crc, (const uchar *)data, nSize);
+    }
+#endif
+    return ~updateCrc32cSoftware(crc, (const uchar *)data, nSize);
+}
+
+quint32 NetworkChecksum::crc32cSoftware(quint32 crc, const char *data, qint64 nSize)
+{
+    return ~updateCrc32cSoftware(~crc, (const uchar *)data, nSize);
+}
+
+quint32 NetworkChecksum::crc32cCombine(quint32 crc1, quint32 crc2, qint64 nLen2)
+{
+    if (nLen2 <= 0)
+    {
+        return crc1;
+    }
+
+    quint32 even[32];
+    quint32 odd[32];
+    //一个0比特的运算矩阵
+    odd[0] = CRC32C_POLY;
+    quint32 row = 1;
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    //2个0比特
+    gf2MatrixSquare(even, odd);
+    //4个0比特
+    gf2MatrixSquare(odd, even);
+
+    //在crc1后追加nLen2个0字节
+    do
+    {
+        gf2MatrixSquare(even, odd);
+        if (nLen2 & 1)
+        {
+            crc1 = gf2MatrixTimes(even, crc1);
+        }
+        nLen2 >>= 1;
+        if (nLen2 == 0)
+        {
+            break;
+        }
+        gf2MatrixSquare(odd, even);
+        if (nLen2 & 1)
+        {
+            crc1 = gf2MatrixTimes(odd, crc1);
+        }
+        nLen2 >>= 1;
+    } while (nLen2 != 0);
+
+    return crc1 ^ crc2;
+}
+
+QByteArray NetworkChecksum::crc32cHex(quint32 crc)
+{
+    return QByteArray::number(crc, 16).rightJustified(8, '0');
+}
+
+bool NetworkChecksum::hardwareCrc32c()
+{
+    return s_bHardwareCrc32c;
+}
+
+bool NetworkChecksum::verify(const RequestTask& task, const QByteArray& bytesHexDigest, qint64 iSize, QString& strError)
+{
+    if (task.iExpectedSize >= 0 && task.iExpectedSize != iSize)
+    {
+        strError = QStringLiteral("Integrity check failed: size %1, expected %2").arg(iSize).arg(task.iExpectedSize);
+        return false;
+    }
+    if (task.eHashAlgorithm != eHashNone)
+    {
+        const QByteArray& bytesExpected = task.bytesExpectedDigest.trimmed().toLower();
+        if (bytesExpected != bytesHexDigest)
+        {
+            strError = QStringLiteral("Integrity check failed: digest %1, expected %2")
+                .arg(QString::fromLatin1(bytesHexDigest)).arg(QString::fromLatin1(bytesExpected));
+            return false;
+        }
+    }
+    return true;
+}
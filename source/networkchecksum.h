@@ -0,0 +1,46 @@
+﻿#ifndef NETWORKCHECKSUM_H
+#define NETWORKCHECKSUM_H
+
+#include <memory>
+#include <QByteArray>
+#include <QString>
+#include "networkdef.h"
+
+class QCryptographicHash;
+
+//增量计算下载内容的摘要(RequestTask::eHashAlgorithm)
+//CRC32C在支持SSE4.2的CPU上使用硬件指令计算
+class NetworkChecksum
+{
+public:
+    explicit NetworkChecksum(HashAlgorithm eAlgorithm = eHashNone);
+    ~NetworkChecksum();
+
+    void reset(HashAlgorithm eAlgorithm);
+    void addData(const char *data, qint64 nSize);
+    void addData(const QByteArray& data) { addData(data.constData(), data.size()); }
+    //摘要的十六进制字符串(小写)
+    QByteArray hexDigest() const;
+    HashAlgorithm algorithm() const { return m_eAlgorithm; }
+
+    //CRC32C(Castagnoli). crc为之前数据的CRC32C(初始为0)
+    static quint32 crc32c(quint32 crc, const char *data, qint64 nSize);
+    //不使用硬件指令的查表计算(测试时与crc32c()对照)
+    static quint32 crc32cSoftware(quint32 crc, const char *data, qint64 nSize);
+    //合并两段相邻数据的CRC32C: crc32c(A+B) = crc32cCombine(crc32c(A), crc32c(B), B的长度)
+    static quint32 crc32cCombine(quint32 crc1, quint32 crc2, qint64 nLen2);
+    static QByteArray crc32cHex(quint32 crc);
+    //CPU是否支持硬件计算CRC32C
+    static bool hardwareCrc32c();
+
+    //检查下载内容的大小和摘要是否与RequestTask中期望的一致，不一致时设置strError
+    static bool verify(const RequestTask& task, const QByteArray& bytesHexDigest, qint64 iSize, QString& strError);
+
+private:
+    Q_DISABLE_COPY(NetworkChecksum);
+    HashAlgorithm m_eAlgorithm;
+    quint32 m_uiCrc32c;
+    std::unique_ptr<QCryptographicHash> m_pHash;
+};
+
+#endif // NETWORKCHECKSUM_H
@@ -2,10 +2,15 @@
 #include <QDebug>
 #include <QNetworkAccessManager>
 #include "Log4cplusWrapper.h"
+#include "networkcompressor.h"
+#include "networkredirectcache.h"
 
 
 NetworkCommonRequest::NetworkCommonRequest(QObject *parent /* = nullptr */)
     : NetworkRequest(parent)
+    , m_bNegotiateEncoding(false)
+    , m_bEncodingChecked(false)
+    , m_bBodyDeviceSent(false)
 {
 }
 
@@ -43,50 +48,59 @@ void NetworkCommonRequest::start()
         }
     }
 
-    if (nullptr == m_pNetworkManager)
-    {
-        m_pNetworkManager = new QNetworkAccessManager;
-    }
+    createNetworkManager();
     //m_pNetworkManager->connectToHost(url.host(), url.port());
 
-    QNetworkRequest request(url);
-
-    auto iter = m_request.mapRawHeader.cbegin();
-    for (; iter != m_request.mapRawHeader.cend(); ++iter)
-    {
-        request.setRawHeader(iter.key(), iter.value());
-    }
-
-#ifndef QT_NO_SSL
-    if (isHttpsProxy(url.scheme()))
-    {
-        // 发送https请求前准备工作;
-        QSslConfiguration conf = request.sslConfiguration();
-        conf.setPeerVerifyMode(QSslSocket::VerifyNone);
-        conf.setProtocol(QSsl::TlsV1SslV3);
-        request.setSslConfiguration(conf);
-    }
-#endif
+    QNetworkRequest request = createNetworkRequest(url);
 
     if (m_request.eType == eTypeGet)
     {
+        //协商压缩格式，由这里解压；调用者自己设置了Accept-Encoding或Range时不处理
+        m_bNegotiateEncoding = !request.hasRawHeader("Accept-Encoding") && !request.hasRawHeader("Range")
+            && (isHttpProxy(url.scheme()) || isHttpsProxy(url.scheme()));
+        m_bEncodingChecked = false;
+        m_decoder.reset();
+        m_bytesDecoded.clear();
+        if (m_bNegotiateEncoding)
+        {
+            request.setRawHeader("Accept-Encoding", NetworkDecompressor::acceptEncoding());
+        }
         m_pNetworkReply = m_pNetworkManager->get(request);
+        if (m_bNegotiateEncoding)
+        {
+            connect(m_pNetworkReply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        }
     }
-    else if (m_request.eType == eTypePost)
+    else if (m_request.eType == eTypePost || m_request.eType == eTypePut)
     {
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded;");
+        if (m_request.eType == eTypePost && !request.header(QNetworkRequest::ContentTypeHeader).isValid())
+        {
+            request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded;");
+        }
 
-        const QByteArray& bytes = m_request.strReqArg.toUtf8();
-        request.setHeader(QNetworkRequest::ContentLengthHeader, bytes.length());
+        if (m_request.pReqBodyDevice)
+        {
+            QIODevice *pDevice = requestDevice(request);
+            if (nullptr == pDevice)
+            {
+                LOG_ERROR(m_strError.toStdWString());
+                qDebug() << "[QMultiThreadNetwork]" << m_strError;
 
-        m_pNetworkReply = m_pNetworkManager->post(request, bytes);
-    }
-    else if (m_request.eType == eTypePut)
-    {
-        const QByteArray& bytes = m_request.strReqArg.toUtf8();
-        request.setHeader(QNetworkRequest::ContentLengthHeader, bytes.length());
+                emit requestFinished(false, QByteArray(), m_strError);
+                return;
+            }
+            m_pNetworkReply = (m_request.eType == eTypePost) ? m_pNetworkManager->post(request, pDevice)
+                : m_pNetworkManager->put(request, pDevice);
+            m_bBodyDeviceSent = true;
+        }
+        else
+        {
+            const QByteArray& bytes = requestBody(request);
+            request.setHeader(QNetworkRequest::ContentLengthHeader, bytes.length());
 
-        m_pNetworkReply = m_pNetworkManager->put(request, bytes);
+            m_pNetworkReply = (m_request.eType == eTypePost) ? m_pNetworkManager->post(request, bytes)
+                : m_pNetworkManager->put(request, bytes);
+        }
     }
     else if (m_request.eType == eTypeDelete)
     {
@@ -99,8 +113,96 @@ void NetworkCommonRequest::start()
 
     connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onFinished()));
     connect(m_pNetworkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
-    connect(m_pNetworkManager, SIGNAL(authenticationRequired(QNetworkReply *, QAuthenticator *)),
-        SLOT(onAuthenticationRequired(QNetworkReply *, QAuthenticator *)));
+}
+
+void NetworkCommonRequest::onReadyRead()
+{
+    if (nullptr == m_pNetworkReply || m_pNetworkReply->error() != QNetworkReply::NoError)
+    {
+        return;
+    }
+    if (!m_bEncodingChecked)
+    {
+        m_bEncodingChecked = true;
+        m_decoder.init(m_pNetworkReply->rawHeader("Content-Encoding"));
+    }
+    //未压缩的内容留在reply中，结束时readAll()
+    if (!m_decoder.isActive())
+    {
+        return;
+    }
+    while (m_pNetworkReply->bytesAvailable() > 0)
+    {
+        const QByteArray& bytes = m_pNetworkReply->read(m_pNetworkReply->bytesAvailable());
+        if (bytes.isEmpty() || !m_decoder.decode(bytes, m_bytesDecoded))
+        {
+            break;
+        }
+    }
+}
+
+QByteArray NetworkCommonRequest::requestBody(QNetworkRequest& request) const
+{
+    //bytesReqBody与任务共享数据，不复制
+    const QByteArray bytes = m_request.bytesReqBody.isEmpty() ? m_request.strReqArg.toUtf8() : m_request.bytesReqBody;
+    if (m_request.eRequestEncoding == eEncodingIdentity || bytes.size() < m_request.iCompressMinSize
+        || !(isHttpProxy(request.url().scheme()) || isHttpsProxy(request.url().scheme())))
+    {
+        return bytes;
+    }
+
+    //压缩请求体，失败时按原样发送
+    QByteArray bytesCompressed;
+    if (!NetworkCompressor::compress(bytes, m_request.eRequestEncoding, bytesCompressed))
+    {
+        LOG_INFO("Compress request body failed, encoding: " << m_request.eRequestEncoding);
+        qDebug() << "[QMultiThreadNetwork] Compress request body failed, encoding:" << m_request.eRequestEncoding;
+        return bytes;
+    }
+    if (bytesCompressed.size() >= bytes.size())
+    {
+        return bytes;
+    }
+    request.setRawHeader("Content-Encoding", NetworkCompressor::encodingName(m_request.eRequestEncoding));
+    return bytesCompressed;
+}
+
+QIODevice *NetworkCommonRequest::requestDevice(QNetworkRequest& request)
+{
+    QIODevice *pDevice = m_request.pReqBodyDevice.get();
+    if (!pDevice->isOpen() && !pDevice->open(QIODevice::ReadOnly))
+    {
+        m_strError = QStringLiteral("Error: open request body device failed, %1").arg(pDevice->errorString());
+        return nullptr;
+    }
+    if (!pDevice->isReadable())
+    {
+        m_strError = QStringLiteral("Error: request body device is not readable");
+        return nullptr;
+    }
+
+    if (pDevice->isSequential())
+    {
+        //顺序设备只能读一遍(重定向后无法再发送)
+        if (m_bBodyDeviceSent)
+        {
+            m_strError = QStringLiteral("Error: sequential request body can not be resent, redirectUrl: %1").arg(m_redirectUrl.toString());
+            return nullptr;
+        }
+    }
+    else
+    {
+        if (!pDevice->seek(0))
+        {
+            m_strError = QStringLiteral("Error: seek request body device failed, %1").arg(pDevice->errorString());
+            return nullptr;
+        }
+        if (!request.header(QNetworkRequest::ContentLengthHeader).isValid())
+        {
+            request.setHeader(QNetworkRequest::ContentLengthHeader, pDevice->size());
+        }
+    }
+    return pDevice;
 }
 
 void NetworkCommonRequest::onFinished()
@@ -113,13 +215,14 @@ void NetworkCommonRequest::onFinished()
     }
     if (!bSuccess)
     {
-        if (statusCode == 301 || statusCode == 302)
-        {//301,302重定向
+        if (isRedirectStatus(statusCode))
+        {//301,302,307,308重定向
             const QVariant& redirectionTarget = m_pNetworkReply->attribute(QNetworkRequest::RedirectionTargetAttribute);
             if (!redirectionTarget.isNull())
             {
                 const QUrl& url = m_request.url;
                 const QUrl& redirectUrl = url.resolved(redirectionTarget.toUrl());
+                NetworkRedirectCache::insert(m_pNetworkReply->url(), redirectUrl, statusCode);
                 if (url != redirectUrl && m_redirectUrl != redirectUrl)
                 {
                     m_redirectUrl = redirectUrl;
@@ -161,7 +264,20 @@ void NetworkCommonRequest::onFinished()
         {
             if (m_pNetworkReply->isOpen())
             {
-                if (bSuccess)
+                if (bSuccess && m_decoder.isActive())
+                {
+                    onReadyRead();
+                    bytes = m_bytesDecoded;
+                    if (!m_decoder.finished() || !m_decoder.errorString().isEmpty())
+                    {
+                        bSuccess = false;
+                        bytes.clear();
+                        m_strError = m_decoder.errorString().isEmpty()
+                            ? QStringLiteral("Error: compressed content is truncated") : m_decoder.errorString();
+                    }
+                    m_bytesDecoded.clear();
+                }
+                else if (bSuccess)
                 {
                     bytes = m_pNetworkReply->readAll();
                 }
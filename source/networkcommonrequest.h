@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include "networkrequest.h"
+#include "networkcompressor.h"
 
 
 //一般请求
@@ -17,6 +18,23 @@ public:
 public Q_SLOTS:
     void start() Q_DECL_OVERRIDE;
     void onFinished() Q_DECL_OVERRIDE;
+    //GET：收到数据时增量解压
+    void onReadyRead();
+
+private:
+    //POST/PUT的请求体，按RequestTask::eRequestEncoding压缩并设置Content-Encoding
+    QByteArray requestBody(QNetworkRequest& request) const;
+    //POST/PUT的流式请求体(RequestTask::pReqBodyDevice)，打开并回到开头，失败时返回nullptr
+    QIODevice *requestDevice(QNetworkRequest& request);
+
+private:
+    //GET协商了压缩格式(Accept-Encoding)时，按响应的Content-Encoding解压
+    bool m_bNegotiateEncoding;
+    bool m_bEncodingChecked;
+    //流式请求体已经发送过(顺序设备不能再发送)
+    bool m_bBodyDeviceSent;
+    NetworkDecompressor m_decoder;
+    QByteArray m_bytesDecoded;
 };
 
 #endif // NETWORKCOMMONREQUEST_H
\ No newline at end of file
@@ -0,0 +1,570 @@
+﻿#include "networkcompressor.h"
+#include <string.h>
+#include <QIODevice>
+#include <QtZlib/zlib.h>
+#ifdef QT_MTNETWORK_ZSTD
+#include <zstd.h>
+#endif
+#ifdef QT_MTNETWORK_BROTLI
+#include <brotli/decode.h>
+#endif
+
+// 每次压缩的输入/输出块大小
+#define COMPRESS_CHUNK_SIZE (64 * 1024)
+// zlib/zstd的压缩级别
+#define ZLIB_COMPRESS_LEVEL 6
+#define ZSTD_COMPRESS_LEVEL 3
+
+//流式压缩，一次压缩一块输入
+class EncoderPrivate
+{
+public:
+    explicit EncoderPrivate(ContentEncoding eEncoding)
+        : m_eEncoding(eEncoding)
+        , m_bValid(false)
+#ifdef QT_MTNETWORK_ZSTD
+        , m_pZstd(nullptr)
+#endif
+    {
+        m_buffer.resize(COMPRESS_CHUNK_SIZE);
+        if (eEncoding == eEncodingGzip || eEncoding == eEncodingDeflate)
+        {
+            memset(&m_zs, 0, sizeof(m_zs));
+            //windowBits加16生成gzip格式；HTTP的deflate是带zlib头的格式
+            const int nWindowBits = (eEncoding == eEncodingGzip) ? (MAX_WBITS + 16) : MAX_WBITS;
+            m_bValid = (Z_OK == deflateInit2(&m_zs, ZLIB_COMPRESS_LEVEL, Z_DEFLATED, nWindowBits, 8, Z_DEFAULT_STRATEGY));
+        }
+#ifdef QT_MTNETWORK_ZSTD
+        else if (eEncoding == eEncodingZstd)
+        {
+            m_pZstd = ZSTD_createCCtx();
+            m_bValid = (m_pZstd != nullptr)
+                && !ZSTD_isError(ZSTD_CCtx_setParameter(m_pZstd, ZSTD_c_compressionLevel, ZSTD_COMPRESS_LEVEL));
+        }
+#endif
+    }
+
+    ~EncoderPrivate()
+    {
+        if (m_bValid && (m_eEncoding == eEncodingGzip || m_eEncoding == eEncodingDeflate))
+        {
+            deflateEnd(&m_zs);
+        }
+#ifdef QT_MTNETWORK_ZSTD
+        if (m_pZstd)
+        {
+            ZSTD_freeCCtx(m_pZstd);
+        }
+#endif
+    }
+
+    bool isValid() const { return m_bValid; }
+
+    //压缩data追加到out. bEnd: 最后一块，结束压缩流
+    bool encode(const char *data, int nSize, bool bEnd, QByteArray& out)
+    {
+        if (!m_bValid)
+        {
+            return false;
+        }
+#ifdef QT_MTNETWORK_ZSTD
+        if (m_eEncoding == eEncodingZstd)
+        {
+            ZSTD_inBuffer input = { data, (size_t)nSize, 0 };
+            bool bFinished = false;
+            do
+            {
+                ZSTD_outBuffer output = { m_buffer.data(), (size_t)m_buffer.size(), 0 };
+                const size_t nRemaining = ZSTD_compressStream2(m_pZstd, &output, &input, bEnd ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(nRemaining))
+                {
+                    return false;
+                }
+                out.append(m_buffer.constData(), (int)output.pos);
+                bFinished = bEnd ? (nRemaining == 0) : (input.pos == input.size);
+            } while (!bFinished);
+            return true;
+        }
+#endif
+        m_zs.next_in = (Bytef *)data;
+        m_zs.avail_in = (uInt)nSize;
+        int nRet = Z_OK;
+        do
+        {
+            m_zs.next_out = (Bytef *)m_buffer.data();
+            m_zs.avail_out = (uInt)m_buffer.size();
+            nRet = deflate(&m_zs, bEnd ? Z_FINISH : Z_NO_FLUSH);
+            if (nRet == Z_STREAM_ERROR)
+            {
+                return false;
+            }
+            out.append(m_buffer.constData(), m_buffer.size() - (int)m_zs.avail_out);
+        } while (m_zs.avail_out == 0);
+        return !bEnd || nRet == Z_STREAM_END;
+    }
+
+private:
+    ContentEncoding m_eEncoding;
+    bool m_bValid;
+    QByteArray m_buffer;
+    z_stream m_zs;
+#ifdef QT_MTNETWORK_ZSTD
+    ZSTD_CCtx *m_pZstd;
+#endif
+};
+
+bool NetworkCompressor::supported(ContentEncoding eEncoding)
+{
+    switch (eEncoding)
+    {
+    case eEncodingGzip:
+    case eEncodingDeflate:
+        return true;
+#ifdef QT_MTNETWORK_ZSTD
+    case eEncodingZstd:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+QByteArray NetworkCompressor::encodingName(ContentEncoding eEncoding)
+{
+    switch (eEncoding)
+    {
+    case eEncodingGzip:
+        return QByteArrayLiteral("gzip");
+    case eEncodingDeflate:
+        return QByteArrayLiteral("deflate");
+    case eEncodingZstd:
+        return QByteArrayLiteral("zstd");
+    default:
+        return QByteArrayLiteral("identity");
+    }
+}
+
+bool NetworkCompressor::compress(const QByteArray& data, ContentEncoding eEncoding, QByteArray& out)
+{
+    EncoderPrivate encoder(eEncoding);
+    if (!encoder.isValid())
+    {
+        return false;
+    }
+    out.clear();
+    out.reserve(data.size() / 4 + 64);
+    int nPos = 0;
+    do
+    {
+        const int nSize = qMin(data.size() - nPos, COMPRESS_CHUNK_SIZE);
+        const bool bEnd = (nPos + nSize >= data.size());
+        if (!encoder.encode(data.constData() + nPos, nSize, bEnd, out))
+        {
+            return false;
+        }
+        nPos += nSize;
+    } while (nPos < data.size());
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+NetworkCompressDevice::NetworkCompressDevice(QIODevice *pSource, ContentEncoding eEncoding, QObject *parent /* = nullptr */)
+    : QIODevice(parent)
+    , m_pSource(pSource)
+    , m_pEncoder(new EncoderPrivate(eEncoding))
+    , m_nPendingPos(0)
+    , m_bEnd(false)
+{
+}
+
+NetworkCompressDevice::~NetworkCompressDevice()
+{
+}
+
+bool NetworkCompressDevice::open(OpenMode mode)
+{
+    if ((mode & QIODevice::WriteOnly) || !m_pSource)
+    {
+        setErrorString(QStringLiteral("NetworkCompressDevice only supports ReadOnly"));
+        return false;
+    }
+    if (!m_pEncoder->isValid())
+    {
+        setErrorString(QStringLiteral("Unsupported content encoding"));
+        return false;
+    }
+    if (!m_pSource->isOpen() && !m_pSource->open(QIODevice::ReadOnly))
+    {
+        setErrorString(m_pSource->errorString());
+        return false;
+    }
+    m_input.resize(COMPRESS_CHUNK_SIZE);
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+bool NetworkCompressDevice::atEnd() const
+{
+    return m_bEnd && m_nPendingPos >= m_pending.size();
+}
+
+qint64 NetworkCompressDevice::bytesAvailable() const
+{
+    return (m_pending.size() - m_nPendingPos) + QIODevice::bytesAvailable();
+}
+
+bool NetworkCompressDevice::fill()
+{
+    m_pending.clear();
+    m_nPendingPos = 0;
+    //压缩器可能攒够数据才输出，读到有输出或数据源结束为止
+    while (m_pending.isEmpty() && !m_bEnd)
+    {
+        const qint64 nRead = m_pSource->read(m_input.data(), m_input.size());
+        if (nRead < 0)
+        {
+            setErrorString(m_pSource->errorString());
+            return false;
+        }
+        m_bEnd = (0 == nRead || m_pSource->atEnd());
+        if (!m_pEncoder->encode(m_input.constData(), (int)nRead, m_bEnd, m_pending))
+        {
+            setErrorString(QStringLiteral("Compress failed"));
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 NetworkCompressDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 nTotal = 0;
+    while (nTotal < maxSize)
+    {
+        if (m_nPendingPos >= m_pending.size())
+        {
+            if (m_bEnd)
+            {
+                break;
+            }
+            if (!fill())
+            {
+                return nTotal > 0 ? nTotal : -1;
+            }
+            continue;
+        }
+        const qint64 nCopy = qMin<qint64>(maxSize - nTotal, m_pending.size() - m_nPendingPos);
+        memcpy(data + nTotal, m_pending.constData() + m_nPendingPos, (size_t)nCopy);
+        m_nPendingPos += (int)nCopy;
+        nTotal += nCopy;
+    }
+    //顺序设备读完返回-1
+    return (0 == nTotal && atEnd()) ? -1 : nTotal;
+}
+
+qint64 NetworkCompressDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class DecoderPrivate
+{
+public:
+    enum Format
+    {
+        eFormatNone,
+        eFormatZlib,
+        eFormatZstd,
+        eFormatBrotli,
+    };
+
+    DecoderPrivate()
+        : eFormat(eFormatNone)
+        , bRawDeflate(false)
+        , bFinished(false)
+        , iTotalIn(0)
+#ifdef QT_MTNETWORK_ZSTD
+        , pZstd(nullptr)
+#endif
+#ifdef QT_MTNETWORK_BROTLI
+        , pBrotli(nullptr)
+#endif
+    {
+        buffer.resize(COMPRESS_CHUNK_SIZE);
+        memset(&zs, 0, sizeof(zs));
+    }
+
+    ~DecoderPrivate()
+    {
+        release();
+    }
+
+    void release()
+    {
+        if (eFormat == eFormatZlib)
+        {
+            inflateEnd(&zs);
+        }
+#ifdef QT_MTNETWORK_ZSTD
+        if (pZstd)
+        {
+            ZSTD_freeDCtx(pZstd);
+            pZstd = nullptr;
+        }
+#endif
+#ifdef QT_MTNETWORK_BROTLI
+        if (pBrotli)
+        {
+            BrotliDecoderDestroyInstance(pBrotli);
+            pBrotli = nullptr;
+        }
+#endif
+        eFormat = eFormatNone;
+        bRawDeflate = false;
+        bFinished = false;
+        iTotalIn = 0;
+        strError.clear();
+    }
+
+    //windowBits加32自动识别gzip和zlib头；bRaw: 不带头的deflate数据(有些服务器的deflate是这种格式)
+    bool initZlib(bool bRaw)
+    {
+        memset(&zs, 0, sizeof(zs));
+        if (Z_OK != inflateInit2(&zs, bRaw ? -MAX_WBITS : (MAX_WBITS + 32)))
+        {
+            return false;
+        }
+        eFormat = eFormatZlib;
+        bRawDeflate = bRaw;
+        return true;
+    }
+
+    bool decodeZlib(const char *data, qint64 nSize, QByteArray& out)
+    {
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = (uInt)nSize;
+        while (!bFinished)
+        {
+            zs.next_out = (Bytef *)buffer.data();
+            zs.avail_out = (uInt)buffer.size();
+            const int nRet = inflate(&zs, Z_NO_FLUSH);
+            if (nRet == Z_DATA_ERROR && !bRawDeflate && iTotalIn == 0 && zs.total_out == 0)
+            {
+                //没有zlib/gzip头，按原始deflate重新解压
+                inflateEnd(&zs);
+                eFormat = eFormatNone;
+                if (!initZlib(true))
+                {
+                    strError = QStringLiteral("inflateInit2 failed");
+                    return false;
+                }
+                zs.next_in = (Bytef *)data;
+                zs.avail_in = (uInt)nSize;
+                continue;
+            }
+            if (nRet == Z_NEED_DICT || nRet == Z_DATA_ERROR || nRet == Z_MEM_ERROR || nRet == Z_STREAM_ERROR)
+            {
+                strError = QStringLiteral("Content decoding failed: %1").arg(QString::fromLatin1(zs.msg ? zs.msg : "zlib error"));
+                return false;
+            }
+            out.append(buffer.constData(), buffer.size() - (int)zs.avail_out);
+            if (nRet == Z_STREAM_END)
+            {
+                //gzip可以有多个成员
+                if (zs.avail_in > 0 && !bRawDeflate && Z_OK == inflateReset(&zs))
+                {
+                    continue;
+                }
+                bFinished = true;
+            }
+            else if (zs.avail_in == 0 && zs.avail_out != 0)
+            {
+                break;
+            }
+            else if (nRet == Z_BUF_ERROR)
+            {
+                break;
+            }
+        }
+        iTotalIn += nSize;
+        return true;
+    }
+
+#ifdef QT_MTNETWORK_ZSTD
+    bool decodeZstd(const char *data, qint64 nSize, QByteArray& out)
+    {
+        ZSTD_inBuffer input = { data, (size_t)nSize, 0 };
+        forever
+        {
+            ZSTD_outBuffer output = { buffer.data(), (size_t)buffer.size(), 0 };
+            const size_t nRet = ZSTD_decompressStream(pZstd, &output, &input);
+            if (ZSTD_isError(nRet))
+            {
+                strError = QStringLiteral("Content decoding failed: %1").arg(QString::fromLatin1(ZSTD_getErrorName(nRet)));
+                return false;
+            }
+            out.append(buffer.constData(), (int)output.pos);
+            //0表示一帧结束
+            bFinished = (nRet == 0);
+            if (input.pos == input.size && output.pos < output.size)
+            {
+                break;
+            }
+        }
+        iTotalIn += nSize;
+        return true;
+    }
+#endif
+
+#ifdef QT_MTNETWORK_BROTLI
+    bool decodeBrotli(const char *data, qint64 nSize, QByteArray& out)
+    {
+        size_t nAvailIn = (size_t)nSize;
+        const uint8_t *pNextIn = (const uint8_t *)data;
+        forever
+        {
+            size_t nAvailOut = (size_t)buffer.size();
+            uint8_t *pNextOut = (uint8_t *)buffer.data();
+            const BrotliDecoderResult eResult = BrotliDecoderDecompressStream(pBrotli, &nAvailIn, &pNextIn, &nAvailOut, &pNextOut, nullptr);
+            if (eResult == BROTLI_DECODER_RESULT_ERROR)
+            {
+                strError = QStringLiteral("Content decoding failed: %1")
+                    .arg(QString::fromLatin1(BrotliDecoderErrorString(BrotliDecoderGetErrorCode(pBrotli))));
+                return false;
+            }
+            out.append(buffer.constData(), buffer.size() - (int)nAvailOut);
+            if (eResult == BROTLI_DECODER_RESULT_SUCCESS)
+            {
+                bFinished = true;
+                break;
+            }
+            if (eResult == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT)
+            {
+                break;
+            }
+        }
+        iTotalIn += nSize;
+        return true;
+    }
+#endif
+
+    Format eFormat;
+    bool bRawDeflate;
+    bool bFinished;
+    qint64 iTotalIn;
+    QString strError;
+    QByteArray buffer;
+    z_stream zs;
+#ifdef QT_MTNETWORK_ZSTD
+    ZSTD_DCtx *pZstd;
+#endif
+#ifdef QT_MTNETWORK_BROTLI
+    BrotliDecoderState *pBrotli;
+#endif
+};
+
+NetworkDecompressor::NetworkDecompressor()
+    : d(new DecoderPrivate)
+{
+}
+
+NetworkDecompressor::~NetworkDecompressor()
+{
+}
+
+QByteArray NetworkDecompressor::acceptEncoding()
+{
+    QByteArray bytes("gzip, deflate");
+#ifdef QT_MTNETWORK_ZSTD
+    bytes.append(", zstd");
+#endif
+#ifdef QT_MTNETWORK_BROTLI
+    bytes.append(", br");
+#endif
+    return bytes;
+}
+
+bool NetworkDecompressor::init(const QByteArray& bytesContentEncoding)
+{
+    d->release();
+    const QByteArray& bytesEncoding = bytesContentEncoding.trimmed().toLower();
+    if (bytesEncoding == "gzip" || bytesEncoding == "x-gzip" || bytesEncoding == "deflate")
+    {
+        return d->initZlib(false);
+    }
+#ifdef QT_MTNETWORK_ZSTD
+    if (bytesEncoding == "zstd")
+    {
+        d->pZstd = ZSTD_createDCtx();
+        if (d->pZstd)
+        {
+            d->eFormat = DecoderPrivate::eFormatZstd;
+        }
+        return (d->pZstd != nullptr);
+    }
+#endif
+#ifdef QT_MTNETWORK_BROTLI
+    if (bytesEncoding == "br")
+    {
+        d->pBrotli = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+        if (d->pBrotli)
+        {
+            d->eFormat = DecoderPrivate::eFormatBrotli;
+        }
+        return (d->pBrotli != nullptr);
+    }
+#endif
+    return false;
+}
+
+void NetworkDecompressor::reset()
+{
+    d->release();
+}
+
+bool NetworkDecompressor::isActive() const
+{
+    return (d->eFormat != DecoderPrivate::eFormatNone);
+}
+
+bool NetworkDecompressor::decode(const char *data, qint64 nSize, QByteArray& out)
+{
+    if (!d->strError.isEmpty())
+    {
+        return false;
+    }
+    //压缩流结束后的数据忽略
+    if (nSize <= 0 || d->bFinished)
+    {
+        return true;
+    }
+    switch (d->eFormat)
+    {
+    case DecoderPrivate::eFormatZlib:
+        return d->decodeZlib(data, nSize, out);
+#ifdef QT_MTNETWORK_ZSTD
+    case DecoderPrivate::eFormatZstd:
+        return d->decodeZstd(data, nSize, out);
+#endif
+#ifdef QT_MTNETWORK_BROTLI
+    case DecoderPrivate::eFormatBrotli:
+        return d->decodeBrotli(data, nSize, out);
+#endif
+    default:
+        out.append(data, (int)nSize);
+        return true;
+    }
+}
+
+bool NetworkDecompressor::finished() const
+{
+    return d->bFinished;
+}
+
+QString NetworkDecompressor::errorString() const
+{
+    return d->strError;
+}
@@ -0,0 +1,84 @@
+﻿#ifndef NETWORKCOMPRESSOR_H
+#define NETWORKCOMPRESSOR_H
+
+#include <memory>
+#include <QByteArray>
+#include <QString>
+#include <QIODevice>
+#include "networkdef.h"
+
+//请求体压缩(gzip/deflate使用Qt自带的zlib，zstd需编译时开启QT_MTNETWORK_ZSTD)
+class NetworkCompressor
+{
+public:
+    //是否支持该压缩格式
+    static bool supported(ContentEncoding eEncoding);
+    //Content-Encoding头的值
+    static QByteArray encodingName(ContentEncoding eEncoding);
+    //压缩内存中的数据
+    static bool compress(const QByteArray& data, ContentEncoding eEncoding, QByteArray& out);
+};
+
+//边读边压缩的只读顺序设备
+//每次读取时才从数据源读一块压缩，内存占用与数据大小无关.
+class EncoderPrivate;
+class NetworkCompressDevice : public QIODevice
+{
+public:
+    //pSource: 数据源(未打开时以只读方式打开)，由本设备释放
+    NetworkCompressDevice(QIODevice *pSource, ContentEncoding eEncoding, QObject *parent = nullptr);
+    ~NetworkCompressDevice();
+
+    //只支持ReadOnly，压缩格式不支持或数据源打开失败时返回false
+    bool open(OpenMode mode) Q_DECL_OVERRIDE;
+    bool isSequential() const Q_DECL_OVERRIDE { return true; }
+    bool atEnd() const Q_DECL_OVERRIDE;
+    qint64 bytesAvailable() const Q_DECL_OVERRIDE;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+    qint64 writeData(const char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+
+private:
+    //从数据源读取并压缩下一块到m_pending
+    bool fill();
+
+private:
+    std::unique_ptr<QIODevice> m_pSource;
+    std::unique_ptr<EncoderPrivate> m_pEncoder;
+    QByteArray m_input;
+    //已压缩还未被读取的数据
+    QByteArray m_pending;
+    int m_nPendingPos;
+    //数据源已读完，压缩流已结束
+    bool m_bEnd;
+};
+
+//响应体解压(Content-Encoding)
+//按收到的数据块增量解压，不用等整个响应结束. gzip/deflate使用zlib，zstd/br需编译时开启QT_MTNETWORK_ZSTD/QT_MTNETWORK_BROTLI
+class DecoderPrivate;
+class NetworkDecompressor
+{
+public:
+    NetworkDecompressor();
+    ~NetworkDecompressor();
+
+    //Accept-Encoding头的值：支持解压的格式
+    static QByteArray acceptEncoding();
+    //根据响应的Content-Encoding开始解压. identity、为空或不支持的格式不解压，返回false
+    bool init(const QByteArray& bytesContentEncoding);
+    void reset();
+    bool isActive() const;
+    //解压一块数据追加到out，数据有错时返回false
+    bool decode(const char *data, qint64 nSize, QByteArray& out);
+    bool decode(const QByteArray& data, QByteArray& out) { return decode(data.constData(), data.size(), out); }
+    //压缩流是否已完整结束(响应结束时检查，否则内容被截断)
+    bool finished() const;
+    QString errorString() const;
+
+private:
+    Q_DISABLE_COPY(NetworkDecompressor);
+    std::unique_ptr<DecoderPrivate> d;
+};
+
+#endif // NETWORKCOMPRESSOR_H
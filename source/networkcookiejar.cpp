@@ -0,0 +1,84 @@
+﻿#include "networkcookiejar.h"
+#include <memory>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace
+{
+    //共享存储，只调用它的数据方法(不使用信号槽)，所以可以在加锁后从任意线程访问
+    class CookieStore : public QNetworkCookieJar
+    {
+    public:
+        QList<QNetworkCookie> cookies() const { return allCookies(); }
+        void setCookies(const QList<QNetworkCookie> &cookieList) { setAllCookies(cookieList); }
+    };
+
+    QMutex s_mutex;
+    std::unique_ptr<CookieStore> s_pStore;
+
+    CookieStore *storeLocked()
+    {
+        if (!s_pStore)
+        {
+            s_pStore.reset(new CookieStore);
+        }
+        return s_pStore.get();
+    }
+}
+
+NetworkCookieJar::NetworkCookieJar(QObject *parent /* = nullptr */)
+    : QNetworkCookieJar(parent)
+{
+}
+
+NetworkCookieJar::~NetworkCookieJar()
+{
+}
+
+QList<QNetworkCookie> NetworkCookieJar::cookiesForUrl(const QUrl &url) const
+{
+    QMutexLocker locker(&s_mutex);
+    return storeLocked()->cookiesForUrl(url);
+}
+
+bool NetworkCookieJar::setCookiesFromUrl(const QList<QNetworkCookie> &cookieList, const QUrl &url)
+{
+    QMutexLocker locker(&s_mutex);
+    return storeLocked()->setCookiesFromUrl(cookieList, url);
+}
+
+bool NetworkCookieJar::insertCookie(const QNetworkCookie &cookie)
+{
+    QMutexLocker locker(&s_mutex);
+    return storeLocked()->insertCookie(cookie);
+}
+
+bool NetworkCookieJar::updateCookie(const QNetworkCookie &cookie)
+{
+    QMutexLocker locker(&s_mutex);
+    return storeLocked()->updateCookie(cookie);
+}
+
+bool NetworkCookieJar::deleteCookie(const QNetworkCookie &cookie)
+{
+    QMutexLocker locker(&s_mutex);
+    return storeLocked()->deleteCookie(cookie);
+}
+
+QList<QNetworkCookie> NetworkCookieJar::sharedCookies()
+{
+    QMutexLocker locker(&s_mutex);
+    return storeLocked()->cookies();
+}
+
+void NetworkCookieJar::setSharedCookies(const QList<QNetworkCookie> &cookieList)
+{
+    QMutexLocker locker(&s_mutex);
+    storeLocked()->setCookies(cookieList);
+}
+
+void NetworkCookieJar::clear()
+{
+    QMutexLocker locker(&s_mutex);
+    s_pStore.reset();
+}
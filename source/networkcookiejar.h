@@ -0,0 +1,28 @@
+﻿#ifndef NETWORKCOOKIEJAR_H
+#define NETWORKCOOKIEJAR_H
+
+#include <QNetworkCookieJar>
+
+//进程内共享的Cookie
+//QNetworkCookieJar不是线程安全的，也不能被不同线程的QNetworkAccessManager共用.
+//每个QNetworkAccessManager使用一个NetworkCookieJar，它只是把读写转给加锁的共享存储，
+//一个请求收到的Cookie(如登录后的会话)对之后所有线程的请求都可见.
+class NetworkCookieJar : public QNetworkCookieJar
+{
+public:
+    explicit NetworkCookieJar(QObject *parent = nullptr);
+    ~NetworkCookieJar();
+
+    QList<QNetworkCookie> cookiesForUrl(const QUrl &url) const Q_DECL_OVERRIDE;
+    bool setCookiesFromUrl(const QList<QNetworkCookie> &cookieList, const QUrl &url) Q_DECL_OVERRIDE;
+    bool insertCookie(const QNetworkCookie &cookie) Q_DECL_OVERRIDE;
+    bool updateCookie(const QNetworkCookie &cookie) Q_DECL_OVERRIDE;
+    bool deleteCookie(const QNetworkCookie &cookie) Q_DECL_OVERRIDE;
+
+    //共享存储的所有Cookie
+    static QList<QNetworkCookie> sharedCookies();
+    static void setSharedCookies(const QList<QNetworkCookie> &cookieList);
+    static void clear();
+};
+
+#endif // NETWORKCOOKIEJAR_H
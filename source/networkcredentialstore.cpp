@@ -0,0 +1,150 @@
+﻿#include "networkcredentialstore.h"
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAuthenticator>
+
+namespace
+{
+    struct CredentialEntry
+    {
+        QString strOrigin;
+        QString strPathPrefix;
+        QString strRealm;
+        QString strUser;
+        QString strPassword;
+        bool bPreemptive;
+    };
+
+    QMutex s_mutex;
+    QList<CredentialEntry> s_listCredential;
+
+    int defaultPort(const QUrl& url)
+    {
+        return (url.scheme().compare(QLatin1String("https"), Qt::CaseInsensitive) == 0) ? 443 : 80;
+    }
+
+    QString origin(const QUrl& url)
+    {
+        return QStringLiteral("%1://%2:%3").arg(url.scheme().toLower()).arg(url.host().toLower()).arg(url.port(defaultPort(url)));
+    }
+
+    QString pathPrefix(const QUrl& url)
+    {
+        const QString& strPath = url.path();
+        return strPath.isEmpty() ? QStringLiteral("/") : strPath;
+    }
+
+    //路径前缀最长的优先；bPreemptiveOnly: 只查找预先认证的
+    const CredentialEntry *findLocked(const QUrl& url, const QString& strRealm, bool bPreemptiveOnly)
+    {
+        const QString& strOrigin = origin(url);
+        const QString& strPath = pathPrefix(url);
+        const CredentialEntry *pFound = nullptr;
+        for (const CredentialEntry& entry : s_listCredential)
+        {
+            if (entry.strOrigin != strOrigin || !strPath.startsWith(entry.strPathPrefix))
+                continue;
+            if (bPreemptiveOnly && !entry.bPreemptive)
+                continue;
+            if (!strRealm.isNull() && !entry.strRealm.isEmpty() && entry.strRealm != strRealm)
+                continue;
+            if (nullptr == pFound || entry.strPathPrefix.length() > pFound->strPathPrefix.length())
+            {
+                pFound = &entry;
+            }
+        }
+        return pFound;
+    }
+}
+
+void NetworkCredentialStore::setCredential(const QUrl& url, const QString& strUser, const QString& strPassword,
+    bool bPreemptive, const QString& strRealm)
+{
+    CredentialEntry entry;
+    entry.strOrigin = origin(url);
+    entry.strPathPrefix = pathPrefix(url);
+    entry.strRealm = strRealm;
+    entry.strUser = strUser;
+    entry.strPassword = strPassword;
+    entry.bPreemptive = bPreemptive;
+
+    QMutexLocker locker(&s_mutex);
+    for (CredentialEntry& e : s_listCredential)
+    {
+        if (e.strOrigin == entry.strOrigin && e.strPathPrefix == entry.strPathPrefix && e.strRealm == entry.strRealm)
+        {
+            e = entry;
+            return;
+        }
+    }
+    s_listCredential.append(entry);
+}
+
+bool NetworkCredentialStore::removeCredential(const QUrl& url, const QString& strRealm)
+{
+    const QString& strOrigin = origin(url);
+    const QString& strPath = pathPrefix(url);
+
+    QMutexLocker locker(&s_mutex);
+    for (int i = 0; i < s_listCredential.size(); ++i)
+    {
+        const CredentialEntry& e = s_listCredential.at(i);
+        if (e.strOrigin == strOrigin && e.strPathPrefix == strPath && e.strRealm == strRealm)
+        {
+            s_listCredential.removeAt(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void NetworkCredentialStore::clear()
+{
+    QMutexLocker locker(&s_mutex);
+    s_listCredential.clear();
+}
+
+void NetworkCredentialStore::applyPreemptive(QNetworkRequest& request)
+{
+    const QUrl& url = request.url();
+    if (request.hasRawHeader("Authorization") || !url.userName().isEmpty())
+    {
+        return;
+    }
+    if (url.scheme().compare(QLatin1String("http"), Qt::CaseInsensitive) != 0
+        && url.scheme().compare(QLatin1String("https"), Qt::CaseInsensitive) != 0)
+    {
+        return;
+    }
+
+    QByteArray bytesToken;
+    {
+        QMutexLocker locker(&s_mutex);
+        const CredentialEntry *pEntry = findLocked(url, QString(), true);
+        if (nullptr == pEntry)
+        {
+            return;
+        }
+        bytesToken = (pEntry->strUser + QLatin1Char(':') + pEntry->strPassword).toUtf8().toBase64();
+    }
+    request.setRawHeader("Authorization", "Basic " + bytesToken);
+}
+
+bool NetworkCredentialStore::answer(const QUrl& url, QAuthenticator *pAuthenticator)
+{
+    if (nullptr == pAuthenticator)
+    {
+        return false;
+    }
+
+    QMutexLocker locker(&s_mutex);
+    const CredentialEntry *pEntry = findLocked(url, pAuthenticator->realm(), false);
+    if (nullptr == pEntry)
+    {
+        return false;
+    }
+    pAuthenticator->setUser(pEntry->strUser);
+    pAuthenticator->setPassword(pEntry->strPassword);
+    return true;
+}
@@ -0,0 +1,31 @@
+﻿#ifndef NETWORKCREDENTIALSTORE_H
+#define NETWORKCREDENTIALSTORE_H
+
+#include <QUrl>
+#include <QString>
+#include <QNetworkRequest>
+
+class QAuthenticator;
+
+//进程内共享的认证信息
+//按scheme://host:port和路径前缀保存用户名密码：
+//	 1.收到401/407质询(QNetworkAccessManager::authenticationRequired())时按url和realm回答，每个请求只回答一次，
+//	   密码错误时请求失败而不是反复质询.
+//	 2.设置了预先认证(bPreemptive)的，第一个请求就带上Basic认证头，省去401质询的往返.
+//所有方法线程安全
+class NetworkCredentialStore
+{
+public:
+    //url: 认证信息适用的服务器和路径前缀(如"https://api.example.com/v1/"). strRealm为空时适用于任何realm
+    static void setCredential(const QUrl& url, const QString& strUser, const QString& strPassword,
+        bool bPreemptive, const QString& strRealm);
+    static bool removeCredential(const QUrl& url, const QString& strRealm);
+    static void clear();
+
+    //预先认证：请求还没有Authorization头时，按url设置Basic认证头(在设置url之后调用)
+    static void applyPreemptive(QNetworkRequest& request);
+    //回答质询，没有匹配的认证信息时返回false
+    static bool answer(const QUrl& url, QAuthenticator *pAuthenticator);
+};
+
+#endif // NETWORKCREDENTIALSTORE_H
@@ -0,0 +1,467 @@
+﻿#include "networkdiskwriter.h"
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#endif
+#include <memory>
+#include <iterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QDebug>
+#include "Log4cplusWrapper.h"
+#include "networktracer.h"
+
+// 写文件的线程数
+#define DISK_WRITER_THREAD_COUNT 2
+// 排队等待写入的数据上限，超过后write()阻塞
+#define DISK_WRITER_MAX_QUEUED_BYTES (64 * 1024 * 1024)
+// 合并后按此大小对齐写入，不足一块的数据先不写
+#define DISK_WRITER_ALIGN_SIZE (64 * 1024)
+// 一次写入的最大长度
+#define DISK_WRITER_MAX_WRITE_SIZE (1024 * 1024)
+// eDurabilityWriteBehind时，每写入这么多数据刷新一次
+#define DISK_WRITER_SYNC_INTERVAL (8 * 1024 * 1024)
+// 临时文件的后缀
+#define DISK_WRITER_TEMP_SUFFIX ".part"
+
+namespace
+{
+    struct FileState
+    {
+        QFile file;
+        // 等待写入的数据 (文件偏移 <---> 数据)
+        QMap<qint64, QByteArray> mapChunk;
+        // mapChunk中的数据量(已取出正在写入的不计入)
+        qint64 iQueuedBytes;
+        // 已交给写文件线程
+        bool bScheduled;
+        // 正在关闭，剩余数据不再等待对齐
+        bool bClosing;
+        QString strError;
+        DurabilityPolicy eDurability;
+        // 上次刷新后写入的数据量
+        qint64 iUnsyncedBytes;
+        // 打开文件的请求(NetworkTracer)
+        quint64 uiTraceId;
+        quint64 uiTraceBatchId;
+
+        FileState() : iQueuedBytes(0), bScheduled(false), bClosing(false)
+            , eDurability(eDurabilityNone), iUnsyncedBytes(0), uiTraceId(0), uiTraceBatchId(0) {}
+    };
+
+    QMutex s_mutex;
+    // 有数据写完(排队数据减少)
+    QWaitCondition s_condSpace;
+    // 有文件的写入任务结束
+    QWaitCondition s_condIdle;
+    QThreadPool *s_pThreadPool = nullptr;
+    QHash<quint64, std::shared_ptr<FileState>> s_hashFile;
+    quint64 s_uiNextId = 0;
+    // 正在因背压等待的write()调用数，大于0时不再等待对齐
+    int s_nPressureWaiters = 0;
+    DiskWriterMetrics s_metrics;
+
+    //从队列中取出一块要写入的数据(需加锁)，从iQueuedBytes中减去
+    //连续的数据合并成一块；bForce为false时只写到对齐的位置，不足一块的数据留在队列中
+    bool takeBlock(FileState *pState, bool bForce, qint64& offset, QByteArray& block, int& nChunks)
+    {
+        auto iter = pState->mapChunk.begin();
+        while (iter != pState->mapChunk.end())
+        {
+            const qint64 runStart = iter.key();
+            qint64 runEnd = runStart;
+            auto runLast = iter;
+            while (runLast != pState->mapChunk.end() && runLast.key() == runEnd
+                && runEnd - runStart < DISK_WRITER_MAX_WRITE_SIZE)
+            {
+                runEnd += runLast.value().size();
+                ++runLast;
+            }
+
+            qint64 writeEnd = runEnd;
+            if (!bForce)
+            {
+                writeEnd = runEnd - runEnd % DISK_WRITER_ALIGN_SIZE;
+                if (writeEnd <= runStart)
+                {
+                    iter = runLast;
+                    continue;
+                }
+            }
+
+            offset = runStart;
+            block.clear();
+            nChunks = 0;
+            if (std::next(iter) == runLast && writeEnd == runEnd)
+            {
+                //只有一块，不用复制
+                block = iter.value();
+                pState->mapChunk.erase(iter);
+                pState->iQueuedBytes -= block.size();
+                nChunks = 1;
+                return true;
+            }
+
+            block.reserve((int)(writeEnd - runStart));
+            while (iter != runLast && runStart + block.size() < writeEnd)
+            {
+                const QByteArray& data = iter.value();
+                const int nNeed = (int)(writeEnd - runStart - block.size());
+                if (data.size() <= nNeed)
+                {
+                    block.append(data);
+                    iter = pState->mapChunk.erase(iter);
+                    nChunks++;
+                }
+                else
+                {
+                    //超出对齐位置的部分留在队列中
+                    block.append(data.constData(), nNeed);
+                    const QByteArray rest = data.mid(nNeed);
+                    pState->mapChunk.erase(iter);
+                    pState->mapChunk.insert(writeEnd, rest);
+                    break;
+                }
+            }
+            pState->iQueuedBytes -= block.size();
+            return true;
+        }
+        return false;
+    }
+
+    class WriteTask : public QRunnable
+    {
+    public:
+        explicit WriteTask(std::shared_ptr<FileState> pState) : m_pState(pState) {}
+
+        void run() Q_DECL_OVERRIDE
+        {
+            QMutexLocker locker(&s_mutex);
+            FileState *pState = m_pState.get();
+            forever
+            {
+                qint64 offset = 0;
+                QByteArray block;
+                int nChunks = 0;
+                const bool bForce = pState->bClosing || s_nPressureWaiters > 0;
+                if (!takeBlock(pState, bForce, offset, block, nChunks))
+                {
+                    pState->bScheduled = false;
+                    s_condIdle.wakeAll();
+                    return;
+                }
+
+                //已经写入失败的文件不再写入，丢弃的数据不计入写入的统计
+                bool bOk = pState->strError.isEmpty();
+                qint64 iLatencyUs = 0;
+                qint64 iSyncMs = -1;
+                if (bOk)
+                {
+                    locker.unlock();
+                    QElapsedTimer timer;
+                    timer.start();
+                    const qint64 iTraceStartUs = NetworkTracer::isEnabled() ? networkTimestampUs() : 0;
+                    bOk = pState->file.seek(offset) && pState->file.write(block) == block.size();
+                    iLatencyUs = timer.nsecsElapsed() / 1000;
+                    if (iTraceStartUs > 0)
+                    {
+                        NetworkTracer::addRequestSpan("disk write", "disk", iTraceStartUs, networkTimestampUs(),
+                            pState->uiTraceId, pState->uiTraceBatchId);
+                    }
+                    //同一文件同时只有一个写入任务，可以不加锁访问iUnsyncedBytes
+                    if (bOk && pState->eDurability == eDurabilityWriteBehind)
+                    {
+                        pState->iUnsyncedBytes += block.size();
+                        if (pState->iUnsyncedBytes >= DISK_WRITER_SYNC_INTERVAL)
+                        {
+                            timer.restart();
+                            bOk = NetworkDiskWriter::syncFile(&pState->file);
+                            iSyncMs = timer.elapsed();
+                            pState->iUnsyncedBytes = 0;
+                        }
+                    }
+                    locker.relock();
+                }
+
+                if (!bOk && pState->strError.isEmpty())
+                {
+                    pState->strError = QStringLiteral("Error: write file(%1) failed - %2")
+                        .arg(pState->file.fileName()).arg(pState->file.errorString());
+                    LOG_ERROR(pState->strError.toStdWString());
+                    qCritical() << "[QMultiThreadNetwork]" << pState->strError;
+                }
+
+                //取出的数据在写完后才从全局的排队数据中减去(背压)；dropQueued()只减去队列中剩余的
+                s_metrics.iQueuedBytes -= block.size();
+                s_metrics.nQueueDepth -= nChunks;
+                if (bOk)
+                {
+                    s_metrics.uiWriteCount++;
+                    s_metrics.uiBytesWritten += block.size();
+                    s_metrics.iTotalWriteLatencyUs += iLatencyUs;
+                    s_metrics.iMaxWriteLatencyUs = qMax(s_metrics.iMaxWriteLatencyUs, iLatencyUs);
+                }
+                if (iSyncMs >= 0)
+                {
+                    s_metrics.uiSyncCount++;
+                    s_metrics.iSyncMs += iSyncMs;
+                }
+                s_condSpace.wakeAll();
+            }
+        }
+
+    private:
+        std::shared_ptr<FileState> m_pState;
+    };
+
+    //需加锁
+    void schedule(const std::shared_ptr<FileState>& pState)
+    {
+        if (pState->bScheduled || pState->mapChunk.isEmpty())
+        {
+            return;
+        }
+        if (nullptr == s_pThreadPool)
+        {
+            s_pThreadPool = new QThreadPool;
+            s_pThreadPool->setMaxThreadCount(DISK_WRITER_THREAD_COUNT);
+        }
+        pState->bScheduled = true;
+        s_pThreadPool->start(new WriteTask(pState));
+    }
+
+    //需加锁
+    void dropQueued(FileState *pState)
+    {
+        s_metrics.iQueuedBytes -= pState->iQueuedBytes;
+        s_metrics.nQueueDepth -= pState->mapChunk.size();
+        pState->iQueuedBytes = 0;
+        pState->mapChunk.clear();
+        s_condSpace.wakeAll();
+    }
+}
+
+quint64 NetworkDiskWriter::open(const QString& strFilePath, QString *pError, DurabilityPolicy eDurability)
+{
+    std::shared_ptr<FileState> pState = std::make_shared<FileState>();
+    pState->eDurability = eDurability;
+    NetworkTracer::currentRequest(pState->uiTraceId, pState->uiTraceBatchId);
+    pState->file.setFileName(strFilePath);
+    if (!pState->file.open(QIODevice::ReadWrite | QIODevice::Unbuffered))
+    {
+        const QString& strError = QStringLiteral("Error: QFile::open(%1) - %2").arg(strFilePath).arg(pState->file.errorString());
+        LOG_ERROR(strError.toStdWString());
+        qWarning() << "[QMultiThreadNetwork]" << strError;
+        if (pError)
+        {
+            *pError = strError;
+        }
+        return 0;
+    }
+
+    QMutexLocker locker(&s_mutex);
+    const quint64 id = ++s_uiNextId;
+    s_hashFile.insert(id, pState);
+    return id;
+}
+
+bool NetworkDiskWriter::write(quint64 id, qint64 offset, const QByteArray& data)
+{
+    if (data.isEmpty())
+    {
+        return true;
+    }
+
+    QMutexLocker locker(&s_mutex);
+    std::shared_ptr<FileState> pState = s_hashFile.value(id);
+    if (!pState.get())
+    {
+        return false;
+    }
+
+    //背压：排队的数据超过上限时等待写文件线程
+    if (s_metrics.iQueuedBytes > 0 && s_metrics.iQueuedBytes + data.size() > DISK_WRITER_MAX_QUEUED_BYTES)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        s_metrics.uiBackPressureCount++;
+        s_nPressureWaiters++;
+        for (std::shared_ptr<FileState>& p : s_hashFile)
+        {
+            schedule(p);
+        }
+        while (s_metrics.iQueuedBytes > 0 && s_metrics.iQueuedBytes + data.size() > DISK_WRITER_MAX_QUEUED_BYTES)
+        {
+            s_condSpace.wait(&s_mutex);
+        }
+        s_nPressureWaiters--;
+        s_metrics.iBackPressureMs += timer.elapsed();
+    }
+
+    if (!pState->strError.isEmpty())
+    {
+        return false;
+    }
+
+    pState->mapChunk.insert(offset, data);
+    pState->iQueuedBytes += data.size();
+    s_metrics.uiSubmitCount++;
+    s_metrics.iQueuedBytes += data.size();
+    s_metrics.nQueueDepth++;
+    s_metrics.iPeakQueuedBytes = qMax(s_metrics.iPeakQueuedBytes, s_metrics.iQueuedBytes);
+
+    if (pState->iQueuedBytes >= DISK_WRITER_ALIGN_SIZE || s_nPressureWaiters > 0)
+    {
+        schedule(pState);
+    }
+    return true;
+}
+
+QString NetworkDiskWriter::errorString(quint64 id)
+{
+    QMutexLocker locker(&s_mutex);
+    std::shared_ptr<FileState> pState = s_hashFile.value(id);
+    return pState.get() ? pState->strError : QStringLiteral("Error: file(id: %1) is not open").arg(id);
+}
+
+bool NetworkDiskWriter::close(quint64 id, bool bDiscard, QString *pError)
+{
+    std::shared_ptr<FileState> pState;
+    {
+        QMutexLocker locker(&s_mutex);
+        pState = s_hashFile.value(id);
+        if (!pState.get())
+        {
+            return false;
+        }
+
+        if (bDiscard)
+        {
+            dropQueued(pState.get());
+        }
+        pState->bClosing = true;
+        schedule(pState);
+        while (pState->bScheduled)
+        {
+            s_condIdle.wait(&s_mutex);
+        }
+        s_hashFile.remove(id);
+    }
+
+    if (!bDiscard && pState->eDurability != eDurabilityNone && pState->strError.isEmpty())
+    {
+        QElapsedTimer timer;
+        timer.start();
+        if (!syncFile(&pState->file))
+        {
+            pState->strError = QStringLiteral("Error: sync file(%1) failed - %2")
+                .arg(pState->file.fileName()).arg(pState->file.errorString());
+            LOG_ERROR(pState->strError.toStdWString());
+        }
+        QMutexLocker locker(&s_mutex);
+        s_metrics.uiSyncCount++;
+        s_metrics.iSyncMs += timer.elapsed();
+    }
+    pState->file.close();
+    if (!pState->strError.isEmpty())
+    {
+        if (pError)
+        {
+            *pError = pState->strError;
+        }
+        return false;
+    }
+    return true;
+}
+
+QString NetworkDiskWriter::tempFilePath(const QString& strFilePath)
+{
+    return strFilePath + QLatin1String(DISK_WRITER_TEMP_SUFFIX);
+}
+
+bool NetworkDiskWriter::commit(const QString& strTempPath, const QString& strFilePath, bool bSync, QString *pError)
+{
+#ifdef WIN32
+    DWORD dwFlags = MOVEFILE_REPLACE_EXISTING;
+    if (bSync)
+    {
+        dwFlags |= MOVEFILE_WRITE_THROUGH;
+    }
+    const bool bRet = (FALSE != MoveFileExW(strTempPath.toStdWString().c_str(), strFilePath.toStdWString().c_str(), dwFlags));
+    const int nError = bRet ? 0 : (int)GetLastError();
+#else
+    const bool bRet = (0 == ::rename(QFile::encodeName(strTempPath).constData(), QFile::encodeName(strFilePath).constData()));
+    const int nError = bRet ? 0 : errno;
+    if (bRet && bSync)
+    {
+        //刷新目录，使改名持久化
+        const QByteArray& bytesDir = QFile::encodeName(QFileInfo(strFilePath).absolutePath());
+        const int fd = ::open(bytesDir.constData(), O_RDONLY);
+        if (fd >= 0)
+        {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+#endif
+    if (!bRet)
+    {
+        const QString& strError = QStringLiteral("Error: rename file(%1) to (%2) failed - %3").arg(strTempPath).arg(strFilePath).arg(nError);
+        LOG_ERROR(strError.toStdWString());
+        qWarning() << "[QMultiThreadNetwork]" << strError;
+        if (pError)
+        {
+            *pError = strError;
+        }
+    }
+    return bRet;
+}
+
+bool NetworkDiskWriter::syncFile(QFile *pFile)
+{
+    if (nullptr == pFile || pFile->handle() < 0)
+    {
+        return false;
+    }
+#ifdef WIN32
+    return (FALSE != FlushFileBuffers((HANDLE)_get_osfhandle(pFile->handle())));
+#elif defined(Q_OS_LINUX)
+    return (0 == ::fdatasync(pFile->handle()));
+#else
+    return (0 == ::fsync(pFile->handle()));
+#endif
+}
+
+DiskWriterMetrics NetworkDiskWriter::metrics()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_metrics;
+}
+
+void NetworkDiskWriter::shutdown()
+{
+    QThreadPool *pThreadPool = nullptr;
+    {
+        QMutexLocker locker(&s_mutex);
+        pThreadPool = s_pThreadPool;
+    }
+    if (pThreadPool && !pThreadPool->waitForDone(3000))
+    {
+        LOG_INFO("DiskWriter waitForDone failed!");
+        qDebug() << "[QMultiThreadNetwork] DiskWriter waitForDone failed!";
+    }
+}
@@ -0,0 +1,39 @@
+﻿#ifndef NETWORKDISKWRITER_H
+#define NETWORKDISKWRITER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include "networkdef.h"
+
+//异步写文件
+//网络线程把收到的数据交给写文件线程池，不再在网络线程中同步写文件. 同一文件中连续的小块数据先合并，
+//凑够对齐的大块后再写入；排队的数据超过内存上限时write()阻塞，网络线程暂停读取(背压).
+//所有方法线程安全
+class NetworkDiskWriter
+{
+public:
+    //打开文件(不存在则创建，不截断)，返回文件id，0表示失败
+    //eDurability: eDurabilityWriteBehind时写文件线程定期刷新已写入的数据，不为eDurabilityNone时close()前刷新到磁盘
+    static quint64 open(const QString& strFilePath, QString *pError = nullptr, DurabilityPolicy eDurability = eDurabilityNone);
+    //把data写入文件的offset处. 只是加入写入队列，写入的错误在close()时返回
+    //返回false表示之前的写入已经出错
+    static bool write(quint64 id, qint64 offset, const QByteArray& data);
+    //等待排队的数据全部写入后关闭文件. bDiscard: 丢弃还未写入的数据(下载失败时)
+    static bool close(quint64 id, bool bDiscard = false, QString *pError = nullptr);
+    //之前的写入出错时的错误信息，没有出错时为空
+    static QString errorString(quint64 id);
+
+    //下载时使用的临时文件路径
+    static QString tempFilePath(const QString& strFilePath);
+    //把临时文件改名为目标文件(已存在则原子地替换). bSync: 改名也刷新到磁盘
+    static bool commit(const QString& strTempPath, const QString& strFilePath, bool bSync, QString *pError = nullptr);
+    //把已打开文件的数据刷新到磁盘(fdatasync/FlushFileBuffers)
+    static bool syncFile(QFile *pFile);
+
+    static DiskWriterMetrics metrics();
+    //等待写文件线程结束(NetworkManager::unInitialize())
+    static void shutdown();
+};
+
+#endif // NETWORKDISKWRITER_H
@@ -8,20 +8,28 @@
 #include <QCoreApplication>
 #include "Log4cplusWrapper.h"
 #include "networkmanager.h"
+#include "networkdiskwriter.h"
+#include "networkbufferpool.h"
+#include "networkredirectcache.h"
 
 
 NetworkDownloadRequest::NetworkDownloadRequest(QObject *parent /* = nullptr */)
     : NetworkRequest(parent)
-    , m_pFile(nullptr)
+    , m_uiWriterId(0)
+    , m_iWriteOffset(0)
+    , m_bNegotiateEncoding(false)
+    , m_bEncodingChecked(false)
+    , m_bDecodeFailed(false)
+    , m_bWriteFailed(false)
 {
 }
 
 NetworkDownloadRequest::~NetworkDownloadRequest()
 {
-    if (m_pFile.get())
+    if (m_uiWriterId != 0)
     {
-        m_pFile->close();
-        m_pFile.reset();
+        NetworkDiskWriter::close(m_uiWriterId, true);
+        m_uiWriterId = 0;
     }
 }
 
@@ -109,21 +117,16 @@ bool NetworkDownloadRequest::createLocalFile()
     }
 
     //重定向等操作后需要关闭打开的文件
-    if (m_pFile.get())
+    if (m_uiWriterId != 0)
     {
-        if (m_pFile->exists())
-        {
-            m_pFile->close();
-            m_pFile->remove();
-        }
-        m_pFile.reset();
+        closeLocalFile(false);
     }
 
-    //如果文件存在，关闭文件并移除
+    //如果文件存在，关闭文件并移除(先下载到临时文件时，下载成功后再替换)
     const QString& strFilePath = QDir::toNativeSeparators(strSaveDir + strFileName);
     if (QFile::exists(strFilePath))
     {
-        if (m_request.bReplaceFileIfExist)
+        if (m_request.bReplaceFileIfExist && !m_request.bAtomicCommit)
         {
             QFile file(strFilePath);
             if (!removeFile(&file))
@@ -134,7 +137,7 @@ bool NetworkDownloadRequest::createLocalFile()
                 return false;
             }
         }
-        else
+        else if (!m_request.bReplaceFileIfExist)
         {
             m_strError = QStringLiteral("Error: File is already exist(%1)").arg(strFilePath);
             qWarning() << m_strError;
@@ -143,23 +146,55 @@ bool NetworkDownloadRequest::createLocalFile()
         }
     }
 
-    //创建并打开文件
-#if _MSC_VER >= 1700
-    m_pFile = std::make_unique<QFile>(strFilePath);
-#else
-    m_pFile->reset(new QFile(strFilePath));
-#endif
-    if (!m_pFile->open(QIODevice::WriteOnly))
+
+    //删除上次残留的临时文件
+    const QString& strWriteFilePath = m_request.bAtomicCommit ? NetworkDiskWriter::tempFilePath(strFilePath) : strFilePath;
+    if (m_request.bAtomicCommit && QFile::exists(strWriteFilePath))
+    {
+        QFile file(strWriteFilePath);
+        if (!removeFile(&file))
+        {
+            m_strError = QStringLiteral("Error: QFile::remove(%1) - %2").arg(strWriteFilePath).arg(file.errorString());
+            qWarning() << m_strError;
+            LOG_INFO(m_strError.toStdWString());
+            return false;
+        }
+    }
+
+    //创建并打开文件，数据由写文件线程写入
+    m_uiWriterId = NetworkDiskWriter::open(strWriteFilePath, &m_strError, m_request.eDurability);
+    if (0 == m_uiWriterId)
     {
-        m_strError = QStringLiteral("Error: QFile::open(%1) - %2").arg(strFilePath).arg(m_pFile->errorString());
-        qWarning() << m_strError;
-        LOG_INFO(m_strError.toStdWString());
-        m_pFile.reset();
         return false;
     }
+    m_strFilePath = strFilePath;
+    m_strWriteFilePath = strWriteFilePath;
+    m_iWriteOffset = 0;
+    m_checksum.reset(m_request.eHashAlgorithm);
     return true;
 }
 
+bool NetworkDownloadRequest::closeLocalFile(bool bSuccess)
+{
+    QString strError;
+    if (!NetworkDiskWriter::close(m_uiWriterId, !bSuccess, &strError) && bSuccess)
+    {
+        bSuccess = false;
+        m_strError = strError;
+    }
+    m_uiWriterId = 0;
+    if (bSuccess && m_strWriteFilePath != m_strFilePath
+        && !NetworkDiskWriter::commit(m_strWriteFilePath, m_strFilePath, m_request.eDurability != eDurabilityNone, &m_strError))
+    {
+        bSuccess = false;
+    }
+    if (!bSuccess)
+    {
+        QFile::remove(m_strWriteFilePath);
+    }
+    return bSuccess;
+}
+
 void NetworkDownloadRequest::start()
 {
     __super::start();
@@ -175,31 +210,26 @@ void NetworkDownloadRequest::start()
         {
             url = m_redirectUrl;
         }
-        QNetworkRequest request(url);
+        QNetworkRequest request = createNetworkRequest(url);
         //request.setRawHeader("Accept-Charset", "utf-8");
         //request.setRawHeader("Accept-Language", "zh-CN");
-        auto iter = m_request.mapRawHeader.cbegin();
-        for (; iter != m_request.mapRawHeader.cend(); ++iter)
-        {
-            request.setRawHeader(iter.key(), iter.value());
-        }
 
-#ifndef QT_NO_SSL
-        if (isHttpsProxy(url.scheme()))
+        //协商压缩格式，由这里解压(不使用QNetworkAccessManager的自动解压)；指定了Range时必须是未压缩的内容
+        //调用者自己设置了Accept-Encoding时按原样保存响应内容
+        m_bNegotiateEncoding = false;
+        m_bEncodingChecked = false;
+        m_bDecodeFailed = false;
+        m_bWriteFailed = false;
+        m_decoder.reset();
+        if (!request.hasRawHeader("Accept-Encoding") && (isHttpProxy(url.scheme()) || isHttpsProxy(url.scheme())))
         {
-            // 发送https请求前准备工作;
-            QSslConfiguration conf = request.sslConfiguration();
-            conf.setPeerVerifyMode(QSslSocket::VerifyNone);
-            conf.setProtocol(QSsl::TlsV1SslV3);
-            request.setSslConfiguration(conf);
+            m_bNegotiateEncoding = !request.hasRawHeader("Range");
+            request.setRawHeader("Accept-Encoding", m_bNegotiateEncoding ? NetworkDecompressor::acceptEncoding() : QByteArray("identity"));
         }
-#endif
 
-        if (nullptr == m_pNetworkManager)
-        {
-            m_pNetworkManager = new QNetworkAccessManager;
-        }
+        createNetworkManager();
         m_pNetworkReply = m_pNetworkManager->get(request);
+        m_pNetworkReply->setReadBufferSize(m_request.iReadBufferSize);
 
         connect(m_pNetworkReply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
         connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onFinished()));
@@ -236,14 +266,53 @@ void NetworkDownloadRequest::onReadyRead()
         && m_pNetworkReply->error() == QNetworkReply::NoError
         && m_pNetworkReply->isOpen())
     {
-        if (fileAccessible(m_pFile.get()) && m_pFile->isOpen())
+        if (!m_bEncodingChecked)
+        {
+            m_bEncodingChecked = true;
+            if (m_bNegotiateEncoding && m_decoder.init(m_pNetworkReply->rawHeader("Content-Encoding")))
+            {
+                LOG_INFO("Download content encoding: " << m_pNetworkReply->rawHeader("Content-Encoding").toStdString());
+            }
+        }
+
+        //读入复用的接收缓冲区，交给写文件线程
+        while (m_uiWriterId != 0 && !m_bDecodeFailed && !m_bWriteFailed && m_pNetworkReply->bytesAvailable() > 0)
         {
-            const QByteArray& bytesRev = m_pNetworkReply->readAll();
-            if (!bytesRev.isEmpty() && -1 == m_pFile->write(bytesRev))
+            QByteArray bytesRev = NetworkBufferPool::read(m_pNetworkReply, m_pNetworkReply->bytesAvailable());
+            if (bytesRev.isEmpty())
+            {
+                break;
+            }
+            if (m_decoder.isActive())
+            {
+                QByteArray bytesDecoded;
+                if (!m_decoder.decode(bytesRev, bytesDecoded))
+                {
+                    //内容有错，不再继续接收
+                    m_bDecodeFailed = true;
+                    LOG_ERROR(m_decoder.errorString().toStdWString());
+                    qDebug() << "[QMultiThreadNetwork]" << m_decoder.errorString();
+                    m_pNetworkReply->abort();
+                    return;
+                }
+                bytesRev = bytesDecoded;
+                if (bytesRev.isEmpty())
+                {
+                    continue;
+                }
+            }
+            if (!NetworkDiskWriter::write(m_uiWriterId, m_iWriteOffset, bytesRev))
             {
-                LOG_ERROR(m_pFile->errorString().toStdWString());
-                qDebug() << "[QMultiThreadNetwork]" << m_pFile->errorString();
+                //写文件已出错(磁盘满等)，不再继续下载
+                m_bWriteFailed = true;
+                m_strError = NetworkDiskWriter::errorString(m_uiWriterId);
+                LOG_ERROR("NetworkDiskWriter::write failed: " << m_strError.toStdWString());
+                qDebug() << "[QMultiThreadNetwork] NetworkDiskWriter::write failed:" << m_strError;
+                m_pNetworkReply->abort();
+                return;
             }
+            m_iWriteOffset += bytesRev.size();
+            m_checksum.addData(bytesRev);
         }
     }
 }
@@ -258,13 +327,14 @@ void NetworkDownloadRequest::onFinished()
     }
     if (!bSuccess)
     {
-        if (statusCode == 301 || statusCode == 302)
-        {//301,302重定向
+        if (isRedirectStatus(statusCode))
+        {//301,302,307,308重定向
             const QVariant& redirectionTarget = m_pNetworkReply->attribute(QNetworkRequest::RedirectionTargetAttribute);
             if (!redirectionTarget.isNull())
             {
                 const QUrl& url = m_request.url;
                 const QUrl& redirectUrl = url.resolved(redirectionTarget.toUrl());
+                NetworkRedirectCache::insert(m_pNetworkReply->url(), redirectUrl, statusCode);
                 if (url != redirectUrl && m_redirectUrl != redirectUrl)
                 {
                     m_redirectUrl = redirectUrl;
@@ -289,13 +359,38 @@ void NetworkDownloadRequest::onFinished()
         }
     }
 
-    if (fileAccessible(m_pFile.get()))
+    if (m_bDecodeFailed)
+    {
+        bSuccess = false;
+        m_strError = m_decoder.errorString();
+    }
+    else if (m_bWriteFailed)
+    {
+        bSuccess = false;
+    }
+    if (m_uiWriterId != 0)
     {
-        m_pFile->close();
-        if (!bSuccess)
+        if (bSuccess)
         {
-            m_pFile->remove();
+            onReadyRead();
+            if (m_decoder.isActive() && !m_decoder.finished())
+            {
+                m_strError = QStringLiteral("Error: compressed content is truncated");
+                LOG_ERROR(m_strError.toStdWString());
+                bSuccess = false;
+            }
+        }
+        if (bSuccess)
+        {
+            if (!NetworkChecksum::verify(m_request, m_checksum.hexDigest(), m_iWriteOffset, m_strError))
+            {
+                LOG_ERROR(m_strError.toStdWString());
+                qDebug() << "[QMultiThreadNetwork]" << m_strError;
+                m_request.eErrorType = eErrorIntegrity;
+                bSuccess = false;
+            }
         }
+        bSuccess = closeLocalFile(bSuccess);
     }
 
     if (!m_bAbortManual)//非调用abort()结束
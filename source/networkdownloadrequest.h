@@ -3,6 +3,8 @@
 
 #include <QObject>
 #include "networkrequest.h"
+#include "networkchecksum.h"
+#include "networkcompressor.h"
 
 class QFile;
 
@@ -26,9 +28,25 @@ private:
     bool createLocalFile();
     bool fileAccessible(QFile *pFile) const;
     bool removeFile(QFile *file);
+    //等待写入完成并关闭文件，成功时把临时文件改名为目标文件，失败时删除文件
+    bool closeLocalFile(bool bSuccess);
 
 private:
-    std::unique_ptr<QFile> m_pFile;
+    //NetworkDiskWriter的文件id
+    quint64 m_uiWriterId;
+    qint64 m_iWriteOffset;
+    QString m_strFilePath;
+    //实际写入的文件(bAtomicCommit时为临时文件)
+    QString m_strWriteFilePath;
+    //下载过程中计算摘要(RequestTask::eHashAlgorithm)
+    NetworkChecksum m_checksum;
+    //协商了压缩格式(Accept-Encoding)时，按响应的Content-Encoding增量解压后再写入文件
+    bool m_bNegotiateEncoding;
+    bool m_bEncodingChecked;
+    bool m_bDecodeFailed;
+    //写文件出错，不再继续接收
+    bool m_bWriteFailed;
+    NetworkDecompressor m_decoder;
 };
 
 #endif // NETWORKDOWNLOADREQUEST_H
\ No newline at end of file
@@ -0,0 +1,85 @@
+﻿#include "networkfileinfocache.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDateTime>
+
+// 缓存有效期(ms)
+#define FILE_INFO_CACHE_TTL (5 * 60 * 1000)
+// 最多缓存的条目数
+#define FILE_INFO_CACHE_MAX_SIZE 256
+
+namespace
+{
+    struct CacheEntry
+    {
+        RemoteFileInfo info;
+        qint64 iExpireTime;
+    };
+
+    QMutex s_mutex;
+    QHash<QUrl, CacheEntry> s_hashCache;
+}
+
+bool NetworkFileInfoCache::lookup(const QUrl& url, RemoteFileInfo& info)
+{
+    QMutexLocker locker(&s_mutex);
+    auto iter = s_hashCache.find(url);
+    if (iter == s_hashCache.end())
+    {
+        return false;
+    }
+    if (iter.value().iExpireTime < QDateTime::currentMSecsSinceEpoch())
+    {
+        s_hashCache.erase(iter);
+        return false;
+    }
+    info = iter.value().info;
+    return true;
+}
+
+void NetworkFileInfoCache::insert(const QUrl& url, const RemoteFileInfo& info)
+{
+    const qint64 iNow = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker locker(&s_mutex);
+    if (s_hashCache.size() >= FILE_INFO_CACHE_MAX_SIZE && !s_hashCache.contains(url))
+    {
+        //先移除过期的，仍然满了就移除最早过期的
+        auto oldest = s_hashCache.end();
+        for (auto iter = s_hashCache.begin(); iter != s_hashCache.end();)
+        {
+            if (iter.value().iExpireTime < iNow)
+            {
+                iter = s_hashCache.erase(iter);
+                continue;
+            }
+            if (oldest == s_hashCache.end() || iter.value().iExpireTime < oldest.value().iExpireTime)
+            {
+                oldest = iter;
+            }
+            ++iter;
+        }
+        if (s_hashCache.size() >= FILE_INFO_CACHE_MAX_SIZE && oldest != s_hashCache.end())
+        {
+            s_hashCache.erase(oldest);
+        }
+    }
+
+    CacheEntry entry;
+    entry.info = info;
+    entry.iExpireTime = iNow + FILE_INFO_CACHE_TTL;
+    s_hashCache.insert(url, entry);
+}
+
+void NetworkFileInfoCache::remove(const QUrl& url)
+{
+    QMutexLocker locker(&s_mutex);
+    s_hashCache.remove(url);
+}
+
+void NetworkFileInfoCache::clear()
+{
+    QMutexLocker locker(&s_mutex);
+    s_hashCache.clear();
+}
@@ -0,0 +1,30 @@
+﻿#ifndef NETWORKFILEINFOCACHE_H
+#define NETWORKFILEINFOCACHE_H
+
+#include <QUrl>
+#include <QByteArray>
+
+//远程文件信息
+struct RemoteFileInfo
+{
+    // 文件大小，-1表示未知
+    qint64 nFileSize;
+    // 是否支持Range请求
+    bool bAcceptRanges;
+    QByteArray bytesETag;
+
+    RemoteFileInfo() : nFileSize(-1), bAcceptRanges(false) {}
+};
+
+//按url缓存远程文件的大小和是否支持Range请求，重复下载同一文件时不再请求文件大小
+//所有方法线程安全
+class NetworkFileInfoCache
+{
+public:
+    static bool lookup(const QUrl& url, RemoteFileInfo& info);
+    static void insert(const QUrl& url, const RemoteFileInfo& info);
+    static void remove(const QUrl& url);
+    static void clear();
+};
+
+#endif // NETWORKFILEINFOCACHE_H
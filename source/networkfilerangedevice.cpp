@@ -0,0 +1,98 @@
+﻿#include "networkfilerangedevice.h"
+#include <QFileInfo>
+
+
+NetworkFileRangeDevice::NetworkFileRangeDevice(const QString& strFilePath, qint64 offset, qint64 length, QObject *parent /* = nullptr */)
+    : QIODevice(parent)
+    , m_file(strFilePath)
+    , m_offset(offset)
+    , m_length(length)
+    , m_iPos(0)
+{
+}
+
+NetworkFileRangeDevice::~NetworkFileRangeDevice()
+{
+    close();
+}
+
+bool NetworkFileRangeDevice::open(OpenMode mode)
+{
+    if ((mode & QIODevice::WriteOnly) || m_offset < 0 || m_length < 0)
+    {
+        setErrorString(QStringLiteral("Invalid open mode or range"));
+        return false;
+    }
+    //这里只检查文件，读取时再打开
+    const QFileInfo fileInfo(m_file.fileName());
+    if (!fileInfo.isFile() || !fileInfo.isReadable())
+    {
+        setErrorString(QStringLiteral("File(%1) is not readable").arg(m_file.fileName()));
+        return false;
+    }
+    if (fileInfo.size() < m_offset + m_length)
+    {
+        setErrorString(QStringLiteral("File(%1) is shorter than range end %2").arg(m_file.fileName()).arg(m_offset + m_length));
+        return false;
+    }
+    m_iPos = 0;
+    //文件本身有缓冲，这里不再缓冲
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void NetworkFileRangeDevice::close()
+{
+    if (isOpen())
+    {
+        QIODevice::close();
+    }
+    m_file.close();
+}
+
+bool NetworkFileRangeDevice::seek(qint64 pos)
+{
+    if (pos < 0 || pos > m_length)
+    {
+        return false;
+    }
+    m_iPos = pos;
+    return QIODevice::seek(pos);
+}
+
+qint64 NetworkFileRangeDevice::readData(char *data, qint64 maxSize)
+{
+    const qint64 nRemain = m_length - m_iPos;
+    if (nRemain <= 0)
+    {
+        m_file.close();
+        return 0;
+    }
+    if (!m_file.isOpen() && !m_file.open(QIODevice::ReadOnly))
+    {
+        setErrorString(m_file.errorString());
+        return -1;
+    }
+    if (m_file.pos() != m_offset + m_iPos && !m_file.seek(m_offset + m_iPos))
+    {
+        setErrorString(m_file.errorString());
+        return -1;
+    }
+
+    const qint64 nRead = m_file.read(data, qMin(maxSize, nRemain));
+    if (nRead > 0)
+    {
+        m_iPos += nRead;
+    }
+    if (m_iPos >= m_length)
+    {
+        m_file.close();
+    }
+    return nRead;
+}
+
+qint64 NetworkFileRangeDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
@@ -0,0 +1,37 @@
+﻿#ifndef NETWORKFILERANGEDEVICE_H
+#define NETWORKFILERANGEDEVICE_H
+
+#include <QIODevice>
+#include <QFile>
+
+//只读访问文件中的一段[offset, offset + length)
+//分块上传时每块一个设备，交给QNetworkAccessManager分块读取，重定向/认证重发时可以seek(0).
+//文件在第一次读取时才打开，读完即关闭，同时存在大量设备时(表单上传很多文件)不会占用大量文件句柄
+class NetworkFileRangeDevice : public QIODevice
+{
+public:
+    NetworkFileRangeDevice(const QString& strFilePath, qint64 offset, qint64 length, QObject *parent = nullptr);
+    ~NetworkFileRangeDevice();
+
+    //只支持ReadOnly，文件长度不足offset + length时失败
+    bool open(OpenMode mode) Q_DECL_OVERRIDE;
+    void close() Q_DECL_OVERRIDE;
+    bool isSequential() const Q_DECL_OVERRIDE { return false; }
+    qint64 size() const Q_DECL_OVERRIDE { return m_length; }
+    bool seek(qint64 pos) Q_DECL_OVERRIDE;
+
+    qint64 offset() const { return m_offset; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+    qint64 writeData(const char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+
+private:
+    QFile m_file;
+    qint64 m_offset;
+    qint64 m_length;
+    //段内的读取位置
+    qint64 m_iPos;
+};
+
+#endif // NETWORKFILERANGEDEVICE_H
@@ -0,0 +1,321 @@
+﻿#include "networkformuploadrequest.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QHttpMultiPart>
+#include <QCoreApplication>
+#include <QNetworkAccessManager>
+#include "Log4cplusWrapper.h"
+#include "networkmanager.h"
+#include "networkfilerangedevice.h"
+
+#define MAX_UPLOAD_THREAD_COUNT 6
+
+
+NetworkFormUploadRequest::NetworkFormUploadRequest(QObject *parent /* = nullptr */)
+    : NetworkRequest(parent)
+    , m_nThreadCount(0)
+    , m_nFinishedBundle(0)
+    , m_iBytesFinished(0)
+    , m_iBytesTotal(0)
+    , m_bFailed(false)
+{
+}
+
+NetworkFormUploadRequest::~NetworkFormUploadRequest()
+{
+    abortBundles();
+}
+
+void NetworkFormUploadRequest::abort()
+{
+    __super::abort();
+    abortBundles();
+}
+
+void NetworkFormUploadRequest::abortBundles()
+{
+    //先取出，abort()会同步触发finished()
+    const QList<QNetworkReply *> listReply = m_hashBundleReply.keys();
+    m_hashBundleReply.clear();
+    for (QNetworkReply *pReply : listReply)
+    {
+        pReply->disconnect(this);
+        if (pReply->isRunning())
+        {
+            pReply->abort();
+        }
+        pReply->deleteLater();
+    }
+}
+
+bool NetworkFormUploadRequest::collectFiles()
+{
+    QVector<FormFile> vecFile;
+    if (!m_request.listFormFile.isEmpty())
+    {
+        for (const QString& strFilePath : m_request.listFormFile)
+        {
+            const QFileInfo fileInfo(strFilePath);
+            if (!fileInfo.isFile())
+            {
+                m_strError = QStringLiteral("Error: File is not exists(%1)").arg(strFilePath);
+                return false;
+            }
+            FormFile file;
+            file.strFilePath = strFilePath;
+            file.strName = fileInfo.fileName();
+            file.iSize = fileInfo.size();
+            vecFile.append(file);
+        }
+    }
+    else
+    {
+        //上传目录下的所有文件，文件名为相对路径
+        const QDir dir(m_request.strReqArg);
+        if (m_request.strReqArg.isEmpty() || !dir.exists())
+        {
+            m_strError = QStringLiteral("Error: Directory is not exists(%1)").arg(m_request.strReqArg);
+            return false;
+        }
+        QDirIterator iter(dir.absolutePath(), QDir::Files | QDir::Hidden | QDir::NoSymLinks, QDirIterator::Subdirectories);
+        while (iter.hasNext())
+        {
+            iter.next();
+            FormFile file;
+            file.strFilePath = iter.filePath();
+            file.strName = dir.relativeFilePath(iter.filePath());
+            file.iSize = iter.fileInfo().size();
+            vecFile.append(file);
+        }
+    }
+
+    //按大小打包，超过iFormBundleSize的文件单独一个包
+    m_vecBundle.clear();
+    m_iBytesTotal = 0;
+    Bundle bundle;
+    bundle.iSize = 0;
+    bundle.nRetry = 0;
+    bundle.iSent = 0;
+    for (const FormFile& file : vecFile)
+    {
+        if (m_request.iFormBundleSize > 0 && !bundle.vecFile.isEmpty()
+            && bundle.iSize + file.iSize > m_request.iFormBundleSize)
+        {
+            m_vecBundle.append(bundle);
+            bundle.vecFile.clear();
+            bundle.iSize = 0;
+        }
+        bundle.vecFile.append(file);
+        bundle.iSize += file.iSize;
+        m_iBytesTotal += file.iSize;
+    }
+    //没有文件时只提交表单字段
+    m_vecBundle.append(bundle);
+    return true;
+}
+
+void NetworkFormUploadRequest::start()
+{
+    __super::start();
+    m_strError.clear();
+    m_bFailed = false;
+    m_listPendingBundle.clear();
+    m_nFinishedBundle = 0;
+    m_iBytesFinished = 0;
+
+    if (!isHttpProxy(m_request.url.scheme()) && !isHttpsProxy(m_request.url.scheme()))
+    {
+        fail(QStringLiteral("Error: Form upload only supports http(s) - %1").arg(m_request.url.toString()));
+        return;
+    }
+    if (!collectFiles())
+    {
+        fail(m_strError);
+        return;
+    }
+
+    for (int i = 0; i < m_vecBundle.size(); ++i)
+    {
+        m_listPendingBundle.append(i);
+    }
+    m_nThreadCount = qBound(1, (int)m_request.nUploadThreadCount, MAX_UPLOAD_THREAD_COUNT);
+    m_nThreadCount = qMin(m_nThreadCount, m_vecBundle.size());
+    LOG_INFO("Form upload start. [size] " << m_iBytesTotal << " [bundles] " << m_vecBundle.size());
+    qDebug() << "[QMultiThreadNetwork] Form upload start. size:" << m_iBytesTotal << "bundles:" << m_vecBundle.size();
+
+    createNetworkManager();
+    fillChannels();
+}
+
+bool NetworkFormUploadRequest::fillChannels()
+{
+    while (!m_bFailed && m_hashBundleReply.size() < m_nThreadCount && !m_listPendingBundle.isEmpty())
+    {
+        if (!startBundle(m_listPendingBundle.takeFirst()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+QHttpMultiPart *NetworkFormUploadRequest::createMultiPart(int nBundle)
+{
+    QHttpMultiPart *pMultiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+    auto iter = m_request.mapFormField.cbegin();
+    for (; iter != m_request.mapFormField.cend(); ++iter)
+    {
+        QHttpPart part;
+        part.setHeader(QNetworkRequest::ContentDispositionHeader,
+            QStringLiteral("form-data; name=\"%1\"").arg(iter.key()));
+        part.setBody(iter.value().toUtf8());
+        pMultiPart->append(part);
+    }
+
+    for (const FormFile& file : m_vecBundle[nBundle].vecFile)
+    {
+        NetworkFileRangeDevice *pDevice = new NetworkFileRangeDevice(file.strFilePath, 0, file.iSize, pMultiPart);
+        if (!pDevice->open(QIODevice::ReadOnly))
+        {
+            m_strError = QStringLiteral("Error: QFile::open(%1) - %2").arg(file.strFilePath).arg(pDevice->errorString());
+            delete pMultiPart;
+            return nullptr;
+        }
+        QHttpPart part;
+        part.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+        part.setHeader(QNetworkRequest::ContentDispositionHeader,
+            QStringLiteral("form-data; name=\"%1\"; filename=\"%2\"").arg(m_request.strFormFileField).arg(file.strName));
+        part.setBodyDevice(pDevice);
+        pMultiPart->append(part);
+    }
+    return pMultiPart;
+}
+
+bool NetworkFormUploadRequest::startBundle(int nBundle)
+{
+    m_vecBundle[nBundle].iSent = 0;
+    QHttpMultiPart *pMultiPart = createMultiPart(nBundle);
+    if (nullptr == pMultiPart)
+    {
+        fail(m_strError);
+        return false;
+    }
+
+    QNetworkRequest request = createNetworkRequest(requestUrl());
+
+    //QHttpMultiPart设置Content-Type(含boundary)，长度由各部分的大小计算
+    QNetworkReply *pReply = m_pNetworkManager->post(request, pMultiPart);
+    pMultiPart->setParent(pReply);
+    m_hashBundleReply.insert(pReply, nBundle);
+
+    connect(pReply, SIGNAL(finished()), this, SLOT(onFinished()));
+    if (m_request.bShowProgress)
+    {
+        connect(pReply, SIGNAL(uploadProgress(qint64, qint64)), this, SLOT(onUploadProgress(qint64, qint64)));
+    }
+    return true;
+}
+
+void NetworkFormUploadRequest::onFinished()
+{
+    QNetworkReply *pReply = qobject_cast<QNetworkReply *>(sender());
+    if (nullptr == pReply || !m_hashBundleReply.contains(pReply))
+    {
+        return;
+    }
+    const int nBundle = m_hashBundleReply.take(pReply);
+    pReply->deleteLater();
+    if (m_bFailed || m_bAbortManual)
+    {
+        return;
+    }
+
+    Bundle& bundle = m_vecBundle[nBundle];
+    const int statusCode = pReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const bool bSuccess = (pReply->error() == QNetworkReply::NoError && statusCode >= 200 && statusCode < 300);
+    if (bSuccess)
+    {
+        bundle.iSent = 0;
+        bundle.bytesReply = pReply->readAll();
+        m_iBytesFinished += bundle.iSize;
+        m_nFinishedBundle++;
+    }
+    else
+    {
+        const QString& strError = QStringLiteral("Bundle %1 upload failed. HttpStatusCode: %2, %3 %4")
+            .arg(nBundle).arg(statusCode).arg(pReply->errorString()).arg(QString::fromUtf8(pReply->readAll()));
+        LOG_ERROR(strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << strError;
+
+        //只重传这个包
+        if (bundle.nRetry >= m_request.nUploadPartRetry)
+        {
+            fail(strError);
+            return;
+        }
+        bundle.nRetry++;
+        bundle.iSent = 0;
+        m_listPendingBundle.prepend(nBundle);
+    }
+
+    if (m_nFinishedBundle == m_vecBundle.size())
+    {
+        //按包的顺序返回各请求的响应内容
+        QByteArray bytes;
+        for (const Bundle& b : m_vecBundle)
+        {
+            bytes.append(b.bytesReply);
+        }
+        LOG_INFO("Form upload finished. [result] " << true);
+        emit requestFinished(true, bytes, m_strError);
+        return;
+    }
+    fillChannels();
+}
+
+void NetworkFormUploadRequest::fail(const QString& strError)
+{
+    m_bFailed = true;
+    m_strError = strError;
+    LOG_ERROR(m_strError.toStdWString());
+    qDebug() << "[QMultiThreadNetwork]" << m_strError;
+    abortBundles();
+    emit requestFinished(false, QByteArray(), m_strError);
+}
+
+void NetworkFormUploadRequest::onUploadProgress(qint64 iSent, qint64 iTotal)
+{
+    Q_UNUSED(iTotal);
+    QNetworkReply *pReply = qobject_cast<QNetworkReply *>(sender());
+    if (m_bAbortManual || nullptr == pReply || !m_hashBundleReply.contains(pReply))
+    {
+        return;
+    }
+    //iSent包含表单的分隔符等，不超过包内文件的大小
+    Bundle& bundle = m_vecBundle[m_hashBundleReply.value(pReply)];
+    bundle.iSent = qMin(iSent, bundle.iSize);
+    postProgress();
+}
+
+void NetworkFormUploadRequest::postProgress()
+{
+    if (!NetworkManager::isInstantiated() || m_iBytesTotal <= 0)
+    {
+        return;
+    }
+
+    qint64 iSent = m_iBytesFinished;
+    for (int nBundle : m_hashBundleReply)
+    {
+        iSent += m_vecBundle[nBundle].iSent;
+    }
+    NetworkProgressEvent *event = new NetworkProgressEvent;
+    event->bDownload = false;
+    event->uiId = m_request.uiId;
+    event->uiBatchId = m_request.uiBatchId;
+    event->iBtyes = iSent;
+    event->iTotalBtyes = m_iBytesTotal;
+    QCoreApplication::postEvent(NetworkManager::globalInstance(), event);
+}
@@ -0,0 +1,66 @@
+﻿#ifndef NETWORKFORMUPLOADREQUEST_H
+#define NETWORKFORMUPLOADREQUEST_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include "networkrequest.h"
+
+class QHttpMultiPart;
+
+//multipart/form-data多文件上传请求
+//多个文件和表单字段在一个请求中上传；可按大小把文件打包成多个请求，由多个连接同时上传
+class NetworkFormUploadRequest : public NetworkRequest
+{
+    Q_OBJECT;
+
+public:
+    explicit NetworkFormUploadRequest(QObject *parent = 0);
+    ~NetworkFormUploadRequest();
+
+public Q_SLOTS:
+    void start() Q_DECL_OVERRIDE;
+    void abort() Q_DECL_OVERRIDE;
+    void onFinished() Q_DECL_OVERRIDE;
+    void onUploadProgress(qint64 iSent, qint64 iTotal);
+
+private:
+    //收集要上传的文件，并按RequestTask::iFormBundleSize打包
+    bool collectFiles();
+    bool fillChannels();
+    bool startBundle(int nBundle);
+    //创建一个包的表单，文件设备读取时才打开文件
+    QHttpMultiPart *createMultiPart(int nBundle);
+    void abortBundles();
+    void fail(const QString& strError);
+    void postProgress();
+
+private:
+    struct FormFile
+    {
+        QString strFilePath;
+        //表单中的文件名
+        QString strName;
+        qint64 iSize;
+    };
+    struct Bundle
+    {
+        QVector<FormFile> vecFile;
+        qint64 iSize;
+        int nRetry;
+        qint64 iSent;
+        QByteArray bytesReply;
+    };
+    QVector<Bundle> m_vecBundle;
+    QList<int> m_listPendingBundle;
+    //正在上传的包 (reply <---> 包序号)
+    QHash<QNetworkReply *, int> m_hashBundleReply;
+    int m_nThreadCount;
+    int m_nFinishedBundle;
+    qint64 m_iBytesFinished;
+    qint64 m_iBytesTotal;
+    bool m_bFailed;
+};
+
+#endif // NETWORKFORMUPLOADREQUEST_H
@@ -9,9 +9,20 @@
 #include <QEvent>
 #include <QDebug>
 #include <QCoreApplication>
+#include <QIODevice>
 #include "Log4cplusWrapper.h"
 #include "classmemorytracer.h"
 #include "networkrunnable.h"
+#include "networkdiskwriter.h"
+#include "networkrequesttemplate.h"
+#include "networktlssessioncache.h"
+#include "networkcredentialstore.h"
+#include "networkcookiejar.h"
+#include "networkredirectcache.h"
+#include "networkaccessmanager.h"
+#include "networkstatistics.h"
+#include "networkmetricsexporter.h"
+#include "networktracer.h"
 
 
 #define DEFAULT_MAX_THREAD_COUNT 5
@@ -37,6 +48,7 @@ private:
 
     bool setMaxThreadCount(int iMax);
     int maxThreadCount() const;
+    void runnableCount(int& nInFlight, int& nQueued);
 
     bool isRequestValid(const QUrl &url) const;
     bool isThreadAvailable() const;
@@ -148,6 +160,8 @@ void NetworkManagerPrivate::initialize()
 
 void NetworkManagerPrivate::unInitialize()
 {
+    //导出线程会调用NetworkManager::statistics()
+    NetworkMetricsExporter::stop();
     stopAllRequest();
     reset();
     m_pThreadPool->clear();
@@ -156,6 +170,12 @@ void NetworkManagerPrivate::unInitialize()
         LOG_INFO("ThreadPool waitForDone failed!");
         qDebug() << "[QMultiThreadNetwork] ThreadPool waitForDone failed!";
     }
+    NetworkDiskWriter::shutdown();
+    NetworkRequestTemplate::clear();
+    NetworkTlsSessionCache::clear();
+    NetworkCredentialStore::clear();
+    NetworkCookieJar::clear();
+    NetworkRedirectCache::clear();
 }
 
 void NetworkManagerPrivate::reset()
@@ -221,6 +241,7 @@ void NetworkManagerPrivate::stopRequest(quint64 uiTaskId)
             if (r.get())
             {
                 t = r->task();
+                NetworkStatisticsCollector::recordCancel();
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5,9,0))
                 if (!m_pThreadPool->tryTake(r.get()))
@@ -276,6 +297,7 @@ void NetworkManagerPrivate::stopBatchRequests(quint64 uiBatchId)
                 r->quit();
 #endif
                 iter = m_mapRunnable.erase(iter);
+                NetworkStatisticsCollector::recordCancel();
             }
             else
             {
@@ -358,6 +380,7 @@ void NetworkManagerPrivate::stopAllRequest()
 #endif
             }
         }
+        NetworkStatisticsCollector::recordCancel(m_mapRunnable.size());
         m_mapRunnable.clear();
     }
     reset();
@@ -473,6 +496,15 @@ int NetworkManagerPrivate::maxThreadCount() const
     return -1;
 }
 
+void NetworkManagerPrivate::runnableCount(int& nInFlight, int& nQueued)
+{
+    QMutexLocker locker(&m_mutex);
+    const int nTotal = m_mapRunnable.size();
+    //线程池只知道活动的线程数，其余的任务在排队
+    nInFlight = m_pThreadPool ? qMin(m_pThreadPool->activeThreadCount(), nTotal) : 0;
+    nQueued = nTotal - nInFlight;
+}
+
 bool NetworkManagerPrivate::isThreadAvailable() const
 {
     if (m_pThreadPool)
@@ -720,6 +752,10 @@ NetworkReply *NetworkManager::addRequest(RequestTask& request)
     Q_D(NetworkManager);
     d->resetStopAllFlag();
 
+    if (!NetworkRequestTemplate::resolveTask(request))
+    {
+        return nullptr;
+    }
     std::shared_ptr<NetworkReply> pReply = d->addRequest(request.url, request.uiId);
     if (pReply.get())
     {
@@ -743,6 +779,13 @@ NetworkReply *NetworkManager::addBatchRequest(BatchRequestTask& tasks, quint64 &
     uiBatchId = 0;
     if (!tasks.isEmpty())
     {
+        for (int i = 0; i < tasks.size(); ++i)
+        {
+            if (!NetworkRequestTemplate::resolveTask(tasks[i]))
+            {
+                return nullptr;
+            }
+        }
         std::shared_ptr<NetworkReply> pReply = d->addBatchRequest(tasks, uiBatchId);
         return pReply.get();
     }
@@ -772,7 +815,12 @@ void NetworkManager::stopAllRequest()
 
 bool NetworkManager::startAsRunnable(const RequestTask &request)
 {
-    std::shared_ptr<NetworkRunnable> r = std::make_shared<NetworkRunnable>(request);
+    //失败重试时重新计时
+    RequestTask task = request;
+    task.timing = RequestTiming();
+    task.timing.iEnqueueUs = networkTimestampUs();
+
+    std::shared_ptr<NetworkRunnable> r = std::make_shared<NetworkRunnable>(task);
     qRegisterMetaType<RequestTask>("RequestTask");
     connect(r.get(), SIGNAL(requestFinished(const RequestTask &)),
         this, SLOT(onRequestFinished(const RequestTask &)));
@@ -796,6 +844,130 @@ bool NetworkManager::setMaxThreadCount(int iMax)
     return d->setMaxThreadCount(iMax);
 }
 
+DiskWriterMetrics NetworkManager::diskWriterMetrics()
+{
+    return NetworkDiskWriter::metrics();
+}
+
+quint32 NetworkManager::addRequestTemplate(const RequestTemplate& tmpl)
+{
+    return NetworkRequestTemplate::add(tmpl);
+}
+
+bool NetworkManager::removeRequestTemplate(quint32 uiTemplateId)
+{
+    return NetworkRequestTemplate::remove(uiTemplateId);
+}
+
+void NetworkManager::setDefaultRequestTemplate(const RequestTemplate& tmpl)
+{
+    NetworkRequestTemplate::setDefault(tmpl);
+}
+
+TlsSessionMetrics NetworkManager::tlsSessionMetrics()
+{
+    return NetworkTlsSessionCache::metrics();
+}
+
+void NetworkManager::setCredential(const QUrl& url, const QString& strUser, const QString& strPassword,
+    bool bPreemptive /* = false */, const QString& strRealm /* = QString() */)
+{
+    NetworkCredentialStore::setCredential(url, strUser, strPassword, bPreemptive, strRealm);
+}
+
+bool NetworkManager::removeCredential(const QUrl& url, const QString& strRealm /* = QString() */)
+{
+    return NetworkCredentialStore::removeCredential(url, strRealm);
+}
+
+QList<QNetworkCookie> NetworkManager::sharedCookies()
+{
+    return NetworkCookieJar::sharedCookies();
+}
+
+void NetworkManager::setSharedCookies(const QList<QNetworkCookie>& cookies)
+{
+    NetworkCookieJar::setSharedCookies(cookies);
+}
+
+void NetworkManager::clearSharedCookies()
+{
+    NetworkCookieJar::clear();
+}
+
+void NetworkManager::setTemporaryRedirectCacheTtl(int iSeconds)
+{
+    NetworkRedirectCache::setTemporaryTtl(iSeconds);
+}
+
+RedirectCacheMetrics NetworkManager::redirectCacheMetrics()
+{
+    return NetworkRedirectCache::metrics();
+}
+
+NetworkStatistics NetworkManager::statistics()
+{
+    Q_D(NetworkManager);
+    NetworkStatistics stat = NetworkStatisticsCollector::snapshot();
+    d->runnableCount(stat.nInFlight, stat.nQueued);
+    stat.nMaxThreads = d->maxThreadCount();
+    stat.diskWriter = NetworkDiskWriter::metrics();
+    stat.tlsSession = NetworkTlsSessionCache::metrics();
+    stat.redirectCache = NetworkRedirectCache::metrics();
+    return stat;
+}
+
+void NetworkManager::resetStatistics()
+{
+    NetworkStatisticsCollector::reset();
+}
+
+bool NetworkManager::startMetricsExporter(quint16 uiPort, QString *pError /* = nullptr */)
+{
+    if (!NetworkManager::isInitialized())
+    {
+        if (pError)
+        {
+            *pError = QStringLiteral("NetworkManager is not initialized");
+        }
+        return false;
+    }
+    NetworkManager *pManager = NetworkManager::globalInstance();
+    return NetworkMetricsExporter::start(uiPort, [pManager]() {
+        return pManager->statistics();
+    }, pError);
+}
+
+void NetworkManager::stopMetricsExporter()
+{
+    NetworkMetricsExporter::stop();
+}
+
+quint16 NetworkManager::metricsExporterPort()
+{
+    return NetworkMetricsExporter::port();
+}
+
+void NetworkManager::setTraceEnabled(bool bEnable)
+{
+    NetworkTracer::setEnabled(bEnable);
+}
+
+bool NetworkManager::isTraceEnabled()
+{
+    return NetworkTracer::isEnabled();
+}
+
+bool NetworkManager::writeTrace(const QString& strFilePath, QString *pError /* = nullptr */)
+{
+    return NetworkTracer::writeChromeTrace(strFilePath, pError);
+}
+
+void NetworkManager::clearTrace()
+{
+    NetworkTracer::clear();
+}
+
 int NetworkManager::maxThreadCount()
 {
     Q_D(NetworkManager);
@@ -872,9 +1044,12 @@ void NetworkManager::onRequestFinished(const RequestTask &request)
         // 加入到失败队列，如果成功表示第一次失败，否则表示是第二次失败
         //		第一次失败的情况: 需要将任务再次加入到等待队列重新执行一遍
         //		第二次失败的情况: 需要将任务结果反馈给用户
-        if (task.bTryAgainIfFailed && d->addToFailedQueue(task))
+        //顺序设备的请求体已被读取，不能再发送
+        const bool bReplayable = !(task.pReqBodyDevice && task.pReqBodyDevice->isSequential());
+        if (task.bTryAgainIfFailed && bReplayable && d->addToFailedQueue(task))
         {
             bNotify = false;
+            NetworkStatisticsCollector::recordRetry();
         }
     }
 
@@ -930,7 +1105,13 @@ void NetworkManager::onRequestFinished(const RequestTask &request)
             {
                 task.bFinished = true;
                 task.bCancel = (task.uiBatchId > 0 && !task.bSuccess && task.bAbortBatchWhenFailed);
+                task.timing.iDeliveredUs = networkTimestampUs();
                 pReply->replyResult(task, bDestroyed);
+                if (NetworkTracer::isEnabled())
+                {
+                    NetworkTracer::addRequestSpan("delivery", "request", task.timing.iDeliveredUs, networkTimestampUs(),
+                        task.uiId, task.uiBatchId);
+                }
                 if (task.uiBatchId > 0 && bDestroyed)
                 {
                     LOG_INFO("[Batch request finished! Id：" << task.uiBatchId);
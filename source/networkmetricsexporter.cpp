@@ -0,0 +1,321 @@
+﻿#include "networkmetricsexporter.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QTimer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QDebug>
+#include "Log4cplusWrapper.h"
+
+//同时保持的连接数
+#define EXPORTER_MAX_CONNECTIONS 16
+//请求头的长度上限
+#define EXPORTER_MAX_REQUEST_BYTES 8192
+//连接超时(ms)，超时未发完请求则关闭
+#define EXPORTER_CONNECTION_TIMEOUT 5000
+
+namespace
+{
+    QMutex s_mutex;
+    QThread *s_pThread = nullptr;
+    quint16 s_uiPort = 0;
+
+    const char *typeLabel(RequestType eType)
+    {
+        switch (eType)
+        {
+        case eTypeDownload: return "download";
+        case eTypeMTDownload: return "mt_download";
+        case eTypeUpload: return "upload";
+        case eTypeGet: return "get";
+        case eTypePost: return "post";
+        case eTypePut: return "put";
+        case eTypeDelete: return "delete";
+        case eTypeHead: return "head";
+        case eTypeMTUpload: return "mt_upload";
+        case eTypeFormUpload: return "form_upload";
+        default: return "unknown";
+        }
+    }
+
+    //标签值的转义: \ " 换行
+    QByteArray escapeLabel(const QString& strValue)
+    {
+        QByteArray bytes = strValue.toUtf8();
+        bytes.replace('\\', "\\\\");
+        bytes.replace('"', "\\\"");
+        bytes.replace('\n', "\\n");
+        return bytes;
+    }
+
+    QByteArray number(double dValue)
+    {
+        return QByteArray::number(dValue, 'g', 12);
+    }
+
+    QByteArray number(qint64 iValue)
+    {
+        return QByteArray::number(iValue);
+    }
+
+    QByteArray number(quint64 uiValue)
+    {
+        return QByteArray::number(uiValue);
+    }
+
+    QByteArray number(int nValue)
+    {
+        return QByteArray::number(nValue);
+    }
+
+    double seconds(qint64 iUs)
+    {
+        return iUs / 1000000.0;
+    }
+
+    void header(QByteArray& out, const char *name, const char *type, const char *help)
+    {
+        out.append("# HELP qmtnetwork_").append(name).append(' ').append(help).append('\n');
+        out.append("# TYPE qmtnetwork_").append(name).append(' ').append(type).append('\n');
+    }
+
+    void sample(QByteArray& out, const char *name, const QByteArray& labels, const QByteArray& value)
+    {
+        out.append("qmtnetwork_").append(name);
+        if (!labels.isEmpty())
+        {
+            out.append('{').append(labels).append('}');
+        }
+        out.append(' ').append(value).append('\n');
+    }
+
+    void metric(QByteArray& out, const char *name, const char *type, const char *help, const QByteArray& value)
+    {
+        header(out, name, type, help);
+        sample(out, name, QByteArray(), value);
+    }
+}
+
+bool NetworkMetricsExporter::start(quint16 uiPort, StatisticsProvider provider, QString *pError /* = nullptr */)
+{
+    stop();
+
+    QMutexLocker locker(&s_mutex);
+    QThread *pThread = new QThread;
+    pThread->setObjectName(QStringLiteral("QMultiThreadNetwork metrics"));
+    NetworkMetricsServer *pServer = new NetworkMetricsServer(provider);
+    pServer->moveToThread(pThread);
+    QObject::connect(pThread, &QThread::finished, pServer, &QObject::deleteLater);
+    pThread->start();
+
+    QString strError;
+    QMetaObject::invokeMethod(pServer, "listenOn", Qt::BlockingQueuedConnection,
+        Q_RETURN_ARG(QString, strError), Q_ARG(int, uiPort));
+    if (!strError.isEmpty())
+    {
+        LOG_ERROR("Metrics exporter listen failed: " << strError.toStdWString());
+        qWarning() << "[QMultiThreadNetwork] Metrics exporter listen failed:" << strError;
+        pThread->quit();
+        pThread->wait();
+        delete pThread;
+        if (pError)
+        {
+            *pError = strError;
+        }
+        return false;
+    }
+
+    //serverPort()在监听后不再改变
+    s_uiPort = pServer->serverPort();
+    s_pThread = pThread;
+    LOG_INFO("Metrics exporter listening on 127.0.0.1:" << s_uiPort);
+    qDebug() << "[QMultiThreadNetwork] Metrics exporter listening on 127.0.0.1:" << s_uiPort;
+    return true;
+}
+
+void NetworkMetricsExporter::stop()
+{
+    QMutexLocker locker(&s_mutex);
+    if (s_pThread)
+    {
+        //线程结束时删除服务(关闭监听和连接)
+        s_pThread->quit();
+        s_pThread->wait();
+        delete s_pThread;
+        s_pThread = nullptr;
+        s_uiPort = 0;
+    }
+}
+
+quint16 NetworkMetricsExporter::port()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_uiPort;
+}
+
+QByteArray NetworkMetricsExporter::format(const NetworkStatistics& stat)
+{
+    QByteArray out;
+    out.reserve(4096);
+
+    metric(out, "requests_in_flight", "gauge", "Requests running on a worker thread.", number(stat.nInFlight));
+    metric(out, "requests_queued", "gauge", "Requests waiting for a worker thread.", number(stat.nQueued));
+    metric(out, "worker_threads_max", "gauge", "Maximum number of worker threads.", number(stat.nMaxThreads));
+
+    header(out, "requests_total", "counter", "Finished requests by type and result.");
+    for (auto iter = stat.mapType.cbegin(); iter != stat.mapType.cend(); ++iter)
+    {
+        const QByteArray type = QByteArray("type=\"") + typeLabel(iter.key()) + '"';
+        sample(out, "requests_total", type + ",result=\"success\"", number(iter->uiCompleted));
+        sample(out, "requests_total", type + ",result=\"failure\"", number(iter->uiFailed));
+    }
+
+    //直方图可以在Prometheus里跨实例聚合并用histogram_quantile()计算分位数
+    header(out, "request_duration_seconds", "histogram", "Time from enqueue to completion by type.");
+    for (auto iter = stat.mapType.cbegin(); iter != stat.mapType.cend(); ++iter)
+    {
+        const LatencySummary& l = iter->latency;
+        const QByteArray type = QByteArray("type=\"") + typeLabel(iter.key()) + '"';
+        for (const auto& bucket : l.listBucket)
+        {
+            sample(out, "request_duration_seconds_bucket",
+                type + ",le=\"" + number(seconds(bucket.first)) + '"', number(bucket.second));
+        }
+        sample(out, "request_duration_seconds_bucket", type + ",le=\"+Inf\"", number(l.uiCount));
+        sample(out, "request_duration_seconds_sum", type, number(seconds(l.iSumUs)));
+        sample(out, "request_duration_seconds_count", type, number(l.uiCount));
+    }
+
+    header(out, "host_requests_total", "counter", "Finished requests by host and result.");
+    for (auto iter = stat.mapHost.cbegin(); iter != stat.mapHost.cend(); ++iter)
+    {
+        const QByteArray host = "host=\"" + escapeLabel(iter.key()) + '"';
+        sample(out, "host_requests_total", host + ",result=\"success\"", number(iter->uiCompleted));
+        sample(out, "host_requests_total", host + ",result=\"failure\"", number(iter->uiFailed));
+    }
+
+    metric(out, "retries_total", "counter", "Failed requests that were retried.", number(stat.uiRetries));
+    metric(out, "cancellations_total", "counter", "Requests cancelled before completion.", number(stat.uiCancellations));
+    metric(out, "sent_bytes_total", "counter", "Request body bytes sent.", number(stat.iBytesSent));
+    metric(out, "received_bytes_total", "counter", "Response body bytes received.", number(stat.iBytesReceived));
+
+    const DiskWriterMetrics& disk = stat.diskWriter;
+    metric(out, "disk_queued_bytes", "gauge", "Bytes waiting to be written to disk.", number(disk.iQueuedBytes));
+    metric(out, "disk_written_bytes_total", "counter", "Bytes written to disk.", number(disk.uiBytesWritten));
+    metric(out, "disk_writes_total", "counter", "Disk write calls.", number(disk.uiWriteCount));
+    metric(out, "disk_backpressure_total", "counter", "Times a network thread waited for the disk queue.", number(disk.uiBackPressureCount));
+
+    header(out, "tls_handshakes_total", "counter", "TLS handshakes by mode.");
+    sample(out, "tls_handshakes_total", "mode=\"full\"", number(stat.tlsSession.uiFullHandshakes));
+    sample(out, "tls_handshakes_total", "mode=\"resumed\"", number(stat.tlsSession.uiResumedHandshakes));
+
+    header(out, "redirect_cache_lookups_total", "counter", "Redirect cache lookups by result.");
+    sample(out, "redirect_cache_lookups_total", "result=\"hit\"", number(stat.redirectCache.uiHits));
+    sample(out, "redirect_cache_lookups_total", "result=\"miss\"", number(stat.redirectCache.uiMisses));
+    return out;
+}
+
+//////////////////////////////////////////////////////////////////////////
+NetworkMetricsServer::NetworkMetricsServer(NetworkMetricsExporter::StatisticsProvider provider, QObject *parent /* = nullptr */)
+    : QTcpServer(parent)
+    , m_provider(provider)
+{
+    setMaxPendingConnections(EXPORTER_MAX_CONNECTIONS);
+    connect(this, &QTcpServer::newConnection, this, &NetworkMetricsServer::onNewConnection);
+}
+
+NetworkMetricsServer::~NetworkMetricsServer()
+{
+    close();
+}
+
+QString NetworkMetricsServer::listenOn(int nPort)
+{
+    //只接受本机的连接
+    if (!listen(QHostAddress::LocalHost, (quint16)nPort))
+    {
+        return errorString();
+    }
+    return QString();
+}
+
+void NetworkMetricsServer::onNewConnection()
+{
+    while (hasPendingConnections())
+    {
+        QTcpSocket *pSocket = nextPendingConnection();
+        if (m_hashBuffer.size() >= EXPORTER_MAX_CONNECTIONS)
+        {
+            pSocket->abort();
+            pSocket->deleteLater();
+            continue;
+        }
+        m_hashBuffer.insert(pSocket, QByteArray());
+        connect(pSocket, &QTcpSocket::readyRead, this, &NetworkMetricsServer::onReadyRead);
+        connect(pSocket, &QTcpSocket::disconnected, this, &NetworkMetricsServer::onDisconnected);
+        QTimer::singleShot(EXPORTER_CONNECTION_TIMEOUT, pSocket, [pSocket]() {
+            pSocket->abort();
+        });
+    }
+}
+
+void NetworkMetricsServer::onReadyRead()
+{
+    QTcpSocket *pSocket = qobject_cast<QTcpSocket *>(sender());
+    auto iter = m_hashBuffer.find(pSocket);
+    if (iter == m_hashBuffer.end())
+    {
+        return;
+    }
+
+    iter->append(pSocket->readAll());
+    const int nHeaderEnd = iter->indexOf("\r\n\r\n");
+    if (nHeaderEnd < 0)
+    {
+        if (iter->size() > EXPORTER_MAX_REQUEST_BYTES)
+        {
+            pSocket->abort();
+        }
+        return;
+    }
+
+    //请求行: METHOD PATH HTTP/1.x
+    const QList<QByteArray> listRequest = iter->left(iter->indexOf("\r\n")).split(' ');
+    iter->clear();
+    disconnect(pSocket, &QTcpSocket::readyRead, this, &NetworkMetricsServer::onReadyRead);
+
+    if (listRequest.size() < 2 || listRequest.at(0) != "GET")
+    {
+        reply(pSocket, "405 Method Not Allowed", "Method Not Allowed\n");
+        return;
+    }
+    const QByteArray path = listRequest.at(1).left(listRequest.at(1).indexOf('?'));
+    if (path != "/metrics" && path != "/")
+    {
+        reply(pSocket, "404 Not Found", "Not Found\n");
+        return;
+    }
+    reply(pSocket, "200 OK", NetworkMetricsExporter::format(m_provider()));
+}
+
+void NetworkMetricsServer::onDisconnected()
+{
+    QTcpSocket *pSocket = qobject_cast<QTcpSocket *>(sender());
+    m_hashBuffer.remove(pSocket);
+    pSocket->deleteLater();
+}
+
+void NetworkMetricsServer::reply(QTcpSocket *pSocket, const QByteArray& bytesStatus, const QByteArray& bytesBody)
+{
+    QByteArray bytes;
+    bytes.reserve(bytesBody.size() + 160);
+    bytes.append("HTTP/1.1 ").append(bytesStatus).append("\r\n");
+    bytes.append("Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n");
+    bytes.append("Content-Length: ").append(QByteArray::number(bytesBody.size())).append("\r\n");
+    bytes.append("Connection: close\r\n\r\n");
+    bytes.append(bytesBody);
+    pSocket->write(bytes);
+    //发送完后断开(disconnected时删除)
+    pSocket->disconnectFromHost();
+}
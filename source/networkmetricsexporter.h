@@ -0,0 +1,57 @@
+﻿#ifndef NETWORKMETRICSEXPORTER_H
+#define NETWORKMETRICSEXPORTER_H
+
+#include <functional>
+#include <QHash>
+#include <QByteArray>
+#include <QTcpServer>
+#include "networkdef.h"
+
+class QTcpSocket;
+
+//Prometheus指标导出 (NetworkManager::startMetricsExporter())
+//在自己的线程中运行一个只监听127.0.0.1的HTTP服务，GET /metrics返回文本格式(0.0.4)的统计，
+//采集不经过NetworkManager所在线程的事件循环. 所有方法线程安全
+class NetworkMetricsExporter
+{
+public:
+    typedef std::function<NetworkStatistics()> StatisticsProvider;
+
+    //uiPort为0时由系统分配端口(通过port()获取). 已启动时先停止
+    static bool start(quint16 uiPort, StatisticsProvider provider, QString *pError = nullptr);
+    //关闭监听和所有连接，等待线程结束
+    static void stop();
+    //监听的端口，未启动时返回0
+    static quint16 port();
+
+    //把统计转换为Prometheus文本格式
+    static QByteArray format(const NetworkStatistics& stat);
+};
+
+//运行在导出线程中的HTTP服务
+class NetworkMetricsServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit NetworkMetricsServer(NetworkMetricsExporter::StatisticsProvider provider, QObject *parent = nullptr);
+    ~NetworkMetricsServer();
+
+    //在导出线程中监听，返回错误信息，成功时为空
+    Q_INVOKABLE QString listenOn(int nPort);
+
+private Q_SLOTS:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    void reply(QTcpSocket *pSocket, const QByteArray& bytesStatus, const QByteArray& bytesBody);
+
+private:
+    NetworkMetricsExporter::StatisticsProvider m_provider;
+    //未收完的请求头
+    QHash<QTcpSocket *, QByteArray> m_hashBuffer;
+};
+
+#endif // NETWORKMETRICSEXPORTER_H
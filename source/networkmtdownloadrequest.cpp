@@ -12,28 +12,250 @@
 #include <QCoreApplication>
 #include "Log4cplusWrapper.h"
 #include "networkmanager.h"
+#include "networkfileinfocache.h"
+#include "networkdiskwriter.h"
+#include "networkbufferpool.h"
+#include "networkchecksum.h"
+#include "networkrequesttemplate.h"
+#include "networkredirectcache.h"
+#include "networktracer.h"
+#include <algorithm>
+
+#define MAX_DOWNLOAD_THREAD_COUNT 10
+// 自动模式初始的下载通道数
+#define AUTO_INITIAL_THREAD_COUNT 2
+// 自动模式测量下载速度的间隔(ms)
+#define AUTO_SAMPLE_INTERVAL 1000
+// 每增加一个通道，总速度至少提升的比例
+#define AUTO_MIN_GAIN 0.1
+// 拆分下载段时，每段的最小长度
+#define MIN_SEGMENT_SIZE (1024 * 1024)
+// 下载到内存的最大文件大小(QByteArray最大不到2GB)
+#define MAX_MEMORY_DOWNLOAD_SIZE (1024LL * 1024 * 1024)
+// 内存映射文件刷新到磁盘的间隔(ms)
+#define MMAP_FLUSH_INTERVAL 2000
 
 
 NetworkMTDownloadRequest::NetworkMTDownloadRequest(QObject *parent /* = nullptr */)
     : NetworkRequest(parent)
     , m_nThreadCount(0)
-    , m_nSuccess(0)
-    , m_nFailed(0)
-    , m_bytesReceived(0)
+    , m_nNextIndex(0)
+    , m_bFailed(false)
+    , m_bProbing(false)
+    , m_bSmartMode(false)
+    , m_bAcceptRanges(true)
+    , m_bMemoryMode(false)
+    , m_uiWriterId(0)
+    , m_pMappedData(nullptr)
+    , m_pFlushTimer(new QTimer(this))
+    , m_bytesFinished(0)
     , m_bytesTotal(0)
     , m_nFileSize(-1)
+    , m_pSampleTimer(new QTimer(this))
+    , m_bytesLastSample(0)
+    , m_dBaselineRate(0)
+    , m_dChannelRate(0)
+    , m_nWarmupSamples(0)
+    , m_bAutoSettled(false)
 {
+    m_pSampleTimer->setInterval(AUTO_SAMPLE_INTERVAL);
+    connect(m_pSampleTimer, SIGNAL(timeout()), this, SLOT(onSampleTimeout()));
+    m_pFlushTimer->setInterval(MMAP_FLUSH_INTERVAL);
+    connect(m_pFlushTimer, SIGNAL(timeout()), this, SLOT(onFlushTimeout()));
 }
 
 NetworkMTDownloadRequest::~NetworkMTDownloadRequest()
 {
+    unmapLocalFile(false);
+    closeLocalFile(true);
 }
 
 void NetworkMTDownloadRequest::abort()
 {
     __super::abort();
+    m_pSampleTimer->stop();
     clearDownloaders();
     clearProgress();
+    unmapLocalFile(false);
+    closeLocalFile(true);
+}
+
+void NetworkMTDownloadRequest::mapLocalFile()
+{
+#if QT_POINTER_SIZE == 8
+    if (m_request.eType != eTypeMTDownload || !m_request.bMemoryMappedFile || m_bMemoryMode
+        || m_pMappedData || m_nFileSize <= 0)
+    {
+        return;
+    }
+    if (m_nFileSize > m_request.iMemoryMapMaxSize)
+    {
+        LOG_INFO("MT download file size " << m_nFileSize << " exceeds memory map budget, use positional writes");
+        qDebug() << "[QMultiThreadNetwork] MT download file size" << m_nFileSize << "exceeds memory map budget, use positional writes";
+        return;
+    }
+
+#if _MSC_VER >= 1700
+    m_pMapFile = std::make_unique<QFile>(m_strWriteFilePath);
+#else
+    m_pMapFile.reset(new QFile(m_strWriteFilePath));
+#endif
+    if (m_pMapFile->open(QIODevice::ReadWrite) && m_pMapFile->resize(m_nFileSize))
+    {
+        m_pMappedData = m_pMapFile->map(0, m_nFileSize);
+    }
+    if (nullptr == m_pMappedData)
+    {
+        LOG_ERROR("MT download map file failed: " << m_pMapFile->errorString().toStdWString());
+        qDebug() << "[QMultiThreadNetwork] MT download map file failed:" << m_pMapFile->errorString();
+        m_pMapFile.reset();
+        return;
+    }
+    //其他策略由操作系统回写，结束时再刷新
+    if (m_request.eDurability == eDurabilityWriteBehind)
+    {
+        m_pFlushTimer->start();
+    }
+#endif
+}
+
+bool NetworkMTDownloadRequest::unmapLocalFile(bool bFlush)
+{
+    if (nullptr == m_pMappedData)
+    {
+        return true;
+    }
+    m_pFlushTimer->stop();
+
+    bool bRet = true;
+    if (bFlush)
+    {
+        //只支持win32(见createLocalFile()). FlushViewOfFile只写入系统缓存，还要刷新文件
+#ifdef WIN32
+        bRet = (FALSE != FlushViewOfFile(m_pMappedData, 0)) && NetworkDiskWriter::syncFile(m_pMapFile.get());
+#endif
+        if (!bRet)
+        {
+            m_strError = QStringLiteral("MT download flush mapped file failed");
+            LOG_ERROR(m_strError.toStdWString());
+        }
+    }
+    m_pMapFile->unmap(m_pMappedData);
+    m_pMappedData = nullptr;
+    m_pMapFile->close();
+    m_pMapFile.reset();
+    return bRet;
+}
+
+bool NetworkMTDownloadRequest::verifyChecksum()
+{
+    if (m_request.eHashAlgorithm == eHashNone && m_request.iExpectedSize < 0)
+    {
+        return true;
+    }
+
+    //所有通道都已结束
+    const qint64 iSize = m_bytesFinished;
+    QByteArray bytesDigest;
+    if (m_request.eHashAlgorithm == eHashCrc32c)
+    {
+        //按位置合并各通道的CRC32C，数据段必须首尾相接
+        std::sort(m_listSegmentCrc.begin(), m_listSegmentCrc.end(),
+            [](const SegmentCrc& a, const SegmentCrc& b) { return a.start < b.start; });
+        quint32 crc = 0;
+        qint64 pos = 0;
+        for (const SegmentCrc& seg : m_listSegmentCrc)
+        {
+            if (seg.start != pos)
+            {
+                break;
+            }
+            crc = NetworkChecksum::crc32cCombine(crc, seg.crc, seg.length);
+            pos += seg.length;
+        }
+        if (pos != iSize)
+        {
+            m_strError = QStringLiteral("Integrity check failed: segments cover %1 of %2 bytes").arg(pos).arg(iSize);
+            LOG_ERROR(m_strError.toStdWString());
+            m_request.eErrorType = eErrorIntegrity;
+            return false;
+        }
+        bytesDigest = NetworkChecksum::crc32cHex(crc);
+    }
+    else if (m_request.eHashAlgorithm == eHashSha256)
+    {
+        //SHA-256不能分段合并，在内存或映射的文件上计算，否则读一遍文件
+        NetworkChecksum checksum(eHashSha256);
+        if (m_bMemoryMode)
+        {
+            checksum.addData(m_bytesContent.constData(), iSize);
+        }
+        else if (m_pMappedData)
+        {
+            checksum.addData((const char *)m_pMappedData, iSize);
+        }
+        else
+        {
+            QFile file(m_strWriteFilePath);
+            if (!file.open(QIODevice::ReadOnly))
+            {
+                m_strError = QStringLiteral("Error: QFile::open(%1) - %2").arg(m_strWriteFilePath).arg(file.errorString());
+                LOG_ERROR(m_strError.toStdWString());
+                return false;
+            }
+            QByteArray buffer;
+            while (!(buffer = file.read(1024 * 1024)).isEmpty())
+            {
+                checksum.addData(buffer);
+            }
+        }
+        bytesDigest = checksum.hexDigest();
+    }
+
+    if (!NetworkChecksum::verify(m_request, bytesDigest, iSize, m_strError))
+    {
+        LOG_ERROR(m_strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << m_strError;
+        m_request.eErrorType = eErrorIntegrity;
+        return false;
+    }
+    return true;
+}
+
+void NetworkMTDownloadRequest::onFlushTimeout()
+{
+    //定时把映射的数据异步刷新到磁盘
+    if (m_pMappedData)
+    {
+#ifdef WIN32
+        FlushViewOfFile(m_pMappedData, 0);
+#endif
+    }
+}
+
+bool NetworkMTDownloadRequest::closeLocalFile(bool bDiscard)
+{
+    if (0 == m_uiWriterId)
+    {
+        return true;
+    }
+    QString strError;
+    const bool bRet = NetworkDiskWriter::close(m_uiWriterId, bDiscard, &strError);
+    if (!bRet && !bDiscard)
+    {
+        m_strError = strError;
+    }
+    m_uiWriterId = 0;
+    return bRet;
+}
+
+bool NetworkMTDownloadRequest::commitLocalFile()
+{
+    if (m_bMemoryMode || m_strWriteFilePath.isEmpty() || m_strWriteFilePath == m_strDstFilePath)
+    {
+        return true;
+    }
+    return NetworkDiskWriter::commit(m_strWriteFilePath, m_strDstFilePath, m_request.eDurability != eDurabilityNone, &m_strError);
 }
 
 bool NetworkMTDownloadRequest::createLocalFile()
@@ -119,11 +341,11 @@ bool NetworkMTDownloadRequest::createLocalFile()
         return false;
     }
 
-    //如果文件存在，关闭文件并移除
+    //如果文件存在，关闭文件并移除(先下载到临时文件时，下载成功后再替换)
     const QString& strFilePath = QDir::toNativeSeparators(strSaveDir + strFileName);
     if (QFile::exists(strFilePath))
     {
-        if (m_request.bReplaceFileIfExist)
+        if (m_request.bReplaceFileIfExist && !m_request.bAtomicCommit)
         {
             QFile file(strFilePath);
             if (!removeFile(&file))
@@ -134,7 +356,7 @@ bool NetworkMTDownloadRequest::createLocalFile()
                 return false;
             }
         }
-        else
+        else if (!m_request.bReplaceFileIfExist)
         {
             m_strError = QStringLiteral("Error: File is already exist(%1)").arg(strFilePath);
             qWarning() << m_strError;
@@ -143,20 +365,40 @@ bool NetworkMTDownloadRequest::createLocalFile()
         }
     }
 
+    //删除上次残留的临时文件
+    const QString& strWriteFilePath = m_request.bAtomicCommit ? NetworkDiskWriter::tempFilePath(strFilePath) : strFilePath;
+    if (m_request.bAtomicCommit && QFile::exists(strWriteFilePath))
+    {
+        QFile file(strWriteFilePath);
+        if (!removeFile(&file))
+        {
+            m_strError = QStringLiteral("Error: QFile::remove(%1) - %2").arg(strWriteFilePath).arg(file.errorString());
+            qWarning() << m_strError;
+            LOG_INFO(m_strError.toStdWString());
+            return false;
+        }
+    }
+
     m_strDstFilePath = strFilePath;
+    m_strWriteFilePath = strWriteFilePath;
 #ifdef WIN32
-    HANDLE hFile = CreateFileW(m_strDstFilePath.toStdWString().c_str(), GENERIC_READ | GENERIC_WRITE,
+    HANDLE hFile = CreateFileW(m_strWriteFilePath.toStdWString().c_str(), GENERIC_READ | GENERIC_WRITE,
         FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS,
         FILE_ATTRIBUTE_NORMAL, nullptr);
     if (hFile != nullptr && hFile != INVALID_HANDLE_VALUE)
     {
-        LARGE_INTEGER li = { 0 };
-        li.QuadPart = m_nFileSize;
-        if (!SetFilePointerEx(hFile, li, &li, FILE_BEGIN))
+        //文件大小未知时(bSkipFileSizeRequest)只创建文件
+        if (m_nFileSize > 0)
         {
-            LOG_ERROR("SetFilePointerEx error:" << GetLastError());
-            qCritical() << "[QMultiThreadNetwork] SetFilePointerEx error:" << GetLastError();
-            return false;
+            LARGE_INTEGER li = { 0 };
+            li.QuadPart = m_nFileSize;
+            if (!SetFilePointerEx(hFile, li, &li, FILE_BEGIN))
+            {
+                LOG_ERROR("SetFilePointerEx error:" << GetLastError());
+                qCritical() << "[QMultiThreadNetwork] SetFilePointerEx error:" << GetLastError();
+                CloseHandle(hFile);
+                return false;
+            }
         }
         CloseHandle(hFile);
     }
@@ -173,222 +415,851 @@ bool NetworkMTDownloadRequest::createLocalFile()
     return false;
 #endif
 
+    //各下载通道的数据由写文件线程写入
+    closeLocalFile(true);
+    m_uiWriterId = NetworkDiskWriter::open(m_strWriteFilePath, &m_strError, m_request.eDurability);
+    return (m_uiWriterId != 0);
+}
+
+bool NetworkMTDownloadRequest::allocateBuffer()
+{
+    m_strError.clear();
+    m_bytesContent.clear();
+    if (m_nFileSize > MAX_MEMORY_DOWNLOAD_SIZE)
+    {
+        m_strError = QStringLiteral("Error: file is too large to download to memory(%1)").arg(m_nFileSize);
+        qWarning() << m_strError;
+        LOG_INFO(m_strError.toStdWString());
+        return false;
+    }
+    //文件大小未知时(bSkipFileSizeRequest)缓冲区随下载的内容增长
+    if (m_nFileSize > 0)
+    {
+        m_bytesContent.resize((int)m_nFileSize);
+        if (m_bytesContent.size() != m_nFileSize)
+        {
+            m_strError = QStringLiteral("Error: allocate memory failed(%1)").arg(m_nFileSize);
+            qWarning() << m_strError;
+            LOG_INFO(m_strError.toStdWString());
+            return false;
+        }
+    }
+    return true;
+}
+
+//用获取下载文件的长度
+bool NetworkMTDownloadRequest::requestFileSize(QUrl url)
+{
+    if (!url.isValid())
+    {
+        return false;
+    }
+    m_nFileSize = -1;
+    m_url = url;
+
+    createNetworkManager();
+    QNetworkRequest request = createNetworkRequest(url);
+    request.setRawHeader("Accept-Encoding", "identity");
+    //request.setRawHeader("Accept-Encoding", "gzip");
+
+    m_pNetworkReply = m_pNetworkManager->head(request);
+    if (m_pNetworkReply)
+    {
+        connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onFinished()));
+        connect(m_pNetworkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
+    }
+    return true;
+}
+
+void NetworkMTDownloadRequest::start()
+{
+    __super::start();
+
+    m_bFailed = false;
+    m_bSmartMode = (m_request.eType == eTypeDownload);
+    m_bMemoryMode = (m_request.eType == eTypeMTDownload && m_request.bDownloadToMemory);
+    m_bAcceptRanges = true;
+    m_bytesContent.clear();
+    m_bytesETag.clear();
+    m_vecMirror.clear();
+    m_vecMirror.append(Mirror(requestUrl()));
+    foreach(const QUrl& url, m_request.listMirrorUrl)
+    {
+        if (url.isValid() && url != m_request.url)
+        {
+            m_vecMirror.append(Mirror(url));
+        }
+    }
+    if (m_request.bAutoDownloadThreadCount)
+    {
+        m_nThreadCount = AUTO_INITIAL_THREAD_COUNT;
+    }
+    else
+    {
+        m_nThreadCount = m_request.nDownloadThreadCount;
+        if (m_nThreadCount < 1)
+        {
+            m_nThreadCount = 1;
+        }
+        if (m_nThreadCount > MAX_DOWNLOAD_THREAD_COUNT)
+        {
+            m_nThreadCount = MAX_DOWNLOAD_THREAD_COUNT;
+        }
+    }
+
+    //之前已经获取过该文件的信息
+    RemoteFileInfo info;
+    if (NetworkFileInfoCache::lookup(m_request.url, info) && info.bAcceptRanges && info.nFileSize > 0
+        && (!m_bSmartMode || info.nFileSize >= m_request.iAutoMTDownloadMinSize))
+    {
+        LOG_INFO("MT File size(cached): " << info.nFileSize);
+        qDebug() << "[QMultiThreadNetwork] MT File size(cached):" << info.nFileSize;
+
+        m_url = requestUrl();
+        clearProgress();
+        m_nFileSize = info.nFileSize;
+        m_bytesTotal = m_nFileSize;
+        m_bytesETag = info.bytesETag;
+        startMTDownload();
+        return;
+    }
+
+    if (m_request.bSkipFileSizeRequest || m_bSmartMode)
+    {
+        startProbeDownload();
+        return;
+    }
+
+    bool b = requestFileSize(requestUrl());
+    if (!b)
+    {
+        m_strError = QStringLiteral("Invalid Url").toUtf8();
+        emit requestFinished(false, QByteArray(), m_strError);
+    }
+}
+
+void NetworkMTDownloadRequest::startMTDownload()
+{
+    if (m_bAbortManual)
+    {
+        return;
+    }
+
+    if (m_nFileSize <= 0)
+    {
+        m_nThreadCount = 1;
+        m_strError = QStringLiteral("MT download 服务器未返回Content-Length");
+        LOG_INFO(m_strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << m_strError;
+
+        emit requestFinished(false, QByteArray(), m_strError);
+        return;
+    }
+
+    if (m_bMemoryMode ? allocateBuffer() : createLocalFile())
+    {
+        if (m_bAbortManual)
+        {
+            return;
+        }
+        mapLocalFile();
+
+        resetChannels();
+
+        //服务器未声明支持Range，先用一个通道请求整个文件，根据响应再决定是否分段
+        if (!m_bAcceptRanges)
+        {
+            m_bProbing = true;
+            if (!startSegment(0, m_nFileSize - 1))
+            {
+                abort();
+                emit requestFinished(false, QByteArray(), m_strError);
+            }
+            return;
+        }
+
+        //将文件分成n段，用异步的方式下载
+        for (int i = 0; i < m_nThreadCount; i++)
+        {
+            qint64 start = 0;
+            qint64 end = -1;
+            if (m_nThreadCount > 1 && m_nFileSize > 0)
+            {
+                //先算出每段的开头和结尾（HTTP协议所需要的信息）
+                start = m_nFileSize * i / m_nThreadCount;
+                end = m_nFileSize * (i + 1) / m_nThreadCount;
+                if (i == m_nThreadCount - 1)
+                {
+                    end--;
+                }
+            }
+            else if (m_nFileSize > 0)
+            {
+                end = m_nFileSize - 1;
+            }
+
+            if (!startSegment(start, end))
+            {
+                abort();
+                emit requestFinished(false, QByteArray(), m_strError);
+                return;
+            }
+        }
+
+        startAutoSample();
+    }
+    else
+    {
+        emit requestFinished(false, QByteArray(), m_strError);
+    }
+}
+
+void NetworkMTDownloadRequest::startProbeDownload()
+{
+    m_url = requestUrl();
+    m_nFileSize = -1;
+    clearProgress();
+
+    if (!(m_bMemoryMode ? allocateBuffer() : createLocalFile()))
+    {
+        emit requestFinished(false, QByteArray(), m_strError);
+        return;
+    }
+    if (m_bAbortManual)
+    {
+        return;
+    }
+
+    resetChannels();
+    m_bProbing = true;
+    //智能下载模式下第一个通道是普通的下载请求
+    if (!startSegment(0, -1, !m_bSmartMode))
+    {
+        abort();
+        emit requestFinished(false, QByteArray(), m_strError);
+    }
+}
+
+bool NetworkMTDownloadRequest::splitProbeSegment(Downloader *pProbe)
+{
+    //把剩余部分平均分成n段，第一个通道继续下载第一段
+    const qint64 from = pProbe->currentPoint();
+    const qint64 rest = m_nFileSize - from;
+    if (m_nThreadCount <= 1 || rest / m_nThreadCount < MIN_SEGMENT_SIZE)
+    {
+        m_nThreadCount = 1;
+        return true;
+    }
+
+    if (!pProbe->shrinkEndPoint(from + rest / m_nThreadCount - 1))
+    {
+        return true;
+    }
+    for (int i = 1; i < m_nThreadCount; i++)
+    {
+        const qint64 start = from + rest * i / m_nThreadCount;
+        const qint64 end = from + rest * (i + 1) / m_nThreadCount - 1;
+        if (!startSegment(start, end))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void NetworkMTDownloadRequest::resetChannels()
+{
+    clearDownloaders();
+    m_listPendingSegment.clear();
+    m_listSegmentCrc.clear();
+    m_nNextIndex = 0;
+    m_bytesFinished = 0;
+    m_bProbing = false;
+    m_elapsedTotal.start();
+}
+
+void NetworkMTDownloadRequest::startAutoSample()
+{
+    if (m_request.bAutoDownloadThreadCount)
+    {
+        m_bAutoSettled = false;
+        m_dBaselineRate = 0;
+        m_dChannelRate = 0;
+        m_bytesLastSample = bytesReceived();
+        m_nWarmupSamples = 1;
+        m_elapsedSample.start();
+        m_pSampleTimer->start();
+    }
+}
+
+void NetworkMTDownloadRequest::onSubPartMetaData(int index, qint64 fileSize, bool bRangeSupported)
+{
+    if (m_bAbortManual || m_bFailed)
+    {
+        return;
+    }
+
+    auto iter = m_mapDownloader.find(index);
+    if (iter == m_mapDownloader.end())
+    {
+        return;
+    }
+    Downloader *pDownloader = iter->second.get();
+
+    //文件在两次请求之间被修改（或者缓存的文件信息已过期），或者镜像上的文件与url不一致
+    const QByteArray& bytesETag = pDownloader->etag();
+    QString strErr;
+    if (fileSize > 0 && m_nFileSize > 0 && fileSize != m_nFileSize)
+    {
+        strErr = QStringLiteral("MT download file size changed(%1 -> %2)").arg(m_nFileSize).arg(fileSize);
+    }
+    else if (!bytesETag.isEmpty() && !m_bytesETag.isEmpty() && bytesETag != m_bytesETag)
+    {
+        strErr = QStringLiteral("MT download ETag changed(%1 -> %2)")
+            .arg(QString::fromLatin1(m_bytesETag)).arg(QString::fromLatin1(bytesETag));
+    }
+    if (!strErr.isEmpty())
+    {
+        strErr += QStringLiteral(" url: %1").arg(m_vecMirror[pDownloader->mirror()].url.toString());
+        LOG_ERROR(strErr.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << strErr;
+        onSubPartFinished(index, false, strErr);
+        return;
+    }
+    if (m_bytesETag.isEmpty())
+    {
+        m_bytesETag = bytesETag;
+    }
+
+    if (!m_bProbing)
+    {
+        return;
+    }
+    m_bProbing = false;
+
+    RemoteFileInfo info;
+    info.nFileSize = fileSize;
+    info.bAcceptRanges = bRangeSupported;
+    info.bytesETag = pDownloader->etag();
+    NetworkFileInfoCache::insert(m_request.url, info);
+
+    LOG_INFO("MT File size: " << fileSize << ", range supported: " << bRangeSupported);
+    qDebug() << "[QMultiThreadNetwork] MT File size:" << fileSize << "range supported:" << bRangeSupported;
+
+    if (fileSize <= 0)
+    {
+        //服务器未返回文件大小，只能用一个通道下载
+        m_nThreadCount = 1;
+        return;
+    }
+
+    m_nFileSize = fileSize;
+    m_bytesTotal = fileSize;
+    pDownloader->shrinkEndPoint(fileSize - 1);
+    if (m_bMemoryMode && m_bytesContent.size() != fileSize)
+    {
+        //第一个通道还未写入数据，此时按文件大小分配缓冲区
+        if (!allocateBuffer())
+        {
+            onSubPartFinished(index, false, m_strError);
+            return;
+        }
+    }
+    //第一个通道还未写入数据，此时映射文件
+    mapLocalFile();
+    if (m_pMappedData)
+    {
+        pDownloader->setMappedFile(m_pMappedData, m_nFileSize);
+    }
+    //不支持Range，或者智能下载模式下文件较小，按单通道下载
+    if (!bRangeSupported || (m_bSmartMode && fileSize < m_request.iAutoMTDownloadMinSize))
+    {
+        m_nThreadCount = 1;
+        return;
+    }
+
+    if (!splitProbeSegment(pDownloader))
+    {
+        onSubPartFinished(index, false, m_strError);
+        return;
+    }
+    startAutoSample();
+}
+
+bool NetworkMTDownloadRequest::startSegment(qint64 start, qint64 end, bool bRangeRequest)
+{
+    const int index = m_nNextIndex++;
+
+    //分段下载该文件
+    std::unique_ptr<Downloader> downloader;
+#if _MSC_VER >= 1700
+    downloader = std::make_unique<Downloader>(index, this);
+#else
+    downloader.reset(new Downloader(index, this));
+#endif
+    connect(downloader.get(), SIGNAL(downloadFinished(int, bool, const QString&)),
+        this, SLOT(onSubPartFinished(int, bool, const QString&)));
+    connect(downloader.get(), SIGNAL(downloadProgress(int, qint64, qint64)),
+        this, SLOT(onSubPartDownloadProgress(int, qint64, qint64)));
+    connect(downloader.get(), SIGNAL(metaDataReceived(int, qint64, bool)),
+        this, SLOT(onSubPartMetaData(int, qint64, bool)));
+    downloader->setRangeRequest(bRangeRequest);
+    const int nMirror = chooseMirror();
+    if (nMirror < 0)
+    {
+        m_strError = QStringLiteral("MT download: no available mirror");
+        LOG_ERROR(m_strError.toStdWString());
+        return false;
+    }
+    downloader->setMirror(nMirror);
+    if (m_bMemoryMode)
+    {
+        downloader->setMemoryBuffer(&m_bytesContent);
+    }
+    else
+    {
+        downloader->setFileWriter(m_uiWriterId);
+        if (m_pMappedData)
+        {
+            downloader->setMappedFile(m_pMappedData, m_nFileSize);
+        }
+    }
+    downloader->setReadBufferSize(m_request.iReadBufferSize);
+    downloader->setRequestPrototype(createNetworkRequest(QUrl()));
+    downloader->setCrc32c(m_request.eHashAlgorithm == eHashCrc32c);
+    if (downloader->startDownload(m_vecMirror[nMirror].url, m_strWriteFilePath, m_pNetworkManager,
+        start, end, m_request.bShowProgress))
+    {
+        m_mapDownloader[index] = std::move(downloader);
+        return true;
+    }
+
+    m_strError = QStringLiteral("Subpart %1 startDownload() failed!").arg(index);
+    LOG_ERROR(m_strError.toStdWString());
+    return false;
+}
+
+bool NetworkMTDownloadRequest::fillChannels()
+{
+    while ((int)m_mapDownloader.size() < m_nThreadCount)
+    {
+        qint64 start = 0;
+        qint64 end = -1;
+        if (!m_listPendingSegment.isEmpty())
+        {
+            const Segment& seg = m_listPendingSegment.takeFirst();
+            start = seg.start;
+            end = seg.end;
+        }
+        else if (!splitLargestSegment(start, end))
+        {
+            break;
+        }
+
+        if (!startSegment(start, end))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NetworkMTDownloadRequest::splitLargestSegment(qint64& start, qint64& end)
+{
+    Downloader *pLargest = nullptr;
+    for (std::pair<const int, std::unique_ptr<Downloader>>& pair : m_mapDownloader)
+    {
+        if (pair.second.get() && (nullptr == pLargest || pair.second->remaining() > pLargest->remaining()))
+        {
+            pLargest = pair.second.get();
+        }
+    }
+
+    if (nullptr == pLargest || pLargest->remaining() < MIN_SEGMENT_SIZE * 2)
+    {
+        return false;
+    }
+
+    const qint64 middle = pLargest->currentPoint() + pLargest->remaining() / 2;
+    end = pLargest->endPoint();
+    if (!pLargest->shrinkEndPoint(middle - 1))
+    {
+        return false;
+    }
+    start = middle;
+    return true;
+}
+
+bool NetworkMTDownloadRequest::addChannel()
+{
+    if (m_nThreadCount >= MAX_DOWNLOAD_THREAD_COUNT)
+    {
+        return false;
+    }
+
+    m_nThreadCount++;
+    if (!fillChannels())
+    {
+        abort();
+        emit requestFinished(false, QByteArray(), m_strError);
+        return false;
+    }
+    if ((int)m_mapDownloader.size() < m_nThreadCount)
+    {
+        //剩余的数据已不够再分出一段
+        m_nThreadCount = (int)m_mapDownloader.size();
+        return false;
+    }
+    return true;
+}
+
+void NetworkMTDownloadRequest::removeChannel()
+{
+    if (m_mapDownloader.size() <= 1)
+    {
+        return;
+    }
+
+    //移除最后增加的通道，未下载的部分退回给其他通道
+    auto iter = --m_mapDownloader.end();
+    Downloader *pDownloader = iter->second.get();
+    if (pDownloader->remaining() > 0)
+    {
+        m_listPendingSegment.prepend(Segment(pDownloader->currentPoint(), pDownloader->endPoint()));
+    }
+    releaseChannel(iter);
+    m_nThreadCount--;
+}
+
+std::map<int, std::unique_ptr<Downloader>>::iterator
+NetworkMTDownloadRequest::releaseChannel(std::map<int, std::unique_ptr<Downloader>>::iterator iter)
+{
+    Downloader *pDownloader = iter->second.get();
+    if (pDownloader)
+    {
+        m_bytesFinished += pDownloader->bytesWritten();
+        if (m_request.eHashAlgorithm == eHashCrc32c && pDownloader->bytesWritten() > 0)
+        {
+            SegmentCrc seg;
+            seg.start = pDownloader->startPoint();
+            seg.length = pDownloader->bytesWritten();
+            seg.crc = pDownloader->crc32c();
+            m_listSegmentCrc.append(seg);
+        }
+        const int nMirror = pDownloader->mirror();
+        if (nMirror >= 0 && nMirror < m_vecMirror.size())
+        {
+            m_vecMirror[nMirror].bytes += pDownloader->bytesWritten();
+            m_vecMirror[nMirror].msElapsed += pDownloader->elapsed();
+        }
+        pDownloader->abort();
+        iter->second.release()->deleteLater();
+    }
+    return m_mapDownloader.erase(iter);
+}
+
+double NetworkMTDownloadRequest::mirrorRate(int nMirror) const
+{
+    const Mirror& mirror = m_vecMirror[nMirror];
+    qint64 bytes = mirror.bytes;
+    qint64 msElapsed = mirror.msElapsed;
+    for (const std::pair<const int, std::unique_ptr<Downloader>>& pair : m_mapDownloader)
+    {
+        if (pair.second.get() && pair.second->mirror() == nMirror)
+        {
+            bytes += pair.second->bytesWritten();
+            msElapsed += pair.second->elapsed();
+        }
+    }
+    return (bytes > 0 && msElapsed > 0) ? (bytes * 1000.0 / msElapsed) : 0;
+}
+
+int NetworkMTDownloadRequest::chooseMirror() const
+{
+    //还没有测得速度的镜像按已测得镜像的平均速度计算
+    double dTotalRate = 0;
+    int nMeasured = 0;
+    QVector<double> vecRate(m_vecMirror.size(), 0);
+    for (int i = 0; i < m_vecMirror.size(); i++)
+    {
+        if (m_vecMirror[i].bAvailable)
+        {
+            vecRate[i] = mirrorRate(i);
+            if (vecRate[i] > 0)
+            {
+                dTotalRate += vecRate[i];
+                nMeasured++;
+            }
+        }
+    }
+    const double dDefaultRate = (nMeasured > 0) ? (dTotalRate / nMeasured) : 1;
+
+    //通道数与速度成比例：选择增加一个通道后 通道数/速度 最小的镜像
+    int nBest = -1;
+    double dBestScore = 0;
+    for (int i = 0; i < m_vecMirror.size(); i++)
+    {
+        if (!m_vecMirror[i].bAvailable)
+        {
+            continue;
+        }
+        int nChannels = 0;
+        for (const std::pair<const int, std::unique_ptr<Downloader>>& pair : m_mapDownloader)
+        {
+            if (pair.second.get() && pair.second->mirror() == i)
+            {
+                nChannels++;
+            }
+        }
+        const double dRate = (vecRate[i] > 0) ? vecRate[i] : dDefaultRate;
+        const double dScore = (nChannels + 1) / dRate;
+        if (nBest < 0 || dScore < dBestScore)
+        {
+            nBest = i;
+            dBestScore = dScore;
+        }
+    }
+    return nBest;
+}
+
+bool NetworkMTDownloadRequest::dropMirror(int nMirror, const QString& strReason)
+{
+    if (nMirror < 0 || nMirror >= m_vecMirror.size())
+    {
+        return false;
+    }
+    int nAvailable = 0;
+    for (int i = 0; i < m_vecMirror.size(); i++)
+    {
+        if (i != nMirror && m_vecMirror[i].bAvailable)
+        {
+            nAvailable++;
+        }
+    }
+    if (nAvailable == 0)
+    {
+        return false;
+    }
+
+    m_vecMirror[nMirror].bAvailable = false;
+    LOG_INFO("MT download drop mirror: " << m_vecMirror[nMirror].url.toString().toStdWString() << "; " << strReason.toStdWString());
+    qDebug() << "[QMultiThreadNetwork] MT download drop mirror:" << m_vecMirror[nMirror].url.toString() << strReason;
+
+    //该镜像上其他通道未下载的部分交给其他镜像
+    for (auto iter = m_mapDownloader.begin(); iter != m_mapDownloader.end();)
+    {
+        Downloader *pDownloader = iter->second.get();
+        if (pDownloader && pDownloader->mirror() == nMirror)
+        {
+            if (pDownloader->endPoint() < 0 || pDownloader->remaining() > 0)
+            {
+                m_listPendingSegment.append(Segment(pDownloader->currentPoint(), pDownloader->endPoint()));
+            }
+            iter = releaseChannel(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
     return true;
 }
 
-//用获取下载文件的长度
-bool NetworkMTDownloadRequest::requestFileSize(QUrl url)
+void NetworkMTDownloadRequest::finishAutoProbe()
 {
-    if (!url.isValid())
-    {
-        return false;
-    }
-    m_nFileSize = -1;
-    m_url = url;
+    m_bAutoSettled = true;
+    LOG_INFO("MT download auto thread count: " << m_nThreadCount << ", rate: " << (qint64)m_dBaselineRate);
+    qDebug() << "[QMultiThreadNetwork] MT download auto thread count:" << m_nThreadCount << "rate:" << (qint64)m_dBaselineRate;
+}
 
-    if (nullptr == m_pNetworkManager)
+void NetworkMTDownloadRequest::onSampleTimeout()
+{
+    if (m_bAbortManual || m_mapDownloader.empty())
     {
-        m_pNetworkManager = new QNetworkAccessManager;
+        return;
     }
-    QNetworkRequest request(url);
-    request.setRawHeader("Accept-Encoding", "identity");
-    //request.setRawHeader("Accept-Encoding", "gzip");
 
-#ifndef QT_NO_SSL
-    if (isHttpsProxy(url.scheme()))
+    const qint64 nElapsed = m_elapsedSample.restart();
+    const qint64 bytes = bytesReceived();
+    const double rate = (nElapsed > 0) ? ((bytes - m_bytesLastSample) * 1000.0 / nElapsed) : 0;
+    m_bytesLastSample = bytes;
+
+    //新通道建立连接期间的速度不准确，跳过
+    if (m_nWarmupSamples > 0)
     {
-        // 发送https请求前准备工作;
-        QSslConfiguration conf = request.sslConfiguration();
-        conf.setPeerVerifyMode(QSslSocket::VerifyNone);
-        conf.setProtocol(QSsl::TlsV1SslV3);
-        request.setSslConfiguration(conf);
+        m_nWarmupSamples--;
+        return;
     }
-#endif
-
-    m_pNetworkReply = m_pNetworkManager->head(request);
-    if (m_pNetworkReply)
+    m_dChannelRate = rate / m_mapDownloader.size();
+    if (m_bAutoSettled)
     {
-        connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onFinished()));
-        connect(m_pNetworkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
+        return;
     }
-    return true;
-}
-
-void NetworkMTDownloadRequest::start()
-{
-    __super::start();
 
-    m_nSuccess = 0;
-    m_nFailed = 0;
-    m_nThreadCount = m_request.nDownloadThreadCount;
-    if (m_nThreadCount < 1)
+    if (m_dBaselineRate <= 0 || rate >= m_dBaselineRate * (1 + AUTO_MIN_GAIN))
     {
-        m_nThreadCount = 1;
+        //增加通道后速度仍有明显提升，继续增加
+        m_dBaselineRate = rate;
+        if (addChannel())
+        {
+            m_nWarmupSamples = 1;
+        }
+        else if (!m_bAbortManual)
+        {
+            finishAutoProbe();
+        }
     }
-    if (m_nThreadCount > 10)
+    else
     {
-        m_nThreadCount = 10;
+        //提升不明显则停止增加；速度反而下降则减少一个通道
+        if (rate < m_dBaselineRate * (1 - AUTO_MIN_GAIN) && m_nThreadCount > AUTO_INITIAL_THREAD_COUNT)
+        {
+            removeChannel();
+        }
+        finishAutoProbe();
     }
+}
 
-    bool b = requestFileSize(m_request.url);
-    if (!b)
+qint64 NetworkMTDownloadRequest::bytesReceived() const
+{
+    qint64 bytes = m_bytesFinished;
+    for (const std::pair<const int, std::unique_ptr<Downloader>>& pair : m_mapDownloader)
     {
-        m_strError = QStringLiteral("Invalid Url").toUtf8();
-        emit requestFinished(false, QByteArray(), m_strError);
+        if (pair.second.get())
+        {
+            bytes += pair.second->bytesWritten();
+        }
     }
+    return bytes;
 }
 
-void NetworkMTDownloadRequest::startMTDownload()
+void NetworkMTDownloadRequest::updateResult()
 {
-    if (m_bAbortManual)
+    m_request.nActualDownloadThreadCount = m_nThreadCount;
+    if (m_dChannelRate > 0)
     {
-        return;
+        m_request.iChannelBytesPerSecond = (qint64)m_dChannelRate;
     }
-
-    if (m_nFileSize <= 0)
+    else if (m_nThreadCount > 0 && m_elapsedTotal.isValid())
     {
-        m_nThreadCount = 1;
-        m_strError = QStringLiteral("MT download 服务器未返回Content-Length");
-        LOG_INFO(m_strError.toStdWString());
-        qDebug() << "[QMultiThreadNetwork]" << m_strError;
+        const qint64 nElapsed = qMax<qint64>(1, m_elapsedTotal.elapsed());
+        m_request.iChannelBytesPerSecond = bytesReceived() * 1000 / nElapsed / m_nThreadCount;
+    }
+}
 
-        emit requestFinished(false, QByteArray(), m_strError);
+void NetworkMTDownloadRequest::onSubPartFinished(int index, bool bSuccess, const QString& strErr)
+{
+    if (m_bAbortManual || m_bFailed)
+    {
         return;
     }
 
-    if (createLocalFile())
+    int nMirror = -1;
+    bool bRestRangeRequest = true;
+    bool bHasRest = false;
+    Segment segRest;
+    auto iter = m_mapDownloader.find(index);
+    if (iter != m_mapDownloader.end())
     {
-        if (m_bAbortManual)
+        Downloader *pDownloader = iter->second.get();
+        nMirror = pDownloader->mirror();
+        bRestRangeRequest = pDownloader->rangeRequest();
+        if (!bSuccess && (pDownloader->endPoint() < 0 || pDownloader->remaining() > 0))
         {
-            return;
+            segRest = Segment(pDownloader->currentPoint(), pDownloader->endPoint());
+            bHasRest = true;
         }
+        releaseChannel(iter);
+    }
 
-        clearDownloaders();
-
-        //将文件分成n段，用异步的方式下载
-        for (int i = 0; i < m_nThreadCount; i++)
+    //镜像出错：丢弃该镜像，未下载的部分交给其他镜像
+    if (!bSuccess && dropMirror(nMirror, strErr))
+    {
+        bSuccess = true;
+        if (bHasRest)
         {
-            qint64 start = 0;
-            qint64 end = -1;
-            if (m_nThreadCount > 1 && m_nFileSize > 0)
-            {
-                //先算出每段的开头和结尾（HTTP协议所需要的信息）
-                start = m_nFileSize * i / m_nThreadCount;
-                end = m_nFileSize * (i + 1) / m_nThreadCount;
-                if (i == m_nThreadCount - 1)
-                {
-                    end--;
-                }
-            }
-
-            //分段下载该文件
-            std::unique_ptr<Downloader> downloader;
-#if _MSC_VER >= 1700
-            downloader = std::make_unique<Downloader>(i, this);
-#else
-            downloader.reset(new Downloader(i, this));
-#endif
-            connect(downloader.get(), SIGNAL(downloadFinished(int, bool, const QString&)),
-                this, SLOT(onSubPartFinished(int, bool, const QString&)));
-            connect(downloader.get(), SIGNAL(downloadProgress(int, qint64, qint64)),
-                this, SLOT(onSubPartDownloadProgress(int, qint64, qint64)));
-            if (downloader->startDownload(m_request.url, m_strDstFilePath, m_pNetworkManager,
-                start, end, m_request.bShowProgress))
+            if (m_bProbing)
             {
-                m_mapDownloader[i] = std::move(downloader);
-                m_mapBytes.insert(i, ProgressData());
+                //还未获取到文件大小，在其他镜像上重新请求
+                bSuccess = startSegment(segRest.start, segRest.end, bRestRangeRequest);
             }
             else
             {
-                abort();
-                m_strError = QStringLiteral("Subpart %1 startDownload() failed!").arg(i);
-                LOG_ERROR(m_strError.toStdWString());
-                emit requestFinished(false, QByteArray(), m_strError);
-                return;
+                m_listPendingSegment.prepend(segRest);
             }
         }
     }
-    else
-    {
-        emit requestFinished(false, QByteArray(), m_strError);
-    }
-}
 
-void NetworkMTDownloadRequest::onSubPartFinished(int index, bool bSuccess, const QString& strErr)
-{
-    if (m_bAbortManual)
+    //所有通道结束并且没有未分配的数据段，等待数据写入文件
+    const bool bAllFinished = bSuccess && m_mapDownloader.empty() && m_listPendingSegment.isEmpty();
+    if (bAllFinished && !(closeLocalFile(false) && verifyChecksum()
+        && unmapLocalFile(m_request.eDurability != eDurabilityNone) && commitLocalFile()))
     {
-        return;
+        bSuccess = false;
     }
 
-    if (bSuccess)
-    {
-        m_nSuccess++;
-    }
-    else
+    //有一段失败，说明下载失败
+    if (!bSuccess || !fillChannels())
     {
-        m_nFailed++;
-        if (m_nFailed == 1)
-        {
-            abort();
-        }
+        m_bFailed = true;
+        NetworkFileInfoCache::remove(m_request.url);
         if (m_strError.isEmpty())
         {
             m_strError = strErr;
         }
+        updateResult();
+        abort();
+        if (!m_strWriteFilePath.isEmpty())
+        {
+            QFile::remove(m_strWriteFilePath);
+        }
+        m_bytesContent.clear();
+
+        emit requestFinished(false, QByteArray(), m_strError);
+        LOG_INFO("MT download finished. [result] " << false);
+        qDebug() << "[QMultiThreadNetwork] MT download finished. [result]" << false;
+        return;
     }
 
-    //如果完成数等于文件段数，则说明文件下载成功；失败数大于0，说明下载失败
-    if (m_nSuccess == m_nThreadCount || m_nFailed == 1)
+    //文件下载成功
+    if (bAllFinished)
     {
-        emit requestFinished((m_nFailed == 0), QByteArray(), m_strError);
-        LOG_INFO("MT download finished. [result] " << (m_nFailed == 0));
-        qDebug() << "[QMultiThreadNetwork] MT download finished. [result]" << (m_nFailed == 0);
+        m_pSampleTimer->stop();
+        updateResult();
+
+        //文件大小未知时缓冲区按下载的内容增长，多分配的部分去掉
+        QByteArray bytesContent;
+        if (m_bMemoryMode)
+        {
+            if (m_nFileSize <= 0)
+            {
+                m_bytesContent.resize((int)bytesReceived());
+            }
+            bytesContent.swap(m_bytesContent);
+        }
+        emit requestFinished(true, bytesContent, m_strError);
+        LOG_INFO("MT download finished. [result] " << true);
+        qDebug() << "[QMultiThreadNetwork] MT download finished. [result]" << true;
     }
 }
 
 void NetworkMTDownloadRequest::onSubPartDownloadProgress(int index, qint64 bytesReceived, qint64 bytesTotal)
 {
+    Q_UNUSED(index);
     if (m_bAbortManual || bytesReceived <= 0 || bytesTotal <= 0)
         return;
 
-    if (m_mapBytes.contains(index))
+    const qint64 bytesRev = this->bytesReceived();
+    if (m_bytesTotal > 0 && bytesRev > 0)
     {
-        //qDebug() << "Part:" << index << " progress:" << bytesReceived << "/" << bytesTotal;
-
-        qint64 bytesRevIncreased = 0;//本次接收增加的字节数
-        qint64 bytesTotalIncreased = 0;//本次总增加的字节数
-
-        qint64 bytesRev = m_mapBytes.value(index).bytesReceived;
-        if (bytesReceived > bytesRev)
-        {
-            bytesRevIncreased = bytesReceived - bytesRev;
-            m_bytesReceived += bytesRevIncreased;
-        }
-        m_mapBytes[index].bytesReceived = bytesReceived;
-
-        if (m_nThreadCount <= 1 || m_nFileSize <= 0)
-        {
-            qint64 bytesTo = m_mapBytes.value(index).bytesTotal;
-            if (bytesTotal > bytesTo)
-            {
-                bytesTotalIncreased = bytesTotal - bytesTo;
-                m_bytesTotal += bytesTotalIncreased;
-            }
-            m_mapBytes[index].bytesTotal = bytesTotal;
-        }
-
-        if (m_bytesTotal > 0 && m_bytesReceived > 0)
+        if (NetworkManager::isInstantiated())
         {
-            if (NetworkManager::isInstantiated())
-            {
-                NetworkProgressEvent *event = new NetworkProgressEvent;
-                event->uiId = m_request.uiId;
-                event->uiBatchId = m_request.uiBatchId;
-                event->iBtyes = m_bytesReceived;
-                event->iTotalBtyes = m_bytesTotal;
-                QCoreApplication::postEvent(NetworkManager::globalInstance(), event);
-            }
+            NetworkProgressEvent *event = new NetworkProgressEvent;
+            event->uiId = m_request.uiId;
+            event->uiBatchId = m_request.uiBatchId;
+            event->iBtyes = bytesRev;
+            event->iTotalBtyes = m_bytesTotal;
+            QCoreApplication::postEvent(NetworkManager::globalInstance(), event);
         }
     }
 }
@@ -403,12 +1274,13 @@ void NetworkMTDownloadRequest::onFinished()
     }
     if (!bSuccess)
     {
-        if (statusCode == 301 || statusCode == 302)
-        {//301,302重定向
+        if (isRedirectStatus(statusCode))
+        {//301,302,307,308重定向
             const QVariant& redirectionTarget = m_pNetworkReply->attribute(QNetworkRequest::RedirectionTargetAttribute);
             if (!redirectionTarget.isNull())
             {
                 const QUrl& redirectUrl = m_url.resolved(redirectionTarget.toUrl());
+                NetworkRedirectCache::insert(m_pNetworkReply->url(), redirectUrl, statusCode);
                 if (m_url != redirectUrl && m_redirectUrl != redirectUrl)
                 {
                     m_redirectUrl = redirectUrl;
@@ -450,6 +1322,17 @@ void NetworkMTDownloadRequest::onFinished()
         QVariant var = m_pNetworkReply->header(QNetworkRequest::ContentLengthHeader);
         m_nFileSize = var.toLongLong();
         m_bytesTotal = m_nFileSize;
+
+        if (m_nFileSize > 0)
+        {
+            RemoteFileInfo info;
+            info.nFileSize = m_nFileSize;
+            info.bAcceptRanges = m_pNetworkReply->rawHeader("Accept-Ranges").contains("bytes");
+            info.bytesETag = m_pNetworkReply->rawHeader("ETag");
+            NetworkFileInfoCache::insert(m_request.url, info);
+            m_bAcceptRanges = info.bAcceptRanges;
+            m_bytesETag = info.bytesETag;
+        }
         LOG_INFO("MT File size: " << m_nFileSize);
         qDebug() << "[QMultiThreadNetwork] MT File size:" << m_nFileSize;
 
@@ -489,9 +1372,8 @@ void NetworkMTDownloadRequest::clearDownloaders()
 
 void NetworkMTDownloadRequest::clearProgress()
 {
-    m_mapBytes.clear();
     m_bytesTotal = 0;
-    m_bytesReceived = 0;
+    m_bytesFinished = 0;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -501,10 +1383,21 @@ Downloader::Downloader(int index, QObject *parent)
     , m_pNetworkManager(nullptr)
     , m_pNetworkReply(nullptr)
     , m_bAbortManual(false)
+    , m_bMetaDataReceived(false)
+    , m_bRangeRequest(true)
+    , m_nMirror(-1)
+    , m_iTraceStartUs(0)
     , m_bShowProgress(false)
     , m_nStartPoint(0)
     , m_nEndPoint(0)
-    , m_hFile(0)
+    , m_nCurrentPoint(0)
+    , m_uiWriterId(0)
+    , m_pMemory(nullptr)
+    , m_pMapped(nullptr)
+    , m_nMappedSize(0)
+    , m_iReadBufferSize(0)
+    , m_bCrc32c(false)
+    , m_uiCrc32c(0)
 {
     TRACE_CLASS_CONSTRUCTOR(Downloader);
 }
@@ -520,18 +1413,38 @@ void Downloader::abort()
     if (m_pNetworkReply)
     {
         m_bAbortManual = true;
+        //abort()会同步触发finished()，先断开连接
+        m_pNetworkReply->disconnect(this);
         m_pNetworkReply->abort();
         m_pNetworkReply->deleteLater();
         m_pNetworkReply = nullptr;
         m_pNetworkManager = nullptr;
-        if (m_hFile)
-        {
-            CloseHandle(m_hFile);
-            m_hFile = nullptr;
-        }
     }
 }
 
+bool Downloader::shrinkEndPoint(qint64 endPoint)
+{
+    if (endPoint < m_nCurrentPoint || (m_nEndPoint >= 0 && endPoint > m_nEndPoint))
+    {
+        return false;
+    }
+    m_nEndPoint = endPoint;
+    return true;
+}
+
+void Downloader::finishRange()
+{
+    LOG_INFO("Part " << m_nIndex << " download range finished");
+    qDebug() << "[QMultiThreadNetwork] Part" << m_nIndex << "download range finished";
+
+    m_pNetworkReply->disconnect(this);
+    m_pNetworkReply->abort();
+    m_pNetworkReply->deleteLater();
+    m_pNetworkReply = nullptr;
+
+    emit downloadFinished(m_nIndex, true, m_strError);
+}
+
 bool Downloader::startDownload(const QUrl &url,
     const QString& strDstFile,
     QNetworkAccessManager* pNetworkManager,
@@ -539,62 +1452,47 @@ bool Downloader::startDownload(const QUrl &url,
     qint64 endPoint,
     bool bShowProgress)
 {
-    if (nullptr == pNetworkManager || !url.isValid() || strDstFile.isEmpty())
+    if (nullptr == pNetworkManager || !url.isValid() || (0 == m_uiWriterId && nullptr == m_pMemory))
         return false;
 
     m_bAbortManual = false;
+    m_bMetaDataReceived = false;
 
     m_url = url;
     m_pNetworkManager = QPointer<QNetworkAccessManager>(pNetworkManager);
     m_nStartPoint = startPoint;
     m_nEndPoint = endPoint;
+    m_nCurrentPoint = startPoint;
     m_bShowProgress = bShowProgress;
-
-    m_strDstFilePath = strDstFile;
-#ifdef WIN32
-    m_hFile = CreateFileW(strDstFile.toStdWString().c_str(), GENERIC_WRITE,
-        FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (m_hFile != nullptr && m_hFile != INVALID_HANDLE_VALUE)
-    {
-        LARGE_INTEGER li = { 0 };
-        li.HighPart = (long)(startPoint << 32);
-        li.LowPart = (DWORD)startPoint;
-        if (!SetFilePointerEx(m_hFile, li, nullptr, FILE_BEGIN))
-        {
-            LOG_ERROR("SetFilePointerEx error:" << GetLastError());
-            qCritical() << "[QMultiThreadNetwork] SetFilePointerEx error:" << GetLastError();
-            return false;
-        }
-    }
-    else
+    m_uiCrc32c = 0;
+    m_elapsed.start();
+    if (0 == m_iTraceStartUs && NetworkTracer::isEnabled())
     {
-        LOG_ERROR("CreateFileW error:" << GetLastError());
-        qCritical() << "[QMultiThreadNetwork] CreateFileW error:" << GetLastError();
-        return false;
+        m_iTraceStartUs = networkTimestampUs();
     }
-#else
-    return false;
-#endif
+
+    m_strDstFilePath = strDstFile;
 
     //根据HTTP协议，写入RANGE头部，说明请求文件的范围
-    QNetworkRequest request;
+    QNetworkRequest request(m_requestPrototype);
     request.setUrl(url);
+    NetworkRequestTemplate::applySharedState(request);
     QString range;
-    range.sprintf("Bytes=%lld-%lld", m_nStartPoint, m_nEndPoint);
-    request.setRawHeader("Range", range.toLocal8Bit());
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
-    request.setRawHeader("Accept-Encoding", "gzip");
-
-#ifndef QT_NO_SSL
-    if (isHttpsProxy(url.scheme()))
+    if (m_bRangeRequest)
     {
-        // 发送https请求前准备工作;
-        QSslConfiguration conf = request.sslConfiguration();
-        conf.setPeerVerifyMode(QSslSocket::VerifyNone);
-        conf.setProtocol(QSsl::TlsV1SslV3);
-        request.setSslConfiguration(conf);
+        if (m_nEndPoint >= 0)
+        {
+            range.sprintf("Bytes=%lld-%lld", m_nStartPoint, m_nEndPoint);
+        }
+        else
+        {
+            range.sprintf("Bytes=%lld-", m_nStartPoint);
+        }
+        request.setRawHeader("Range", range.toLocal8Bit());
+        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
     }
-#endif
+    //各通道按字节位置写入，必须是未压缩的内容(压缩后Range的位置是压缩数据的位置)
+    request.setRawHeader("Accept-Encoding", "identity");
 
     LOG_INFO("Part " << m_nIndex << " start, Range: " << range.toStdString());
     qDebug() << "[QMultiThreadNetwork] Part" << m_nIndex << "start, Range:" << range;
@@ -602,48 +1500,190 @@ bool Downloader::startDownload(const QUrl &url,
     m_pNetworkReply = m_pNetworkManager->get(request);
     if (m_pNetworkReply)
     {
+        m_pNetworkReply->setReadBufferSize(m_iReadBufferSize);
         connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onFinished()));
         connect(m_pNetworkReply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(m_pNetworkReply, SIGNAL(metaDataChanged()), this, SLOT(onMetaDataChanged()));
         connect(m_pNetworkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
-        if (bShowProgress)
+    }
+    return true;
+}
+
+void Downloader::onMetaDataChanged()
+{
+    if (nullptr == m_pNetworkReply || m_bMetaDataReceived)
+    {
+        return;
+    }
+    const int statusCode = m_pNetworkReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (statusCode < 200 || statusCode >= 300)
+    {
+        return;
+    }
+    m_bMetaDataReceived = true;
+    m_bytesETag = m_pNetworkReply->rawHeader("ETag");
+
+    //206: Content-Range: bytes 0-1023/4096
+    qint64 fileSize = -1;
+    bool bRangeSupported = false;
+    const QByteArray& contentRange = m_pNetworkReply->rawHeader("Content-Range");
+    if (statusCode == 206 && !contentRange.isEmpty())
+    {
+        bRangeSupported = true;
+        bool bOk = false;
+        const qint64 total = contentRange.mid(contentRange.lastIndexOf('/') + 1).trimmed().toLongLong(&bOk);
+        if (bOk)
         {
-            connect(m_pNetworkReply, &QNetworkReply::downloadProgress, this, [=](qint64 bytesReceived, qint64 bytesTotal) {
-                if (m_bAbortManual || bytesReceived < 0 || bytesTotal < 0)
-                    return;
-                emit downloadProgress(m_nIndex, bytesReceived, bytesTotal);
-            });
+            fileSize = total;
         }
     }
-    return true;
+    else
+    {
+        const QVariant& var = m_pNetworkReply->header(QNetworkRequest::ContentLengthHeader);
+        if (var.isValid())
+        {
+            fileSize = var.toLongLong();
+        }
+        //普通请求根据Accept-Ranges判断是否支持Range
+        if (!m_bRangeRequest)
+        {
+            bRangeSupported = m_pNetworkReply->rawHeader("Accept-Ranges").contains("bytes");
+        }
+    }
+
+    //服务器忽略了Range，返回的是整个文件
+    if (!bRangeSupported && m_nStartPoint > 0)
+    {
+        m_strError = QStringLiteral("Part %1: server does not support range requests").arg(m_nIndex);
+        LOG_ERROR(m_strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << m_strError;
+
+        m_pNetworkReply->disconnect(this);
+        m_pNetworkReply->abort();
+        m_pNetworkReply->deleteLater();
+        m_pNetworkReply = nullptr;
+        emit downloadFinished(m_nIndex, false, m_strError);
+        return;
+    }
+
+    emit metaDataReceived(m_nIndex, fileSize, bRangeSupported);
 }
 
 void Downloader::onReadyRead()
 {
-#ifdef WIN32
     if (m_pNetworkReply
         && m_pNetworkReply->error() == QNetworkReply::NoError
         && m_pNetworkReply->isOpen())
     {
-        if (m_hFile != nullptr)
+        //重定向等非2xx响应的内容不写入文件
+        const int statusCode = m_pNetworkReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if ((m_uiWriterId != 0 || m_pMemory != nullptr) && statusCode < 300)
         {
-            const QByteArray& bytesRev = m_pNetworkReply->readAll();
-            if (!bytesRev.isEmpty())
+            bool bReceived = false;
+            while (m_pNetworkReply->bytesAvailable() > 0)
             {
-                DWORD byteWritten = 0;
-                if (!WriteFile(m_hFile, bytesRev.data(), bytesRev.size(), &byteWritten, nullptr))
+                qint64 nSize = m_pNetworkReply->bytesAvailable();
+                if (m_nEndPoint >= 0)
                 {
-                    LOG_ERROR("WriteFile error:" << GetLastError());
-                    qCritical() << "[QMultiThreadNetwork] WriteFile error:" << GetLastError();
+                    //下载段可能被缩短，超出部分不读取
+                    nSize = qMin(nSize, m_nEndPoint - m_nCurrentPoint + 1);
                 }
-                if (byteWritten != bytesRev.size())
+                if (nSize <= 0)
                 {
-                    LOG_ERROR("mismatched bytes! receive: " << bytesRev.size() << "; write: " << byteWritten);
-                    qCritical() << "[QMultiThreadNetwork] mismatched bytes! receive:" << bytesRev.size() << "write:" << byteWritten;
+                    break;
                 }
+
+                const qint64 byteWritten = receiveData(nSize);
+                if (byteWritten < 0)
+                {
+                    m_pNetworkReply->disconnect(this);
+                    m_pNetworkReply->abort();
+                    m_pNetworkReply->deleteLater();
+                    m_pNetworkReply = nullptr;
+                    emit downloadFinished(m_nIndex, false, m_strError);
+                    return;
+                }
+                if (byteWritten == 0)
+                {
+                    break;
+                }
+                m_nCurrentPoint += byteWritten;
+                bReceived = true;
+            }
+
+            if (bReceived && m_bShowProgress)
+            {
+                emit downloadProgress(m_nIndex, bytesWritten(), (m_nEndPoint >= 0) ? (m_nEndPoint - m_nStartPoint + 1) : 0);
+            }
+
+            if (m_nEndPoint >= 0 && m_nCurrentPoint > m_nEndPoint)
+            {
+                finishRange();
             }
         }
     }
-#endif
+}
+
+qint64 Downloader::receiveData(qint64 nMaxSize)
+{
+    if (m_pMemory)
+    {
+        //直接读入缓冲区中本通道的区间，不经过中间缓冲区
+        if (m_nCurrentPoint + nMaxSize > m_pMemory->size())
+        {
+            if (m_nCurrentPoint + nMaxSize > MAX_MEMORY_DOWNLOAD_SIZE)
+            {
+                m_strError = QStringLiteral("Part %1: file is too large to download to memory").arg(m_nIndex);
+                LOG_ERROR(m_strError.toStdWString());
+                qCritical() << "[QMultiThreadNetwork]" << m_strError;
+                return -1;
+            }
+            m_pMemory->resize((int)(m_nCurrentPoint + nMaxSize));
+        }
+        const qint64 nRead = qMax<qint64>(0, m_pNetworkReply->read(m_pMemory->data() + m_nCurrentPoint, nMaxSize));
+        if (m_bCrc32c)
+        {
+            m_uiCrc32c = NetworkChecksum::crc32c(m_uiCrc32c, m_pMemory->constData() + m_nCurrentPoint, nRead);
+        }
+        return nRead;
+    }
+
+    if (m_pMapped)
+    {
+        //直接读入内存映射文件中本通道的区间
+        nMaxSize = qMin(nMaxSize, m_nMappedSize - m_nCurrentPoint);
+        if (nMaxSize <= 0)
+        {
+            m_strError = QStringLiteral("Part %1: data exceeds the mapped file size").arg(m_nIndex);
+            LOG_ERROR(m_strError.toStdWString());
+            return -1;
+        }
+        const qint64 nRead = qMax<qint64>(0, m_pNetworkReply->read((char *)m_pMapped + m_nCurrentPoint, nMaxSize));
+        if (m_bCrc32c)
+        {
+            m_uiCrc32c = NetworkChecksum::crc32c(m_uiCrc32c, (const char *)m_pMapped + m_nCurrentPoint, nRead);
+        }
+        return nRead;
+    }
+
+    //读入复用的接收缓冲区，交给写文件线程，不在网络线程中写文件
+    const QByteArray& data = NetworkBufferPool::read(m_pNetworkReply, nMaxSize);
+    if (data.isEmpty())
+    {
+        return 0;
+    }
+    if (!NetworkDiskWriter::write(m_uiWriterId, m_nCurrentPoint, data))
+    {
+        m_strError = QStringLiteral("Part %1: write file failed").arg(m_nIndex);
+        LOG_ERROR(m_strError.toStdWString());
+        qCritical() << "[QMultiThreadNetwork]" << m_strError;
+        return -1;
+    }
+    if (m_bCrc32c)
+    {
+        m_uiCrc32c = NetworkChecksum::crc32c(m_uiCrc32c, data.constData(), data.size());
+    }
+    return data.size();
 }
 
 void Downloader::onFinished()
@@ -651,6 +1691,15 @@ void Downloader::onFinished()
     try
     {
         bool bSuccess = (m_pNetworkReply->error() == QNetworkReply::NoError);
+        if (bSuccess)
+        {
+            onReadyRead();
+            if (nullptr == m_pNetworkReply)
+            {
+                //已在onReadyRead()中结束
+                return;
+            }
+        }
         int statusCode = m_pNetworkReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
         if (isHttpProxy(m_url.scheme()) || isHttpsProxy(m_url.scheme()))
         {
@@ -658,29 +1707,27 @@ void Downloader::onFinished()
         }
         if (!bSuccess)
         {
-            if (statusCode == 301 || statusCode == 302)
-            {//301,302重定向
+            if (isRedirectStatus(statusCode))
+            {//301,302,307,308重定向
                 const QVariant& redirectionTarget = m_pNetworkReply->attribute(QNetworkRequest::RedirectionTargetAttribute);
                 if (!redirectionTarget.isNull())
                 {//如果网址跳转重新请求
                     const QUrl& redirectUrl = m_url.resolved(redirectionTarget.toUrl());
+                    NetworkRedirectCache::insert(m_pNetworkReply->url(), redirectUrl, statusCode);
                     if (redirectUrl.isValid() && redirectUrl != m_url)
                     {
                         LOG_INFO("url: " << m_url.toString().toStdWString() << "; redirectUrl:" << redirectUrl.toString().toStdWString());
                         qDebug() << "[QMultiThreadNetwork] url:" << m_url.toString() << "redirectUrl:" << redirectUrl.toString();
 
+                        m_pNetworkReply->disconnect(this);
                         m_pNetworkReply->abort();
                         m_pNetworkReply->deleteLater();
                         m_pNetworkReply = nullptr;
-#ifdef WIN32
-                        if (m_hFile)
+                        if (!startDownload(redirectUrl, m_strDstFilePath, m_pNetworkManager.data(),
+                            m_nCurrentPoint, m_nEndPoint, m_bShowProgress))
                         {
-                            CloseHandle(m_hFile);
-                            m_hFile = nullptr;
+                            emit downloadFinished(m_nIndex, false, QStringLiteral("Part %1 redirect failed").arg(m_nIndex));
                         }
-#endif
-                        startDownload(redirectUrl, m_strDstFilePath, m_pNetworkManager.data(),
-                            m_nStartPoint, m_nEndPoint, m_bShowProgress);
                         return;
                     }
                 }
@@ -690,14 +1737,10 @@ void Downloader::onFinished()
                 //qDebug() << "HttpStatusCode: " << statusCode;
             }
         }
-        else
+        else if (m_nEndPoint >= 0 && m_nCurrentPoint <= m_nEndPoint)
         {
-#ifdef WIN32
-            if (m_hFile)
-            {
-                FlushFileBuffers(m_hFile);
-            }
-#endif
+            bSuccess = false;
+            m_strError = QStringLiteral("Part %1 incomplete: %2 bytes left").arg(m_nIndex).arg(remaining());
         }
 
         LOG_INFO("Part " << m_nIndex << " download " << bSuccess);
@@ -705,14 +1748,12 @@ void Downloader::onFinished()
 
         m_pNetworkReply->deleteLater();
         m_pNetworkReply = nullptr;
-#ifdef WIN32
-        if (m_hFile)
+
+        if (m_iTraceStartUs > 0)
         {
-            CloseHandle(m_hFile);
-            m_hFile = nullptr;
+            NetworkTracer::addSpan("segment", "download", m_iTraceStartUs, networkTimestampUs(), true);
+            m_iTraceStartUs = 0;
         }
-#endif
-
         emit downloadFinished(m_nIndex, bSuccess, m_strError);
     }
     catch (std::exception* e)
@@ -4,9 +4,12 @@
 #include <QObject>
 #include <QPointer>
 #include <QMutex>
+#include <QVector>
+#include <QElapsedTimer>
 #include "networkrequest.h"
 
 class QFile;
+class QTimer;
 class Downloader;
 
 //多线程下载请求(这里的线程是指下载的通道。一个文件被分成多个部分，由多个下载通道同时下载)
@@ -24,39 +27,129 @@ public Q_SLOTS:
     void onFinished() Q_DECL_OVERRIDE;
     void onSubPartFinished(int index, bool bSuccess, const QString& strErr);
     void onSubPartDownloadProgress(int index, qint64 bytesReceived, qint64 bytesTotal);
+    void onSubPartMetaData(int index, qint64 fileSize, bool bRangeSupported);
+    void onSampleTimeout();
+    void onFlushTimeout();
 
 private:
     bool requestFileSize(QUrl url);
     //根据文件名创建本地文件
     bool createLocalFile();
+    //下载到内存：按文件大小分配缓冲区
+    bool allocateBuffer();
+    //关闭NetworkDiskWriter的文件. bDiscard: 丢弃还未写入的数据
+    bool closeLocalFile(bool bDiscard);
+    //bAtomicCommit：下载成功后把临时文件改名为目标文件
+    bool commitLocalFile();
+    //内存映射文件(RequestTask::bMemoryMappedFile)：扩展文件到m_nFileSize并映射，失败时仍使用NetworkDiskWriter
+    void mapLocalFile();
+    bool unmapLocalFile(bool bFlush);
+    //检查下载内容的大小和摘要(RequestTask::eHashAlgorithm)
+    bool verifyChecksum();
     bool fileAccessible(QFile *pFile) const;
     bool removeFile(QFile *file);
     void startMTDownload();
+    //不请求文件大小，第一个通道直接下载整个文件
+    void startProbeDownload();
+    //第一个通道获取到文件大小后，把剩余部分分给其他通道
+    bool splitProbeSegment(Downloader *pProbe);
+    void startAutoSample();
+    void resetChannels();
+    //启动一个下载通道，下载[start, end]段
+    bool startSegment(qint64 start, qint64 end, bool bRangeRequest = true);
+    //补足下载通道：优先下载未分配的数据段，否则从剩余最多的通道中分出一半
+    bool fillChannels();
+    bool splitLargestSegment(qint64& start, qint64& end);
+    //结束一个下载通道，统计其下载字节数，返回下一个通道
+    std::map<int, std::unique_ptr<Downloader>>::iterator releaseChannel(std::map<int, std::unique_ptr<Downloader>>::iterator iter);
+    //选择新通道使用的镜像：按各镜像的速度分配通道
+    int chooseMirror() const;
+    //单个通道在该镜像上的下载速度(字节/秒)，0表示还没有测得
+    double mirrorRate(int nMirror) const;
+    //丢弃出错的镜像，该镜像上的通道未下载的部分退回. 没有其他可用的镜像时返回false
+    bool dropMirror(int nMirror, const QString& strReason);
+    //自动模式：增加/减少一个下载通道
+    bool addChannel();
+    void removeChannel();
+    void finishAutoProbe();
+    qint64 bytesReceived() const;
+    void updateResult();
     void clearDownloaders();
     void clearProgress();
 
 private:
     QUrl m_url;
     QString m_strDstFilePath;
+    //实际写入的文件(bAtomicCommit时为临时文件)
+    QString m_strWriteFilePath;
     qint64 m_nFileSize;
 
     std::map<int, std::unique_ptr<Downloader>> m_mapDownloader;
-    int m_nThreadCount;//分割成多少段下载
-    int m_nSuccess;
-    int m_nFailed;
+    int m_nThreadCount;//同时下载的通道数
+    int m_nNextIndex;
+    bool m_bFailed;
+    //第一个通道正在获取文件大小
+    bool m_bProbing;
+    //智能下载模式(eTypeDownload)
+    bool m_bSmartMode;
+    //HEAD响应中声明了Accept-Ranges: bytes
+    bool m_bAcceptRanges;
+    //下载到内存(RequestTask::bDownloadToMemory)
+    bool m_bMemoryMode;
+    QByteArray m_bytesContent;
+    //NetworkDiskWriter的文件id，各下载通道共用
+    quint64 m_uiWriterId;
+    //内存映射文件
+    std::unique_ptr<QFile> m_pMapFile;
+    uchar *m_pMappedData;
+    QTimer *m_pFlushTimer;
+
+    //已结束通道下载的数据段的CRC32C，全部结束后按位置合并
+    struct SegmentCrc
+    {
+        qint64 start;
+        qint64 length;
+        quint32 crc;
+    };
+    QList<SegmentCrc> m_listSegmentCrc;
+
+    struct Segment
+    {
+        qint64 start;
+        qint64 end;
+        Segment(qint64 s = 0, qint64 e = -1) : start(s), end(e) {}
+    };
+    //未分配通道的数据段（减少通道或丢弃镜像时退回的数据段）
+    QList<Segment> m_listPendingSegment;
 
-    struct ProgressData
+    //下载地址：第一个是RequestTask::url，之后是RequestTask::listMirrorUrl
+    struct Mirror
     {
-        qint64 bytesReceived;
-        qint64 bytesTotal;
-        ProgressData() : bytesReceived(0), bytesTotal(0) {}
+        QUrl url;
+        bool bAvailable;
+        //已结束通道的下载字节数和下载时长(ms)
+        qint64 bytes;
+        qint64 msElapsed;
+        Mirror(const QUrl& u = QUrl()) : url(u), bAvailable(true), bytes(0), msElapsed(0) {}
     };
+    QVector<Mirror> m_vecMirror;
+    //用于检查各镜像的文件是否一致
+    QByteArray m_bytesETag;
 
-    QMap<int, ProgressData> m_mapBytes;
+    //已结束通道的下载字节数
+    qint64 m_bytesFinished;
     qint64 m_bytesTotal;
-    qint64 m_bytesReceived;
-};
 
+    //自动选择通道数
+    QTimer *m_pSampleTimer;
+    QElapsedTimer m_elapsedSample;
+    QElapsedTimer m_elapsedTotal;
+    qint64 m_bytesLastSample;
+    double m_dBaselineRate;//上一次增加通道前的总速度
+    double m_dChannelRate;
+    int m_nWarmupSamples;
+    bool m_bAutoSettled;
+};
 //用于下载文件（或文件的一部分）
 class Downloader : public QObject
 {
@@ -75,28 +168,84 @@ public:
 
     void abort();
 
+    //false: 不带Range头的普通请求，根据Accept-Ranges判断是否支持分段
+    void setRangeRequest(bool bRange) { m_bRangeRequest = bRange; }
+    bool rangeRequest() const { return m_bRangeRequest; }
+    //使用的镜像序号(NetworkMTDownloadRequest)
+    void setMirror(int nMirror) { m_nMirror = nMirror; }
+    int mirror() const { return m_nMirror; }
+    //写入内存而不是文件，在startDownload()之前设置. 文件大小未知时缓冲区随下载的内容增长
+    void setMemoryBuffer(QByteArray *pBuffer) { m_pMemory = pBuffer; }
+    //写入文件(NetworkDiskWriter的文件id)，在startDownload()之前设置
+    void setFileWriter(quint64 uiWriterId) { m_uiWriterId = uiWriterId; }
+    //QNetworkReply的读缓冲区上限，0表示不限制
+    void setReadBufferSize(qint64 iSize) { m_iReadBufferSize = iSize; }
+    //请求模板和任务的header、TLS配置(url和Range由startDownload()设置)
+    void setRequestPrototype(const QNetworkRequest& request) { m_requestPrototype = request; }
+    //直接读入内存映射文件(优先于setFileWriter())，nSize为映射的大小
+    void setMappedFile(uchar *pMapped, qint64 nSize) { m_pMapped = pMapped; m_nMappedSize = nSize; }
+    //计算下载数据的CRC32C
+    void setCrc32c(bool bEnable) { m_bCrc32c = bEnable; }
+    quint32 crc32c() const { return m_uiCrc32c; }
+    qint64 startPoint() const { return m_nStartPoint; }
+
+    //下一个要写入的位置
+    qint64 currentPoint() const { return m_nCurrentPoint; }
+    qint64 endPoint() const { return m_nEndPoint; }
+    //剩余未下载的字节数（-1表示未知）
+    qint64 remaining() const { return (m_nEndPoint < 0) ? -1 : (m_nEndPoint - m_nCurrentPoint + 1); }
+    //缩短下载段，下载到新的结束位置后提前结束请求
+    bool shrinkEndPoint(qint64 endPoint);
+    qint64 bytesWritten() const { return m_nCurrentPoint - m_nStartPoint; }
+    QByteArray etag() const { return m_bytesETag; }
+    //开始下载到现在的时长(ms)
+    qint64 elapsed() const { return m_elapsed.isValid() ? m_elapsed.elapsed() : 0; }
+
 Q_SIGNALS:
     void downloadFinished(int index, bool bSuccess, const QString& strErr);
     void downloadProgress(int index, qint64 bytesReceived, qint64 bytesTotal);
+    //收到响应头. fileSize为整个文件的大小(-1表示未知)
+    void metaDataReceived(int index, qint64 fileSize, bool bRangeSupported);
 
 public Q_SLOTS:
     void onFinished();
     void onReadyRead();
+    void onMetaDataChanged();
     void onError(QNetworkReply::NetworkError code);
 
+private:
+    //分配的数据段已经下载完
+    void finishRange();
+    //读取最多nMaxSize字节写入文件或内存，返回写入的字节数(-1表示失败)
+    qint64 receiveData(qint64 nMaxSize);
+
 private:
     QPointer<QNetworkAccessManager> m_pNetworkManager;
     QNetworkReply *m_pNetworkReply;
     QUrl m_url;
-    typedef void * HANDLE;
-    HANDLE m_hFile;
+    quint64 m_uiWriterId;
+    QByteArray *m_pMemory;
+    uchar *m_pMapped;
+    qint64 m_nMappedSize;
+    qint64 m_iReadBufferSize;
+    QNetworkRequest m_requestPrototype;
+    bool m_bCrc32c;
+    quint32 m_uiCrc32c;
     QString m_strDstFilePath;
     bool m_bAbortManual;
     QString m_strError;
+    QByteArray m_bytesETag;
+    bool m_bMetaDataReceived;
+    bool m_bRangeRequest;
+    int m_nMirror;
+    QElapsedTimer m_elapsed;
+    //NetworkTracer: 分段开始的时间(重定向后继续计时)
+    qint64 m_iTraceStartUs;
 
     const int m_nIndex;
     qint64 m_nStartPoint;
     qint64 m_nEndPoint;
+    qint64 m_nCurrentPoint;
     bool m_bShowProgress;
 };
 
@@ -0,0 +1,316 @@
+﻿#include "networkmtuploadrequest.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QUrlQuery>
+#include <QUuid>
+#include <QCoreApplication>
+#include <QNetworkAccessManager>
+#include "Log4cplusWrapper.h"
+#include "networkmanager.h"
+#include "networkfilerangedevice.h"
+
+#define MAX_UPLOAD_THREAD_COUNT 6
+// 每块的最小长度
+#define MIN_UPLOAD_PART_SIZE (64 * 1024)
+
+
+NetworkMTUploadRequest::NetworkMTUploadRequest(QObject *parent /* = nullptr */)
+    : NetworkRequest(parent)
+    , m_iFileSize(0)
+    , m_nThreadCount(0)
+    , m_nFinishedPart(0)
+    , m_iBytesFinished(0)
+    , m_bFailed(false)
+{
+}
+
+NetworkMTUploadRequest::~NetworkMTUploadRequest()
+{
+    abortParts();
+}
+
+void NetworkMTUploadRequest::abort()
+{
+    __super::abort();
+    abortParts();
+}
+
+void NetworkMTUploadRequest::abortParts()
+{
+    //先取出，abort()会同步触发finished()
+    const QList<QNetworkReply *> listReply = m_hashPartReply.keys();
+    m_hashPartReply.clear();
+    for (QNetworkReply *pReply : listReply)
+    {
+        pReply->disconnect(this);
+        if (pReply->isRunning())
+        {
+            pReply->abort();
+        }
+        pReply->deleteLater();
+    }
+}
+
+void NetworkMTUploadRequest::start()
+{
+    __super::start();
+    m_strError.clear();
+    m_bFailed = false;
+    m_vecPart.clear();
+    m_listPendingPart.clear();
+    m_nFinishedPart = 0;
+    m_iBytesFinished = 0;
+
+    if (!isHttpProxy(m_request.url.scheme()) && !isHttpsProxy(m_request.url.scheme()))
+    {
+        fail(QStringLiteral("Error: MT upload only supports http(s) - %1").arg(m_request.url.toString()));
+        return;
+    }
+
+    m_strFilePath = m_request.strReqArg;
+    QFileInfo fileInfo(m_strFilePath);
+    if (!fileInfo.exists() || !fileInfo.isFile())
+    {
+        fail(QStringLiteral("Error: File is not exists(%1)").arg(m_strFilePath));
+        return;
+    }
+
+    //分块
+    m_iFileSize = fileInfo.size();
+    const qint64 iPartSize = qMax<qint64>(m_request.iUploadPartSize, MIN_UPLOAD_PART_SIZE);
+    qint64 offset = 0;
+    do
+    {
+        Part part;
+        part.offset = offset;
+        part.length = qMin(iPartSize, m_iFileSize - offset);
+        part.nRetry = 0;
+        part.iSent = 0;
+        m_listPendingPart.append(m_vecPart.size());
+        m_vecPart.append(part);
+        offset += part.length;
+    } while (offset < m_iFileSize);
+
+    m_strUploadId = QUuid::createUuid().toString().remove('{').remove('}');
+    m_nThreadCount = qBound(1, (int)m_request.nUploadThreadCount, MAX_UPLOAD_THREAD_COUNT);
+    m_nThreadCount = qMin(m_nThreadCount, m_vecPart.size());
+    LOG_INFO("MT upload start. [file] " << m_strFilePath.toStdWString() << " [size] " << m_iFileSize
+        << " [parts] " << m_vecPart.size() << " [connections] " << m_nThreadCount);
+    qDebug() << "[QMultiThreadNetwork] MT upload start. file:" << m_strFilePath << "size:" << m_iFileSize
+        << "parts:" << m_vecPart.size() << "connections:" << m_nThreadCount;
+
+    createNetworkManager();
+    fillChannels();
+}
+
+QUrl NetworkMTUploadRequest::partUrl(const QList<QPair<QString, QString>>& listQueryItem) const
+{
+    QUrl url = requestUrl();
+    QUrlQuery query(url);
+    query.addQueryItem(QStringLiteral("uploadid"), m_strUploadId);
+    for (const auto& item : listQueryItem)
+    {
+        query.addQueryItem(item.first, item.second);
+    }
+    url.setQuery(query);
+    return url;
+}
+
+QNetworkRequest NetworkMTUploadRequest::createRequest(const QUrl& url) const
+{
+    return createNetworkRequest(url);
+}
+
+bool NetworkMTUploadRequest::fillChannels()
+{
+    while (!m_bFailed && m_hashPartReply.size() < m_nThreadCount && !m_listPendingPart.isEmpty())
+    {
+        if (!startPart(m_listPendingPart.takeFirst()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NetworkMTUploadRequest::startPart(int nPart)
+{
+    Part& part = m_vecPart[nPart];
+    part.iSent = 0;
+
+    //每块从文件中分段读取，不读入内存
+    NetworkFileRangeDevice *pDevice = new NetworkFileRangeDevice(m_strFilePath, part.offset, part.length);
+    if (!pDevice->open(QIODevice::ReadOnly))
+    {
+        fail(QStringLiteral("Error: open part %1 of file(%2) - %3").arg(nPart).arg(m_strFilePath).arg(pDevice->errorString()));
+        delete pDevice;
+        return false;
+    }
+
+    QList<QPair<QString, QString>> listQueryItem;
+    listQueryItem << qMakePair(QStringLiteral("part"), QString::number(nPart))
+        << qMakePair(QStringLiteral("parts"), QString::number(m_vecPart.size()));
+    QNetworkRequest request = createRequest(partUrl(listQueryItem));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    request.setHeader(QNetworkRequest::ContentLengthHeader, part.length);
+    if (part.length > 0)
+    {
+        const QString& strRange = QStringLiteral("bytes %1-%2/%3").arg(part.offset).arg(part.offset + part.length - 1).arg(m_iFileSize);
+        request.setRawHeader("Content-Range", strRange.toLatin1());
+    }
+
+    QNetworkReply *pReply = m_request.bUploadUsePut ? m_pNetworkManager->put(request, pDevice)
+        : m_pNetworkManager->post(request, pDevice);
+    pDevice->setParent(pReply);
+    m_hashPartReply.insert(pReply, nPart);
+
+    connect(pReply, SIGNAL(finished()), this, SLOT(onPartFinished()));
+    if (m_request.bShowProgress)
+    {
+        connect(pReply, SIGNAL(uploadProgress(qint64, qint64)), this, SLOT(onPartUploadProgress(qint64, qint64)));
+    }
+    return true;
+}
+
+void NetworkMTUploadRequest::onPartFinished()
+{
+    QNetworkReply *pReply = qobject_cast<QNetworkReply *>(sender());
+    if (nullptr == pReply || !m_hashPartReply.contains(pReply))
+    {
+        return;
+    }
+    const int nPart = m_hashPartReply.take(pReply);
+    pReply->deleteLater();
+    if (m_bFailed || m_bAbortManual)
+    {
+        return;
+    }
+
+    Part& part = m_vecPart[nPart];
+    const int statusCode = pReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const bool bSuccess = (pReply->error() == QNetworkReply::NoError && statusCode >= 200 && statusCode < 300);
+    if (bSuccess)
+    {
+        part.iSent = 0;
+        m_iBytesFinished += part.length;
+        m_nFinishedPart++;
+    }
+    else
+    {
+        const QString& strError = QStringLiteral("Part %1 upload failed. HttpStatusCode: %2, %3")
+            .arg(nPart).arg(statusCode).arg(pReply->errorString());
+        LOG_ERROR(strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << strError;
+
+        //只重传这一块
+        if (part.nRetry >= m_request.nUploadPartRetry)
+        {
+            fail(strError);
+            return;
+        }
+        part.nRetry++;
+        part.iSent = 0;
+        m_listPendingPart.prepend(nPart);
+    }
+
+    if (m_nFinishedPart == m_vecPart.size())
+    {
+        startCommit();
+        return;
+    }
+    fillChannels();
+}
+
+void NetworkMTUploadRequest::startCommit()
+{
+    LOG_INFO("MT upload parts finished, commit. [uploadid] " << m_strUploadId.toStdWString());
+    qDebug() << "[QMultiThreadNetwork] MT upload parts finished, commit. uploadid:" << m_strUploadId;
+
+    QList<QPair<QString, QString>> listQueryItem;
+    listQueryItem << qMakePair(QStringLiteral("commit"), QStringLiteral("1"))
+        << qMakePair(QStringLiteral("parts"), QString::number(m_vecPart.size()))
+        << qMakePair(QStringLiteral("size"), QString::number(m_iFileSize));
+    QNetworkRequest request = createRequest(partUrl(listQueryItem));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    request.setHeader(QNetworkRequest::ContentLengthHeader, 0);
+
+    m_pNetworkReply = m_pNetworkManager->post(request, QByteArray());
+    connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onFinished()));
+    connect(m_pNetworkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
+}
+
+void NetworkMTUploadRequest::onFinished()
+{
+    bool bSuccess = (m_pNetworkReply->error() == QNetworkReply::NoError);
+    const int statusCode = m_pNetworkReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bSuccess = bSuccess && (statusCode >= 200 && statusCode < 300);
+    if (!bSuccess && statusCode != 0)
+    {
+        LOG_INFO("HttpStatusCode: " << statusCode);
+        qDebug() << "[QMultiThreadNetwork] HttpStatusCode: " << statusCode;
+    }
+
+    QByteArray bytes;
+    if (!m_bAbortManual)//非调用abort()结束
+    {
+        if (m_pNetworkReply->isOpen())
+        {
+            if (bSuccess)
+            {
+                bytes = m_pNetworkReply->readAll();
+            }
+            else
+            {
+                m_strError.append(QString::fromUtf8(m_pNetworkReply->readAll()));
+            }
+        }
+    }
+    LOG_INFO("MT upload finished. [result] " << bSuccess);
+    emit requestFinished(bSuccess, bytes, m_strError);
+
+    m_pNetworkReply->deleteLater();
+    m_pNetworkReply = nullptr;
+}
+
+void NetworkMTUploadRequest::fail(const QString& strError)
+{
+    m_bFailed = true;
+    m_strError = strError;
+    LOG_ERROR(m_strError.toStdWString());
+    qDebug() << "[QMultiThreadNetwork]" << m_strError;
+    abortParts();
+    emit requestFinished(false, QByteArray(), m_strError);
+}
+
+void NetworkMTUploadRequest::onPartUploadProgress(qint64 iSent, qint64 iTotal)
+{
+    Q_UNUSED(iTotal);
+    QNetworkReply *pReply = qobject_cast<QNetworkReply *>(sender());
+    if (m_bAbortManual || nullptr == pReply || !m_hashPartReply.contains(pReply))
+    {
+        return;
+    }
+    m_vecPart[m_hashPartReply.value(pReply)].iSent = iSent;
+    postProgress();
+}
+
+void NetworkMTUploadRequest::postProgress()
+{
+    if (!NetworkManager::isInstantiated() || m_iFileSize <= 0)
+    {
+        return;
+    }
+
+    qint64 iSent = m_iBytesFinished;
+    for (int nPart : m_hashPartReply)
+    {
+        iSent += m_vecPart[nPart].iSent;
+    }
+    NetworkProgressEvent *event = new NetworkProgressEvent;
+    event->bDownload = false;
+    event->uiId = m_request.uiId;
+    event->uiBatchId = m_request.uiBatchId;
+    event->iBtyes = iSent;
+    event->iTotalBtyes = m_iFileSize;
+    QCoreApplication::postEvent(NetworkManager::globalInstance(), event);
+}
@@ -0,0 +1,65 @@
+﻿#ifndef NETWORKMTUPLOADREQUEST_H
+#define NETWORKMTUPLOADREQUEST_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include "networkrequest.h"
+
+//分块上传请求
+//文件分成多块，由多个连接同时上传，出错的块单独重试；全部上传后发送提交请求，由服务器合并
+class NetworkMTUploadRequest : public NetworkRequest
+{
+    Q_OBJECT;
+
+public:
+    explicit NetworkMTUploadRequest(QObject *parent = 0);
+    ~NetworkMTUploadRequest();
+
+public Q_SLOTS:
+    void start() Q_DECL_OVERRIDE;
+    void abort() Q_DECL_OVERRIDE;
+    //提交请求结束
+    void onFinished() Q_DECL_OVERRIDE;
+    void onPartFinished();
+    void onPartUploadProgress(qint64 iSent, qint64 iTotal);
+
+private:
+    //补足上传连接
+    bool fillChannels();
+    //上传第nPart块
+    bool startPart(int nPart);
+    void startCommit();
+    //url附加分块上传的参数
+    QUrl partUrl(const QList<QPair<QString, QString>>& listQueryItem) const;
+    QNetworkRequest createRequest(const QUrl& url) const;
+    void abortParts();
+    void fail(const QString& strError);
+    void postProgress();
+
+private:
+    struct Part
+    {
+        qint64 offset;
+        qint64 length;
+        //已重试的次数
+        int nRetry;
+        //当前连接已发送的字节数
+        qint64 iSent;
+    };
+    QString m_strFilePath;
+    qint64 m_iFileSize;
+    QString m_strUploadId;
+    QVector<Part> m_vecPart;
+    //等待上传的块
+    QList<int> m_listPendingPart;
+    //正在上传的块 (reply <---> 块序号)
+    QHash<QNetworkReply *, int> m_hashPartReply;
+    int m_nThreadCount;
+    int m_nFinishedPart;
+    qint64 m_iBytesFinished;
+    bool m_bFailed;
+};
+
+#endif // NETWORKMTUPLOADREQUEST_H
@@ -0,0 +1,149 @@
+﻿#include "networkredirectcache.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDateTime>
+
+//最多缓存的重定向数
+#define REDIRECT_CACHE_SIZE 1024
+//沿重定向链查找的最大次数(防止循环)
+#define REDIRECT_MAX_HOPS 8
+
+namespace
+{
+    struct RedirectEntry
+    {
+        QUrl redirectUrl;
+        //过期时间，0表示永久重定向
+        qint64 iExpireMSecs;
+        quint64 uiLastUse;
+    };
+
+    QMutex s_mutex;
+    QHash<QUrl, RedirectEntry> s_hashRedirect;
+    quint64 s_uiUseCounter = 0;
+    int s_iTemporaryTtl = 0;
+    RedirectCacheMetrics s_metrics;
+
+    bool isCacheable(const QUrl& url)
+    {
+        const QString& strScheme = url.scheme();
+        return (strScheme.compare(QLatin1String("http"), Qt::CaseInsensitive) == 0
+            || strScheme.compare(QLatin1String("https"), Qt::CaseInsensitive) == 0);
+    }
+
+    void evictLocked()
+    {
+        auto oldest = s_hashRedirect.begin();
+        for (auto iter = s_hashRedirect.begin(); iter != s_hashRedirect.end(); ++iter)
+        {
+            if (iter->uiLastUse < oldest->uiLastUse)
+            {
+                oldest = iter;
+            }
+        }
+        if (oldest != s_hashRedirect.end())
+        {
+            s_hashRedirect.erase(oldest);
+            ++s_metrics.uiEvictions;
+        }
+    }
+}
+
+void NetworkRedirectCache::insert(const QUrl& url, const QUrl& redirectUrl, int statusCode)
+{
+    if (!isCacheable(url) || !redirectUrl.isValid() || url == redirectUrl)
+    {
+        return;
+    }
+
+    QMutexLocker locker(&s_mutex);
+    RedirectEntry entry;
+    entry.redirectUrl = redirectUrl;
+    if (statusCode == 301 || statusCode == 308)
+    {
+        entry.iExpireMSecs = 0;
+    }
+    else if ((statusCode == 302 || statusCode == 307) && s_iTemporaryTtl > 0)
+    {
+        entry.iExpireMSecs = QDateTime::currentMSecsSinceEpoch() + 1000LL * s_iTemporaryTtl;
+    }
+    else
+    {
+        return;
+    }
+    entry.uiLastUse = ++s_uiUseCounter;
+
+    if (!s_hashRedirect.contains(url) && s_hashRedirect.size() >= REDIRECT_CACHE_SIZE)
+    {
+        evictLocked();
+    }
+    s_hashRedirect.insert(url, entry);
+    ++s_metrics.uiInserts;
+}
+
+bool NetworkRedirectCache::lookup(const QUrl& url, QUrl& finalUrl)
+{
+    if (!isCacheable(url))
+    {
+        return false;
+    }
+
+    QMutexLocker locker(&s_mutex);
+    const qint64 iNow = QDateTime::currentMSecsSinceEpoch();
+    QUrl current = url;
+    for (int i = 0; i < REDIRECT_MAX_HOPS; ++i)
+    {
+        auto iter = s_hashRedirect.find(current);
+        if (iter == s_hashRedirect.end())
+        {
+            break;
+        }
+        if (iter->iExpireMSecs > 0 && iter->iExpireMSecs <= iNow)
+        {
+            s_hashRedirect.erase(iter);
+            break;
+        }
+        iter->uiLastUse = ++s_uiUseCounter;
+        current = iter->redirectUrl;
+        if (current == url)
+        {//循环
+            break;
+        }
+    }
+
+    if (current == url)
+    {
+        ++s_metrics.uiMisses;
+        return false;
+    }
+    ++s_metrics.uiHits;
+    finalUrl = current;
+    return true;
+}
+
+void NetworkRedirectCache::remove(const QUrl& url)
+{
+    QMutexLocker locker(&s_mutex);
+    s_hashRedirect.remove(url);
+}
+
+void NetworkRedirectCache::setTemporaryTtl(int iSeconds)
+{
+    QMutexLocker locker(&s_mutex);
+    s_iTemporaryTtl = qMax(0, iSeconds);
+}
+
+RedirectCacheMetrics NetworkRedirectCache::metrics()
+{
+    QMutexLocker locker(&s_mutex);
+    RedirectCacheMetrics m = s_metrics;
+    m.nEntries = s_hashRedirect.size();
+    return m;
+}
+
+void NetworkRedirectCache::clear()
+{
+    QMutexLocker locker(&s_mutex);
+    s_hashRedirect.clear();
+}
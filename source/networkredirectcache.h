@@ -0,0 +1,33 @@
+﻿#ifndef NETWORKREDIRECTCACHE_H
+#define NETWORKREDIRECTCACHE_H
+
+#include <QUrl>
+#include "networkdef.h"
+
+//重定向缓存(进程内所有请求共享)
+//请求收到301/308(永久重定向)后保存原url到目标url的映射，直到被淘汰；302/307(临时重定向)只在设置了
+//有效期(setTemporaryTtl())时保存. 之后到同一url的请求开始前直接改用最终的url，省去重定向的往返.
+//按最近使用淘汰，所有方法线程安全
+class NetworkRedirectCache
+{
+public:
+    //保存重定向(statusCode不是可缓存的重定向时不处理)
+    static void insert(const QUrl& url, const QUrl& redirectUrl, int statusCode);
+    //查找url重定向后最终的url(沿缓存的重定向链)，没有时返回false
+    static bool lookup(const QUrl& url, QUrl& finalUrl);
+    //使用缓存的url请求失败时移除(目标可能已失效)
+    static void remove(const QUrl& url);
+
+    //临时重定向(302/307)的缓存时长(秒)，0表示不缓存(默认)
+    static void setTemporaryTtl(int iSeconds);
+    static RedirectCacheMetrics metrics();
+    static void clear();
+};
+
+//请求按重定向处理的状态码
+inline bool isRedirectStatus(int statusCode)
+{
+    return (statusCode == 301 || statusCode == 302 || statusCode == 307 || statusCode == 308);
+}
+
+#endif // NETWORKREDIRECTCACHE_H
@@ -1,15 +1,27 @@
 ﻿#include "networkrequest.h"
+#include <atomic>
 #include <QDebug>
+#include <QNetworkAccessManager>
+#include <QAuthenticator>
 #include "networkdownloadrequest.h"
 #include "networkuploadrequest.h"
 #include "networkcommonrequest.h"
 #include "networkmtdownloadrequest.h"
+#include "networkmtuploadrequest.h"
+#include "networkformuploadrequest.h"
+#include "networkrequesttemplate.h"
+#include "networktlssessioncache.h"
+#include "networkcredentialstore.h"
+#include "networkredirectcache.h"
+#include "networkaccessmanager.h"
 #include "Log4cplusWrapper.h"
 
 
 NetworkRequest::NetworkRequest(QObject *parent)
     : QObject(parent)
     , m_bAbortManual(false)
+    , m_bCachedRedirect(false)
+    , m_pTiming(std::make_shared<RequestTiming>())
     , m_pNetworkManager(nullptr)
     , m_pNetworkReply(nullptr)
 {
@@ -28,6 +40,53 @@ NetworkRequest::~NetworkRequest()
     }
 }
 
+void NetworkRequest::setRequestTask(const RequestTask &request)
+{
+    m_request = request;
+    m_pTemplate = NetworkRequestTemplate::find(request.uiTemplateId);
+    if (!m_pTemplate)
+    {
+        //添加任务后模板被移除
+        LOG_ERROR("Request template not found, id: " << request.uiTemplateId << ", use the default");
+        qDebug() << "[QMultiThreadNetwork] Request template not found, id:" << request.uiTemplateId << ", use the default";
+        m_pTemplate = NetworkRequestTemplate::find(0);
+    }
+
+    //之前的请求重定向过，直接请求最终的url
+    QUrl finalUrl;
+    m_bCachedRedirect = NetworkRedirectCache::lookup(m_request.url, finalUrl);
+    if (m_bCachedRedirect)
+    {
+        m_redirectUrl = finalUrl;
+        LOG_INFO("url: " << m_request.url.toString().toStdWString() << "; cached redirectUrl:" << finalUrl.toString().toStdWString());
+        qDebug() << "[QMultiThreadNetwork] url:" << m_request.url.toString() << "cached redirectUrl:" << finalUrl.toString();
+    }
+}
+
+QNetworkRequest NetworkRequest::createNetworkRequest(const QUrl& url) const
+{
+    return m_pTemplate->createRequest(url, m_request.mapRawHeader);
+}
+
+void NetworkRequest::createNetworkManager()
+{
+    if (nullptr == m_pNetworkManager)
+    {
+        m_pNetworkManager = new NetworkAccessManager(m_pTiming);
+        m_pTemplate->applyTo(m_pNetworkManager);
+#ifndef QT_NO_SSL
+        connect(m_pNetworkManager, SIGNAL(encrypted(QNetworkReply *)), this, SLOT(onEncrypted(QNetworkReply *)));
+#endif
+        connect(m_pNetworkManager, SIGNAL(authenticationRequired(QNetworkReply *, QAuthenticator *)),
+            this, SLOT(onAuthenticationRequired(QNetworkReply *, QAuthenticator *)));
+    }
+}
+
+void NetworkRequest::onEncrypted(QNetworkReply *r)
+{
+    NetworkTlsSessionCache::store(r);
+}
+
 void NetworkRequest::abort()
 {
     m_bAbortManual = true;
@@ -45,6 +104,7 @@ void NetworkRequest::abort()
 void NetworkRequest::start()
 {
     m_bAbortManual = false;
+    m_request.eErrorType = eErrorNone;
 }
 
 void NetworkRequest::onError(QNetworkReply::NetworkError code)
@@ -61,19 +121,46 @@ void NetworkRequest::onError(QNetworkReply::NetworkError code)
 
 void NetworkRequest::onAuthenticationRequired(QNetworkReply *r, QAuthenticator *a)
 {
-    Q_UNUSED(a);
-    LOG_FUN(__FUNCTION__ << r->readAll().toStdString());
-    qDebug() << __FUNCTION__ << r->readAll();
+    //每个reply只回答一次，认证信息错误时请求失败(不填写a)，不会反复质询
+    if (!r->property("mtnetwork_auth_answered").toBool()
+        && NetworkCredentialStore::answer(r->url(), a))
+    {
+        r->setProperty("mtnetwork_auth_answered", true);
+        return;
+    }
+    LOG_INFO("Authentication required, no credential, url: " << r->url().toString().toStdWString()
+        << ", realm: " << a->realm().toStdWString());
+    qDebug() << "[QMultiThreadNetwork] Authentication required, no credential, url:" << r->url().toString() << "realm:" << a->realm();
 }
 
 
-std::unique_ptr<NetworkRequest> NetworkRequestFactory::create(const RequestType& eType)
+std::unique_ptr<NetworkRequest> NetworkRequestFactory::create(const RequestTask& task)
 {
     std::unique_ptr<NetworkRequest> pRequest;
-    switch (eType)
+    switch (task.eType)
     {
     case eTypeDownload:
     {
+#ifdef WIN32
+        //智能下载模式由多线程下载请求实现，开始时只有一个通道
+        if (task.bAutoMTDownload && (isHttpProxy(task.url.scheme()) || isHttpsProxy(task.url.scheme())))
+        {
+#if _MSC_VER >= 1700
+            pRequest = std::make_unique<NetworkMTDownloadRequest>();
+#else
+            pRequest.reset(new NetworkMTDownloadRequest());
+#endif
+            break;
+        }
+#else
+        //多线程下载只支持win32，按单通道下载(只提示一次)
+        static std::atomic<bool> s_bAutoMTDownloadWarned(false);
+        if (task.bAutoMTDownload && !s_bAutoMTDownloadWarned.exchange(true))
+        {
+            LOG_INFO("bAutoMTDownload is only supported on Windows, downloading with a single channel");
+            qDebug() << "[QMultiThreadNetwork] bAutoMTDownload is only supported on Windows, downloading with a single channel";
+        }
+#endif
 #if _MSC_VER >= 1700
         pRequest = std::make_unique<NetworkDownloadRequest>();
 #else
@@ -96,6 +183,24 @@ std::unique_ptr<NetworkRequest> NetworkRequestFactory::create(const RequestType&
         pRequest = std::make_unique<NetworkUploadRequest>();
 #else
         pRequest.reset(new NetworkUploadRequest());
+#endif
+    }
+    break;
+    case eTypeMTUpload:
+    {
+#if _MSC_VER >= 1700
+        pRequest = std::make_unique<NetworkMTUploadRequest>();
+#else
+        pRequest.reset(new NetworkMTUploadRequest());
+#endif
+    }
+    break;
+    case eTypeFormUpload:
+    {
+#if _MSC_VER >= 1700
+        pRequest = std::make_unique<NetworkFormUploadRequest>();
+#else
+        pRequest.reset(new NetworkFormUploadRequest());
 #endif
     }
     break;
@@ -9,6 +9,7 @@
 
 
 class QNetworkAccessManager;
+class NetworkRequestTemplate;
 class NetworkRequest : public QObject
 {
     Q_OBJECT
@@ -17,9 +18,16 @@ public:
     explicit NetworkRequest(QObject *parent = 0);
     virtual ~NetworkRequest();
 
-    void setRequestTask(const RequestTask &request) { m_request = request; }
+    void setRequestTask(const RequestTask &request);
+    const RequestTask& requestTask() const { return m_request; }
     //是否重定向
     bool redirected() const { return (m_redirectUrl.isValid() && m_redirectUrl != m_request.url); }
+    //请求的url(重定向后的url)
+    QUrl requestUrl() const { return redirected() ? m_redirectUrl : m_request.url; }
+    //开始时使用了缓存的重定向(NetworkRedirectCache)
+    bool cachedRedirect() const { return m_bCachedRedirect; }
+    //网络各阶段的时间(NetworkAccessManager记录)
+    RequestTiming timing() const { return *m_pTiming; }
 
     QString error() const { return m_strError; }
 
@@ -29,15 +37,27 @@ public Q_SLOTS:
     virtual void onFinished() = 0;
     virtual void onError(QNetworkReply::NetworkError);
     virtual void onAuthenticationRequired(QNetworkReply *, QAuthenticator *);
+    //TLS握手完成，保存会话票据(NetworkTlsSessionCache)
+    void onEncrypted(QNetworkReply *);
 
 Q_SIGNALS:
     void requestFinished(bool bSuccess, const QByteArray& strContent, const QString& strError);
     void aboutToAbort();
 
+protected:
+    //按请求模板创建QNetworkRequest，并设置任务的header(mapRawHeader)
+    QNetworkRequest createNetworkRequest(const QUrl& url) const;
+    //创建m_pNetworkManager(已创建时不处理)，并设置模板的代理
+    void createNetworkManager();
+
 protected:
     RequestTask m_request;
+    //任务引用的请求模板(与其他请求共享，只读)
+    std::shared_ptr<const NetworkRequestTemplate> m_pTemplate;
     bool m_bAbortManual;
     QUrl m_redirectUrl;
+    bool m_bCachedRedirect;
+    std::shared_ptr<RequestTiming> m_pTiming;
     QString m_strError;
     QNetworkAccessManager *m_pNetworkManager;
     QNetworkReply *m_pNetworkReply;
@@ -48,7 +68,7 @@ class NetworkRequestFactory
 {
 public:
     ///根据类型创建request对象
-    static std::unique_ptr<NetworkRequest> create(const RequestType& type);
+    static std::unique_ptr<NetworkRequest> create(const RequestTask& task);
 };
 
 inline bool isHttpProxy(const QString& strScheme) { return (strScheme.compare(QLatin1String("http"), Qt::CaseInsensitive) == 0); }
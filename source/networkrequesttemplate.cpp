@@ -0,0 +1,175 @@
+﻿#include "networkrequesttemplate.h"
+#include <QHash>
+#include <QReadWriteLock>
+#include <QNetworkAccessManager>
+#include <QDebug>
+#include "Log4cplusWrapper.h"
+#include "networktlssessioncache.h"
+#include "networkcredentialstore.h"
+#include "networkcookiejar.h"
+
+namespace
+{
+    QReadWriteLock s_lock;
+    QHash<quint32, std::shared_ptr<const NetworkRequestTemplate>> s_hashTemplate;
+    quint32 s_uiNextId = 0;
+
+    //uiTemplateId为0的请求使用的默认模板
+    std::shared_ptr<const NetworkRequestTemplate> s_pDefault;
+
+    std::shared_ptr<const NetworkRequestTemplate> defaultTemplateLocked()
+    {
+        if (!s_pDefault)
+        {
+            s_pDefault = std::make_shared<NetworkRequestTemplate>(RequestTemplate());
+        }
+        return s_pDefault;
+    }
+}
+
+NetworkRequestTemplate::NetworkRequestTemplate(const RequestTemplate& tmpl)
+    : m_baseUrl(tmpl.baseUrl)
+    , m_proxy(tmpl.proxy)
+    , m_bSharedCookies(tmpl.bSharedCookies)
+{
+    auto iter = tmpl.mapRawHeader.cbegin();
+    for (; iter != tmpl.mapRawHeader.cend(); ++iter)
+    {
+        m_prototype.setRawHeader(iter.key(), iter.value());
+    }
+
+#ifndef QT_NO_SSL
+    // 发送https请求前准备工作(只对https请求生效);
+    QSslConfiguration conf = tmpl.sslConfiguration;
+    if (conf.isNull())
+    {
+        conf = QSslConfiguration::defaultConfiguration();
+        conf.setPeerVerifyMode(tmpl.bVerifyPeer ? QSslSocket::VerifyPeer : QSslSocket::VerifyNone);
+        conf.setProtocol(tmpl.eSslProtocol);
+    }
+    //保留会话票据(sessionTicket())才能恢复会话
+    conf.setSslOption(QSsl::SslOptionDisableSessionPersistence, !tmpl.bTlsSessionResumption);
+    m_prototype.setSslConfiguration(conf);
+#endif
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    if (tmpl.iTransferTimeout > 0)
+    {
+        m_prototype.setTransferTimeout(tmpl.iTransferTimeout);
+    }
+#endif
+}
+
+QUrl NetworkRequestTemplate::resolved(const QUrl& url) const
+{
+    if (url.isRelative() && m_baseUrl.isValid())
+    {
+        return m_baseUrl.resolved(url);
+    }
+    return url;
+}
+
+QNetworkRequest NetworkRequestTemplate::createRequest(const QUrl& url, const QMap<QByteArray, QByteArray>& mapRawHeader) const
+{
+    QNetworkRequest request(m_prototype);
+    request.setUrl(url);
+
+    auto iter = mapRawHeader.cbegin();
+    for (; iter != mapRawHeader.cend(); ++iter)
+    {
+        request.setRawHeader(iter.key(), iter.value());
+    }
+    applySharedState(request);
+    return request;
+}
+
+void NetworkRequestTemplate::applySharedState(QNetworkRequest& request)
+{
+    if (request.url().isEmpty())
+    {
+        return;
+    }
+    NetworkTlsSessionCache::apply(request);
+    NetworkCredentialStore::applyPreemptive(request);
+}
+
+void NetworkRequestTemplate::applyTo(QNetworkAccessManager *pNetworkManager) const
+{
+    if (nullptr == pNetworkManager)
+    {
+        return;
+    }
+    if (m_proxy.type() != QNetworkProxy::DefaultProxy)
+    {
+        pNetworkManager->setProxy(m_proxy);
+    }
+    if (m_bSharedCookies)
+    {
+        //QNetworkAccessManager拥有jar，jar只转发到共享存储
+        pNetworkManager->setCookieJar(new NetworkCookieJar);
+    }
+}
+
+quint32 NetworkRequestTemplate::add(const RequestTemplate& tmpl)
+{
+    std::shared_ptr<const NetworkRequestTemplate> pTemplate = std::make_shared<NetworkRequestTemplate>(tmpl);
+
+    QWriteLocker locker(&s_lock);
+    const quint32 uiId = ++s_uiNextId;
+    s_hashTemplate.insert(uiId, pTemplate);
+    return uiId;
+}
+
+bool NetworkRequestTemplate::remove(quint32 uiTemplateId)
+{
+    QWriteLocker locker(&s_lock);
+    return (s_hashTemplate.remove(uiTemplateId) > 0);
+}
+
+std::shared_ptr<const NetworkRequestTemplate> NetworkRequestTemplate::find(quint32 uiTemplateId)
+{
+    if (0 == uiTemplateId)
+    {
+        {
+            QReadLocker locker(&s_lock);
+            if (s_pDefault)
+            {
+                return s_pDefault;
+            }
+        }
+        QWriteLocker locker(&s_lock);
+        return defaultTemplateLocked();
+    }
+
+    QReadLocker locker(&s_lock);
+    return s_hashTemplate.value(uiTemplateId);
+}
+
+bool NetworkRequestTemplate::resolveTask(RequestTask& task)
+{
+    //uiTemplateId为0时相对默认模板的baseUrl解析
+    std::shared_ptr<const NetworkRequestTemplate> pTemplate = find(task.uiTemplateId);
+    if (!pTemplate)
+    {
+        LOG_ERROR("Request template not found, id: " << task.uiTemplateId);
+        qDebug() << "[QMultiThreadNetwork] Request template not found, id:" << task.uiTemplateId;
+        return false;
+    }
+    task.url = pTemplate->resolved(task.url);
+    return true;
+}
+
+void NetworkRequestTemplate::setDefault(const RequestTemplate& tmpl)
+{
+    std::shared_ptr<const NetworkRequestTemplate> pTemplate = std::make_shared<NetworkRequestTemplate>(tmpl);
+
+    QWriteLocker locker(&s_lock);
+    s_pDefault = pTemplate;
+}
+
+void NetworkRequestTemplate::clear()
+{
+    QWriteLocker locker(&s_lock);
+    s_hashTemplate.clear();
+    s_pDefault.reset();
+}
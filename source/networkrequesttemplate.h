@@ -0,0 +1,49 @@
+﻿#ifndef NETWORKREQUESTTEMPLATE_H
+#define NETWORKREQUESTTEMPLATE_H
+
+#include <memory>
+#include <QNetworkRequest>
+#include <QNetworkProxy>
+#include "networkdef.h"
+
+class QNetworkAccessManager;
+
+//请求模板(RequestTemplate)构建后的只读状态
+//header、TLS配置和超时预先设置到一个QNetworkRequest中，各请求复制它(隐式共享)后只设置自己的url和header，
+//再带上进程内共享的TLS会话(NetworkTlsSessionCache)和预先认证的认证头(NetworkCredentialStore).
+//模板构建后不再修改，可以在多个线程中同时使用. 注册表的方法线程安全
+class NetworkRequestTemplate
+{
+public:
+    explicit NetworkRequestTemplate(const RequestTemplate& tmpl);
+
+    //相对url按baseUrl解析
+    QUrl resolved(const QUrl& url) const;
+    //创建请求：模板的设置 + url + mapRawHeader(同名的header覆盖模板的)
+    QNetworkRequest createRequest(const QUrl& url, const QMap<QByteArray, QByteArray>& mapRawHeader) const;
+    //创建QNetworkAccessManager时设置代理和共享的Cookie
+    void applyTo(QNetworkAccessManager *pNetworkManager) const;
+    //设置进程内共享的状态：缓存的TLS会话、预先认证的Authorization头(在设置url之后调用)
+    static void applySharedState(QNetworkRequest& request);
+
+    //添加模板，返回模板id(从1开始)
+    static quint32 add(const RequestTemplate& tmpl);
+    static bool remove(quint32 uiTemplateId);
+    //替换默认模板(uiTemplateId为0的请求使用)
+    static void setDefault(const RequestTemplate& tmpl);
+    //查找模板. uiTemplateId为0时返回默认模板；模板不存在时返回nullptr
+    static std::shared_ptr<const NetworkRequestTemplate> find(quint32 uiTemplateId);
+    //添加任务时按模板(uiTemplateId为0时是默认模板)解析相对url，模板不存在时返回false
+    static bool resolveTask(RequestTask& task);
+    //清除所有模板(NetworkManager::unInitialize())
+    static void clear();
+
+private:
+    Q_DISABLE_COPY(NetworkRequestTemplate);
+    QUrl m_baseUrl;
+    QNetworkRequest m_prototype;
+    QNetworkProxy m_proxy;
+    bool m_bSharedCookies;
+};
+
+#endif // NETWORKREQUESTTEMPLATE_H
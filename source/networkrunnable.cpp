@@ -6,6 +6,10 @@
 #include "classmemorytracer.h"
 #include "networkrequest.h"
 #include "networkmanager.h"
+#include "networkredirectcache.h"
+#include "networkaccessmanager.h"
+#include "networkstatistics.h"
+#include "networktracer.h"
 
 
 NetworkRunnable::NetworkRunnable(const RequestTask &task, QObject *parent)
@@ -24,6 +28,15 @@ NetworkRunnable::~NetworkRunnable()
 void NetworkRunnable::run()
 {
     RequestTask task = m_task;
+    task.timing.iDispatchUs = networkTimestampUs();
+    const bool bTrace = NetworkTracer::isEnabled();
+    if (bTrace)
+    {
+        //在NetworkManager的队列和线程池中等待的时间
+        NetworkTracer::addRequestSpan("queued", "request", task.timing.iEnqueueUs, task.timing.iDispatchUs,
+            task.uiId, task.uiBatchId, true);
+        NetworkTracer::setCurrentRequest(task.uiId, task.uiBatchId);
+    }
     std::unique_ptr<NetworkRequest> pRequest = nullptr;
 
     bool bQuit = false;
@@ -42,15 +55,43 @@ void NetworkRunnable::run()
 
         if (!bQuit)
         {
-            pRequest = std::move(NetworkRequestFactory::create(task.eType));
+            pRequest = std::move(NetworkRequestFactory::create(task));
 
             if (pRequest.get())
             {
                 connect(pRequest.get(), &NetworkRequest::requestFinished,
-                    [this, &task](bool bSuccess, const QByteArray& bytesContent, const QString& strError) {
+                    [this, &task, &pRequest](bool bSuccess, const QByteArray& bytesContent, const QString& strError) {
                     task.bSuccess = bSuccess;
                     task.bytesContent = bytesContent;
                     task.strError = strError;
+
+                    const RequestTask& result = pRequest->requestTask();
+                    task.nActualDownloadThreadCount = result.nActualDownloadThreadCount;
+                    task.iChannelBytesPerSecond = result.iChannelBytesPerSecond;
+                    task.eErrorType = result.eErrorType;
+
+                    //排队的时间在这里，网络各阶段的时间由请求记录
+                    const RequestTiming& timing = pRequest->timing();
+                    const qint64 iEnqueueUs = task.timing.iEnqueueUs;
+                    const qint64 iDispatchUs = task.timing.iDispatchUs;
+                    task.timing = timing;
+                    task.timing.iEnqueueUs = iEnqueueUs;
+                    task.timing.iDispatchUs = iDispatchUs;
+                    if (0 == task.timing.iLastByteUs && task.timing.nRequests > 0)
+                    {
+                        task.timing.iLastByteUs = networkTimestampUs();
+                    }
+                    if (!bSuccess && task.eErrorType == eErrorNone)
+                    {
+                        task.eErrorType = eErrorGeneral;
+                    }
+                    //缓存的重定向目标可能已失效，下次(包括失败重试)重新请求原url
+                    if (!bSuccess && pRequest->cachedRedirect())
+                    {
+                        NetworkRedirectCache::remove(task.url);
+                    }
+                    const qint64 iStartUs = task.timing.iEnqueueUs > 0 ? task.timing.iEnqueueUs : task.timing.iDispatchUs;
+                    NetworkStatisticsCollector::recordResult(task.eType, task.url.host(), bSuccess, networkTimestampUs() - iStartUs);
                     emit requestFinished(task);
                 });
                 pRequest->setRequestTask(task);
@@ -63,6 +104,7 @@ void NetworkRunnable::run()
 
                 task.bSuccess = false;
                 task.strError = QString("Unsupported type(%1)").arg(task.eType);
+                task.eErrorType = eErrorGeneral;
                 emit requestFinished(task);
             }
             loop.exec();
@@ -84,6 +126,13 @@ void NetworkRunnable::run()
         pRequest->abort();
         pRequest.reset();
     }
+
+    if (bTrace)
+    {
+        NetworkTracer::addRequestSpan("running", "request", task.timing.iDispatchUs, networkTimestampUs(),
+            task.uiId, task.uiBatchId);
+        NetworkTracer::setCurrentRequest(0, 0);
+    }
 }
 
 quint64 NetworkRunnable::requsetId() const
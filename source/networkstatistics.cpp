@@ -0,0 +1,569 @@
+﻿#include "networkstatistics.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <QList>
+#include <QHash>
+#include <QVector>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThreadStorage>
+#include <QtAlgorithms>
+#include "networkaccessmanager.h"
+
+//直方图：每个2的幂区间分成(1 << HISTOGRAM_SUB_BITS)个线性桶
+#define HISTOGRAM_SUB_BITS 3
+//最大的2的幂(微秒)，约12.7天
+#define HISTOGRAM_MAX_EXP 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_EXP - HISTOGRAM_SUB_BITS + 2) << HISTOGRAM_SUB_BITS)
+//统计的请求类型数(RequestType 0-9)
+#define STATISTICS_TYPE_COUNT 10
+//导出的累计分布的上界: 2^MIN_EXP - 1 到 2^MAX_EXP - 1 微秒
+#define HISTOGRAM_EXPORT_MIN_EXP 10
+#define HISTOGRAM_EXPORT_MAX_EXP 36
+//每个线程最多统计的服务器数
+#define STATISTICS_MAX_HOSTS 256
+//每个线程的服务器表的大小(2的幂，大于STATISTICS_MAX_HOSTS保证探测能结束)
+#define STATISTICS_HOST_SLOTS 512
+//速度按最近RATE_WINDOW_SECONDS个完整的秒计算
+#define RATE_WINDOW_SECONDS 5
+//每个线程按秒的字节数的环形缓冲(大于RATE_WINDOW_SECONDS，写入的当前秒不在窗口内)
+#define RATE_SLOTS 8
+
+namespace
+{
+    typedef std::atomic<quint64> Counter;
+
+    //只有所属线程写入，不需要原子的加法
+    inline void bump(Counter& counter, quint64 uiValue = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + uiValue, std::memory_order_relaxed);
+    }
+
+    inline quint64 value(const Counter& counter)
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+    int bucketIndex(quint64 uiValue)
+    {
+        if (uiValue < (1u << HISTOGRAM_SUB_BITS))
+        {
+            return (int)uiValue;
+        }
+        int iExp = 63 - (int)qCountLeadingZeroBits(uiValue);
+        if (iExp > HISTOGRAM_MAX_EXP)
+        {
+            return HISTOGRAM_BUCKETS - 1;
+        }
+        const int iShift = iExp - HISTOGRAM_SUB_BITS;
+        const int iSub = (int)((uiValue >> iShift) & ((1u << HISTOGRAM_SUB_BITS) - 1));
+        return ((iShift + 1) << HISTOGRAM_SUB_BITS) + iSub;
+    }
+
+    //桶的上界
+    qint64 bucketUpperBound(int iIndex)
+    {
+        if (iIndex < (1 << HISTOGRAM_SUB_BITS))
+        {
+            return iIndex;
+        }
+        const int iShift = (iIndex >> HISTOGRAM_SUB_BITS) - 1;
+        const qint64 iSub = iIndex & ((1 << HISTOGRAM_SUB_BITS) - 1);
+        const qint64 iLower = ((1LL << HISTOGRAM_SUB_BITS) + iSub) << iShift;
+        return iLower + (1LL << iShift) - 1;
+    }
+
+    struct TypeCounters
+    {
+        Counter uiCompleted;
+        Counter uiFailed;
+        Counter uiMaxUs;
+        Counter uiSumUs;
+        Counter buckets[HISTOGRAM_BUCKETS];
+    };
+
+    //按服务器的计数. 开放寻址的固定大小的表，只有所属线程插入，插入后键不再改变
+    struct HostSlot
+    {
+        //release发布，读取的线程acquire后才读键
+        std::atomic<QString*> pHost;
+        Counter uiCompleted;
+        Counter uiFailed;
+    };
+
+    //一秒内收发的字节数. iSecond是所属的秒，只有所属线程写入
+    struct RateSlot
+    {
+        std::atomic<qint64> iSecond;
+        Counter uiSent;
+        Counter uiReceived;
+    };
+
+    struct HostCounters
+    {
+        quint64 uiCompleted;
+        quint64 uiFailed;
+
+        HostCounters() : uiCompleted(0), uiFailed(0) {}
+    };
+
+    //合并后的计数(不是原子的，只在registry的锁内使用)
+    struct Totals
+    {
+        quint64 uiCompleted[STATISTICS_TYPE_COUNT];
+        quint64 uiFailed[STATISTICS_TYPE_COUNT];
+        quint64 uiMaxUs[STATISTICS_TYPE_COUNT];
+        quint64 uiSumUs[STATISTICS_TYPE_COUNT];
+        quint64 buckets[STATISTICS_TYPE_COUNT][HISTOGRAM_BUCKETS];
+        quint64 uiBytesSent;
+        quint64 uiBytesReceived;
+        quint64 uiRetries;
+        quint64 uiCancellations;
+        QHash<QString, HostCounters> hashHost;
+
+        Totals() { clear(); }
+        void clear();
+        void add(const Totals& other);
+        //减去reset()时的基线
+        void subtract(const Totals& base);
+    };
+
+    void Totals::clear()
+    {
+        memset(uiCompleted, 0, sizeof(uiCompleted));
+        memset(uiFailed, 0, sizeof(uiFailed));
+        memset(uiMaxUs, 0, sizeof(uiMaxUs));
+        memset(uiSumUs, 0, sizeof(uiSumUs));
+        memset(buckets, 0, sizeof(buckets));
+        uiBytesSent = 0;
+        uiBytesReceived = 0;
+        uiRetries = 0;
+        uiCancellations = 0;
+        hashHost.clear();
+    }
+
+    void Totals::add(const Totals& other)
+    {
+        for (int i = 0; i < STATISTICS_TYPE_COUNT; ++i)
+        {
+            uiCompleted[i] += other.uiCompleted[i];
+            uiFailed[i] += other.uiFailed[i];
+            uiSumUs[i] += other.uiSumUs[i];
+            uiMaxUs[i] = qMax(uiMaxUs[i], other.uiMaxUs[i]);
+            for (int j = 0; j < HISTOGRAM_BUCKETS; ++j)
+            {
+                buckets[i][j] += other.buckets[i][j];
+            }
+        }
+        uiBytesSent += other.uiBytesSent;
+        uiBytesReceived += other.uiBytesReceived;
+        uiRetries += other.uiRetries;
+        uiCancellations += other.uiCancellations;
+        for (auto iter = other.hashHost.cbegin(); iter != other.hashHost.cend(); ++iter)
+        {
+            HostCounters& h = hashHost[iter.key()];
+            h.uiCompleted += iter->uiCompleted;
+            h.uiFailed += iter->uiFailed;
+        }
+    }
+
+    void Totals::subtract(const Totals& base)
+    {
+        for (int i = 0; i < STATISTICS_TYPE_COUNT; ++i)
+        {
+            uiCompleted[i] -= base.uiCompleted[i];
+            uiFailed[i] -= base.uiFailed[i];
+            uiSumUs[i] -= base.uiSumUs[i];
+            //最大值不能相减，限制在剩余的最高的桶内
+            for (int j = 0; j < HISTOGRAM_BUCKETS; ++j)
+            {
+                buckets[i][j] -= base.buckets[i][j];
+            }
+            quint64 uiBound = 0;
+            for (int j = HISTOGRAM_BUCKETS - 1; j >= 0; --j)
+            {
+                if (buckets[i][j] > 0)
+                {
+                    uiBound = (quint64)bucketUpperBound(j);
+                    break;
+                }
+            }
+            uiMaxUs[i] = qMin(uiMaxUs[i], uiBound);
+        }
+        uiBytesSent -= base.uiBytesSent;
+        uiBytesReceived -= base.uiBytesReceived;
+        uiRetries -= base.uiRetries;
+        uiCancellations -= base.uiCancellations;
+        for (auto iter = base.hashHost.cbegin(); iter != base.hashHost.cend(); ++iter)
+        {
+            auto it = hashHost.find(iter.key());
+            if (it == hashHost.end())
+            {
+                continue;
+            }
+            it->uiCompleted -= iter->uiCompleted;
+            it->uiFailed -= iter->uiFailed;
+            if (it->uiCompleted == 0 && it->uiFailed == 0)
+            {
+                hashHost.erase(it);
+            }
+        }
+    }
+
+    struct ThreadCounters
+    {
+        TypeCounters types[STATISTICS_TYPE_COUNT];
+        Counter uiBytesSent;
+        Counter uiBytesReceived;
+        Counter uiRetries;
+        Counter uiCancellations;
+
+        HostSlot hosts[STATISTICS_HOST_SLOTS];
+        //已插入的服务器数(只有所属线程访问)
+        int nHosts;
+        RateSlot rates[RATE_SLOTS];
+
+        ThreadCounters();
+        ~ThreadCounters();
+        //所属线程调用. 表满时返回nullptr
+        HostSlot *hostSlot(const QString& strHost);
+        //读取(调用者持有registry的锁)
+        void addTo(Totals& totals) const;
+    };
+
+    //所有线程的计数器. 不释放，避免进程退出时线程存储先于它销毁
+    struct Registry
+    {
+        QMutex mutex;
+        QList<ThreadCounters*> listThread;
+        //已退出线程的计数器之和
+        Totals retired;
+        //reset()时的计数，读取时减去
+        Totals baseline;
+    };
+
+    Registry *registry()
+    {
+        static Registry *s_pRegistry = nullptr;
+        static QBasicMutex s_mutex;
+        QMutexLocker locker(&s_mutex);
+        if (nullptr == s_pRegistry)
+        {
+            s_pRegistry = new Registry;
+        }
+        return s_pRegistry;
+    }
+
+    ThreadCounters::ThreadCounters()
+        : nHosts(0)
+    {
+        for (TypeCounters& t : types)
+        {
+            t.uiCompleted.store(0, std::memory_order_relaxed);
+            t.uiFailed.store(0, std::memory_order_relaxed);
+            t.uiMaxUs.store(0, std::memory_order_relaxed);
+            t.uiSumUs.store(0, std::memory_order_relaxed);
+            for (Counter& c : t.buckets)
+            {
+                c.store(0, std::memory_order_relaxed);
+            }
+        }
+        uiBytesSent.store(0, std::memory_order_relaxed);
+        uiBytesReceived.store(0, std::memory_order_relaxed);
+        uiRetries.store(0, std::memory_order_relaxed);
+        uiCancellations.store(0, std::memory_order_relaxed);
+        for (HostSlot& h : hosts)
+        {
+            h.pHost.store(nullptr, std::memory_order_relaxed);
+            h.uiCompleted.store(0, std::memory_order_relaxed);
+            h.uiFailed.store(0, std::memory_order_relaxed);
+        }
+        for (RateSlot& s : rates)
+        {
+            s.iSecond.store(-1, std::memory_order_relaxed);
+            s.uiSent.store(0, std::memory_order_relaxed);
+            s.uiReceived.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ThreadCounters::~ThreadCounters()
+    {
+        //线程退出：并入汇总的计数器
+        Registry *r = registry();
+        {
+            QMutexLocker locker(&r->mutex);
+            r->listThread.removeOne(this);
+            addTo(r->retired);
+        }
+        for (HostSlot& h : hosts)
+        {
+            delete h.pHost.load(std::memory_order_relaxed);
+        }
+    }
+
+    HostSlot *ThreadCounters::hostSlot(const QString& strHost)
+    {
+        const uint uiMask = STATISTICS_HOST_SLOTS - 1;
+        for (uint i = qHash(strHost) & uiMask; ; i = (i + 1) & uiMask)
+        {
+            HostSlot& h = hosts[i];
+            const QString *pHost = h.pHost.load(std::memory_order_relaxed);
+            if (nullptr == pHost)
+            {
+                if (nHosts >= STATISTICS_MAX_HOSTS)
+                {
+                    return nullptr;
+                }
+                ++nHosts;
+                h.pHost.store(new QString(strHost), std::memory_order_release);
+                return &h;
+            }
+            if (*pHost == strHost)
+            {
+                return &h;
+            }
+        }
+    }
+
+    void ThreadCounters::addTo(Totals& totals) const
+    {
+        for (int i = 0; i < STATISTICS_TYPE_COUNT; ++i)
+        {
+            const TypeCounters& t = types[i];
+            totals.uiCompleted[i] += value(t.uiCompleted);
+            totals.uiFailed[i] += value(t.uiFailed);
+            totals.uiSumUs[i] += value(t.uiSumUs);
+            totals.uiMaxUs[i] = qMax(totals.uiMaxUs[i], value(t.uiMaxUs));
+            for (int j = 0; j < HISTOGRAM_BUCKETS; ++j)
+            {
+                totals.buckets[i][j] += value(t.buckets[j]);
+            }
+        }
+        totals.uiBytesSent += value(uiBytesSent);
+        totals.uiBytesReceived += value(uiBytesReceived);
+        totals.uiRetries += value(uiRetries);
+        totals.uiCancellations += value(uiCancellations);
+        for (const HostSlot& h : hosts)
+        {
+            const QString *pHost = h.pHost.load(std::memory_order_acquire);
+            if (pHost)
+            {
+                HostCounters& c = totals.hashHost[*pHost];
+                c.uiCompleted += value(h.uiCompleted);
+                c.uiFailed += value(h.uiFailed);
+            }
+        }
+    }
+
+    QThreadStorage<ThreadCounters*> s_threadCounters;
+
+    ThreadCounters *localCounters()
+    {
+        if (!s_threadCounters.hasLocalData())
+        {
+            ThreadCounters *p = new ThreadCounters;
+            {
+                Registry *r = registry();
+                QMutexLocker locker(&r->mutex);
+                r->listThread.append(p);
+            }
+            s_threadCounters.setLocalData(p);
+        }
+        return s_threadCounters.localData();
+    }
+
+    qint64 percentile(const QVector<quint64>& vecBucket, quint64 uiCount, double dRatio)
+    {
+        //第ceil(count * ratio)个值所在的桶
+        quint64 uiRank = (quint64)(uiCount * dRatio);
+        if (uiRank < uiCount)
+        {
+            ++uiRank;
+        }
+        quint64 uiSum = 0;
+        for (int i = 0; i < vecBucket.size(); ++i)
+        {
+            uiSum += vecBucket[i];
+            if (uiSum >= uiRank)
+            {
+                return bucketUpperBound(i);
+            }
+        }
+        return bucketUpperBound(vecBucket.size() - 1);
+    }
+}
+
+void NetworkStatisticsCollector::recordResult(RequestType eType, const QString& strHost, bool bSuccess, qint64 iLatencyUs)
+{
+    ThreadCounters *p = localCounters();
+    if (eType >= 0 && eType < STATISTICS_TYPE_COUNT)
+    {
+        TypeCounters& t = p->types[eType];
+        bump(bSuccess ? t.uiCompleted : t.uiFailed);
+        const quint64 uiLatency = (quint64)qMax<qint64>(0, iLatencyUs);
+        bump(t.buckets[bucketIndex(uiLatency)]);
+        bump(t.uiSumUs, uiLatency);
+        if (uiLatency > value(t.uiMaxUs))
+        {
+            t.uiMaxUs.store(uiLatency, std::memory_order_relaxed);
+        }
+    }
+
+    if (!strHost.isEmpty())
+    {
+        HostSlot *h = p->hostSlot(strHost);
+        if (h)
+        {
+            bump(bSuccess ? h->uiCompleted : h->uiFailed);
+        }
+    }
+}
+
+void NetworkStatisticsCollector::addBytes(qint64 iBytesSent, qint64 iBytesReceived)
+{
+    ThreadCounters *p = localCounters();
+    if (iBytesSent > 0)
+    {
+        bump(p->uiBytesSent, (quint64)iBytesSent);
+    }
+    if (iBytesReceived > 0)
+    {
+        bump(p->uiBytesReceived, (quint64)iBytesReceived);
+    }
+
+    const qint64 iSecond = networkTimestampUs() / 1000000;
+    RateSlot& s = p->rates[iSecond % RATE_SLOTS];
+    if (s.iSecond.load(std::memory_order_relaxed) != iSecond)
+    {
+        //新的一秒：先清零再发布秒数
+        s.uiSent.store(0, std::memory_order_relaxed);
+        s.uiReceived.store(0, std::memory_order_relaxed);
+        s.iSecond.store(iSecond, std::memory_order_release);
+    }
+    bump(s.uiSent, (quint64)qMax<qint64>(0, iBytesSent));
+    bump(s.uiReceived, (quint64)qMax<qint64>(0, iBytesReceived));
+}
+
+void NetworkStatisticsCollector::recordRetry()
+{
+    bump(localCounters()->uiRetries);
+}
+
+void NetworkStatisticsCollector::recordCancel(int nCount /* = 1 */)
+{
+    if (nCount > 0)
+    {
+        bump(localCounters()->uiCancellations, (quint64)nCount);
+    }
+}
+
+NetworkStatistics NetworkStatisticsCollector::snapshot()
+{
+    //合并到临时的计数(数组较大，放在堆上)
+    std::unique_ptr<Totals> pSum(new Totals);
+    Registry *r = registry();
+    QMutexLocker locker(&r->mutex);
+    pSum->add(r->retired);
+    for (ThreadCounters *p : r->listThread)
+    {
+        p->addTo(*pSum);
+    }
+    pSum->subtract(r->baseline);
+
+    NetworkStatistics stat;
+    for (int i = 0; i < STATISTICS_TYPE_COUNT; ++i)
+    {
+        RequestCountStatistics s;
+        s.uiCompleted = pSum->uiCompleted[i];
+        s.uiFailed = pSum->uiFailed[i];
+        if (s.uiCompleted + s.uiFailed == 0)
+        {
+            continue;
+        }
+        stat.uiCompleted += s.uiCompleted;
+        stat.uiFailed += s.uiFailed;
+
+        QVector<quint64> vecBucket(HISTOGRAM_BUCKETS);
+        quint64 uiCount = 0;
+        for (int j = 0; j < HISTOGRAM_BUCKETS; ++j)
+        {
+            vecBucket[j] = pSum->buckets[i][j];
+            uiCount += vecBucket[j];
+        }
+        s.latency.uiCount = uiCount;
+        if (uiCount > 0)
+        {
+            s.latency.iP50Us = percentile(vecBucket, uiCount, 0.5);
+            s.latency.iP90Us = percentile(vecBucket, uiCount, 0.9);
+            s.latency.iP99Us = percentile(vecBucket, uiCount, 0.99);
+            s.latency.iP999Us = percentile(vecBucket, uiCount, 0.999);
+            s.latency.iMaxUs = (qint64)pSum->uiMaxUs[i];
+            s.latency.iSumUs = (qint64)pSum->uiSumUs[i];
+        }
+        //2^n - 1是桶的上界，累计到该桶
+        int iNext = 0;
+        quint64 uiCumulative = 0;
+        for (int n = HISTOGRAM_EXPORT_MIN_EXP; n <= HISTOGRAM_EXPORT_MAX_EXP; ++n)
+        {
+            const qint64 iBound = (1LL << n) - 1;
+            const int iLast = bucketIndex((quint64)iBound);
+            for (; iNext <= iLast; ++iNext)
+            {
+                uiCumulative += vecBucket[iNext];
+            }
+            s.latency.listBucket.append(qMakePair(iBound, uiCumulative));
+        }
+        stat.mapType.insert((RequestType)i, s);
+    }
+    for (auto iter = pSum->hashHost.cbegin(); iter != pSum->hashHost.cend(); ++iter)
+    {
+        if (iter->uiCompleted + iter->uiFailed == 0)
+        {
+            continue;
+        }
+        RequestCountStatistics s;
+        s.uiCompleted = iter->uiCompleted;
+        s.uiFailed = iter->uiFailed;
+        stat.mapHost.insert(iter.key(), s);
+    }
+
+    stat.uiRetries = pSum->uiRetries;
+    stat.uiCancellations = pSum->uiCancellations;
+    stat.iBytesSent = (qint64)pSum->uiBytesSent;
+    stat.iBytesReceived = (qint64)pSum->uiBytesReceived;
+
+    //最近RATE_WINDOW_SECONDS个完整的秒的平均速度. 只读取，多个调用者互不影响
+    //(已退出的线程的速度不计入，线程池的线程空闲30秒才退出)
+    const qint64 iNowSecond = networkTimestampUs() / 1000000;
+    quint64 uiSent = 0;
+    quint64 uiReceived = 0;
+    for (ThreadCounters *p : r->listThread)
+    {
+        for (const RateSlot& s : p->rates)
+        {
+            const qint64 iSecond = s.iSecond.load(std::memory_order_acquire);
+            if (iSecond >= iNowSecond - RATE_WINDOW_SECONDS && iSecond < iNowSecond)
+            {
+                uiSent += value(s.uiSent);
+                uiReceived += value(s.uiReceived);
+            }
+        }
+    }
+    stat.dUploadBytesPerSecond = (double)uiSent / RATE_WINDOW_SECONDS;
+    stat.dDownloadBytesPerSecond = (double)uiReceived / RATE_WINDOW_SECONDS;
+    return stat;
+}
+
+void NetworkStatisticsCollector::reset()
+{
+    //不修改各线程的计数器，记下当前的计数作为基线
+    Registry *r = registry();
+    QMutexLocker locker(&r->mutex);
+    r->baseline.clear();
+    r->baseline.add(r->retired);
+    for (ThreadCounters *p : r->listThread)
+    {
+        p->addTo(r->baseline);
+    }
+}
@@ -0,0 +1,28 @@
+﻿#ifndef NETWORKSTATISTICS_H
+#define NETWORKSTATISTICS_H
+
+#include <QString>
+#include "networkdef.h"
+
+//运行时统计 (NetworkManager::statistics())
+//每个线程有自己的计数器(QThreadStorage)，只有该线程写入，用relaxed原子操作更新，不加锁；
+//读取时合并所有线程的计数器. 线程退出时它的计数器并入一个汇总的计数器.
+//按服务器的计数也在线程自己的固定大小的表里，键插入后不再改变.
+//reset()不修改各线程的计数器，只记下当前的计数作为基线，读取时减去.
+//snapshot()没有副作用，多个调用者(statistics()、指标导出)可以同时读取.
+class NetworkStatisticsCollector
+{
+public:
+    //请求结束(工作线程). iLatencyUs: 从加入队列到接收完
+    static void recordResult(RequestType eType, const QString& strHost, bool bSuccess, qint64 iLatencyUs);
+    //收发的字节数(NetworkAccessManager)
+    static void addBytes(qint64 iBytesSent, qint64 iBytesReceived);
+    static void recordRetry();
+    static void recordCancel(int nCount = 1);
+
+    //合并所有线程的计数器. nInFlight/nQueued和其他模块的统计由NetworkManager填写
+    static NetworkStatistics snapshot();
+    static void reset();
+};
+
+#endif // NETWORKSTATISTICS_H
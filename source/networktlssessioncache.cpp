@@ -0,0 +1,157 @@
+﻿#include "networktlssessioncache.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QNetworkReply>
+#ifndef QT_NO_SSL
+#include <QSslConfiguration>
+#endif
+
+//最多缓存的会话数(服务器数)
+#define TLS_SESSION_CACHE_SIZE 256
+//服务器没有给出票据的有效期时，票据保存的时长(秒)
+#define TLS_SESSION_DEFAULT_LIFETIME (2 * 60 * 60)
+
+namespace
+{
+    struct SessionEntry
+    {
+        QByteArray bytesTicket;
+        qint64 iExpireMSecs;
+    };
+
+    QMutex s_mutex;
+    QHash<QString, SessionEntry> s_hashSession;
+    quint64 s_uiFullHandshakes = 0;
+    quint64 s_uiResumedHandshakes = 0;
+
+    QString sessionKey(const QUrl& url)
+    {
+        return QStringLiteral("%1:%2").arg(url.host().toLower()).arg(url.port(443));
+    }
+
+    //缓存已满时先删除过期的会话，仍然满则删除最早过期的一个
+    void evictLocked(qint64 iNow)
+    {
+        for (auto iter = s_hashSession.begin(); iter != s_hashSession.end();)
+        {
+            if (iter->iExpireMSecs <= iNow)
+            {
+                iter = s_hashSession.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+        if (s_hashSession.size() >= TLS_SESSION_CACHE_SIZE)
+        {
+            auto oldest = s_hashSession.begin();
+            for (auto iter = s_hashSession.begin(); iter != s_hashSession.end(); ++iter)
+            {
+                if (iter->iExpireMSecs < oldest->iExpireMSecs)
+                {
+                    oldest = iter;
+                }
+            }
+            s_hashSession.erase(oldest);
+        }
+    }
+}
+
+void NetworkTlsSessionCache::apply(QNetworkRequest& request)
+{
+#ifndef QT_NO_SSL
+    const QUrl& url = request.url();
+    if (url.scheme().compare(QLatin1String("https"), Qt::CaseInsensitive) != 0)
+    {
+        return;
+    }
+    QSslConfiguration conf = request.sslConfiguration();
+    //模板关闭了会话恢复
+    if (conf.testSslOption(QSsl::SslOptionDisableSessionPersistence))
+    {
+        return;
+    }
+
+    QByteArray bytesTicket;
+    {
+        QMutexLocker locker(&s_mutex);
+        auto iter = s_hashSession.find(sessionKey(url));
+        if (iter == s_hashSession.end())
+        {
+            return;
+        }
+        if (iter->iExpireMSecs <= QDateTime::currentMSecsSinceEpoch())
+        {
+            s_hashSession.erase(iter);
+            return;
+        }
+        bytesTicket = iter->bytesTicket;
+    }
+    conf.setSessionTicket(bytesTicket);
+    request.setSslConfiguration(conf);
+#else
+    Q_UNUSED(request);
+#endif
+}
+
+void NetworkTlsSessionCache::store(QNetworkReply *pReply)
+{
+#ifndef QT_NO_SSL
+    if (nullptr == pReply)
+    {
+        return;
+    }
+    //发起握手时是否带了缓存的票据(Qt没有提供会话是否被服务器接受的接口)
+    const bool bResumed = !pReply->request().sslConfiguration().sessionTicket().isEmpty();
+    const QSslConfiguration& conf = pReply->sslConfiguration();
+    const QByteArray& bytesTicket = conf.sessionTicket();
+
+    QMutexLocker locker(&s_mutex);
+    if (bResumed)
+    {
+        ++s_uiResumedHandshakes;
+    }
+    else
+    {
+        ++s_uiFullHandshakes;
+    }
+    if (bytesTicket.isEmpty() || conf.testSslOption(QSsl::SslOptionDisableSessionPersistence))
+    {
+        return;
+    }
+
+    const qint64 iNow = QDateTime::currentMSecsSinceEpoch();
+    const int iLifeTime = conf.sessionTicketLifeTimeHint();
+    SessionEntry entry;
+    entry.bytesTicket = bytesTicket;
+    entry.iExpireMSecs = iNow + 1000LL * ((iLifeTime > 0) ? iLifeTime : TLS_SESSION_DEFAULT_LIFETIME);
+
+    const QString& strKey = sessionKey(pReply->url());
+    if (!s_hashSession.contains(strKey) && s_hashSession.size() >= TLS_SESSION_CACHE_SIZE)
+    {
+        evictLocked(iNow);
+    }
+    s_hashSession.insert(strKey, entry);
+#else
+    Q_UNUSED(pReply);
+#endif
+}
+
+TlsSessionMetrics NetworkTlsSessionCache::metrics()
+{
+    QMutexLocker locker(&s_mutex);
+    TlsSessionMetrics m;
+    m.uiFullHandshakes = s_uiFullHandshakes;
+    m.uiResumedHandshakes = s_uiResumedHandshakes;
+    m.nCachedSessions = s_hashSession.size();
+    return m;
+}
+
+void NetworkTlsSessionCache::clear()
+{
+    QMutexLocker locker(&s_mutex);
+    s_hashSession.clear();
+}
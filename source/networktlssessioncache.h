@@ -0,0 +1,25 @@
+﻿#ifndef NETWORKTLSSESSIONCACHE_H
+#define NETWORKTLSSESSIONCACHE_H
+
+#include <QNetworkRequest>
+#include "networkdef.h"
+
+class QNetworkReply;
+
+//TLS会话缓存(进程内所有请求共享)
+//每个请求使用自己的QNetworkAccessManager，连接不能复用，每个https请求都要重新握手.
+//握手完成后按host:port保存服务器发放的会话票据(QSslConfiguration::sessionTicket())，之后到同一服务器的新连接
+//带上该票据恢复会话，省去证书交换和验证. 所有方法线程安全
+class NetworkTlsSessionCache
+{
+public:
+    //请求的url是https并且有未过期的会话时，把会话票据设置到请求的TLS配置中(在设置url之后调用)
+    static void apply(QNetworkRequest& request);
+    //握手完成(QNetworkAccessManager::encrypted())：统计握手次数，保存新的会话票据
+    static void store(QNetworkReply *pReply);
+
+    static TlsSessionMetrics metrics();
+    static void clear();
+};
+
+#endif // NETWORKTLSSESSIONCACHE_H
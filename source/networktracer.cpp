@@ -0,0 +1,405 @@
+﻿#include "networktracer.h"
+#include <QList>
+#include <QVector>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadStorage>
+#include <QCoreApplication>
+#include <QDebug>
+#include "Log4cplusWrapper.h"
+
+//每个线程的环形缓冲区能保存的区间数
+#define TRACE_BUFFER_SIZE 16384
+
+std::atomic<bool> NetworkTracer::ms_bEnabled(false);
+
+namespace
+{
+    //读取后的记录
+    struct TraceEvent
+    {
+        const char *name;
+        const char *category;
+        qint64 iStartUs;
+        qint64 iEndUs;
+        quint64 uiId;
+        quint64 uiBatchId;
+        bool bAsync;
+        //在缓冲区中的序号
+        quint64 uiIndex;
+    };
+
+    //缓冲区中的一条记录. 所属线程写入时其他线程可能在读，所有字段都是原子的(relaxed)，
+    //由uiSeq判断读到的是否完整(seqlock)：第n条记录写入时为2n+1，写完后为2n+2
+    struct TraceSlot
+    {
+        std::atomic<quint64> uiSeq;
+        std::atomic<const char*> name;
+        std::atomic<const char*> category;
+        std::atomic<qint64> iStartUs;
+        std::atomic<qint64> iEndUs;
+        std::atomic<quint64> uiId;
+        std::atomic<quint64> uiBatchId;
+        std::atomic<bool> bAsync;
+    };
+
+    //使用缓冲区的线程. 缓冲区交给新线程后，之后的记录属于新线程
+    struct TraceOwner
+    {
+        //新线程的第一条记录的序号
+        quint64 uiStart;
+        int nTid;
+        QString strThreadName;
+    };
+
+    struct TraceBuffer
+    {
+        TraceSlot slots[TRACE_BUFFER_SIZE];
+        //已写入的记录总数. 只有所属线程写入，写完一条后release，读取时acquire
+        std::atomic<quint64> uiHead;
+        //clear()时的uiHead，之前的记录不再输出
+        std::atomic<quint64> uiCleared;
+        //以下只由所属线程访问
+        quint64 uiCurrentId;
+        quint64 uiCurrentBatchId;
+        //以下加锁访问. listOwner按uiStart升序，最后一个是当前的线程
+        QList<TraceOwner> listOwner;
+        bool bInUse;
+    };
+
+    //线程退出时把缓冲区还给registry，由之后的新线程继续使用(线程池的线程会过期重建，缓冲区不随之增长)
+    struct TraceHolder
+    {
+        TraceBuffer *pBuffer;
+        ~TraceHolder();
+    };
+
+    //所有缓冲区. 不释放，避免进程退出时线程存储先于它销毁
+    struct Registry
+    {
+        QMutex mutex;
+        QList<TraceBuffer*> listBuffer;
+        int nLastTid;
+    };
+
+    Registry *registry()
+    {
+        static Registry *s_pRegistry = nullptr;
+        static QBasicMutex s_mutex;
+        QMutexLocker locker(&s_mutex);
+        if (nullptr == s_pRegistry)
+        {
+            s_pRegistry = new Registry;
+            s_pRegistry->nLastTid = 0;
+        }
+        return s_pRegistry;
+    }
+
+    TraceHolder::~TraceHolder()
+    {
+        Registry *r = registry();
+        QMutexLocker locker(&r->mutex);
+        pBuffer->bInUse = false;
+    }
+
+    QThreadStorage<TraceHolder*> s_threadBuffer;
+
+    QString threadName()
+    {
+        QThread *pThread = QThread::currentThread();
+        if (QCoreApplication::instance() && pThread == QCoreApplication::instance()->thread())
+        {
+            return QStringLiteral("Main");
+        }
+        return pThread->objectName();
+    }
+
+    TraceBuffer *localBuffer()
+    {
+        if (!s_threadBuffer.hasLocalData())
+        {
+            Registry *r = registry();
+            QMutexLocker locker(&r->mutex);
+            TraceBuffer *pBuffer = nullptr;
+            for (TraceBuffer *p : r->listBuffer)
+            {
+                if (!p->bInUse)
+                {
+                    pBuffer = p;
+                    break;
+                }
+            }
+            if (nullptr == pBuffer)
+            {
+                pBuffer = new TraceBuffer;
+                for (TraceSlot& slot : pBuffer->slots)
+                {
+                    slot.uiSeq.store(0, std::memory_order_relaxed);
+                }
+                pBuffer->uiHead.store(0, std::memory_order_relaxed);
+                pBuffer->uiCleared.store(0, std::memory_order_relaxed);
+                r->listBuffer.append(pBuffer);
+            }
+            pBuffer->bInUse = true;
+            pBuffer->uiCurrentId = 0;
+            pBuffer->uiCurrentBatchId = 0;
+
+            //之前的线程的记录仍然按之前的线程输出；记录已被全部覆盖的线程不再保留
+            const quint64 uiHead = pBuffer->uiHead.load(std::memory_order_relaxed);
+            while (pBuffer->listOwner.size() > 1 && pBuffer->listOwner.at(1).uiStart + TRACE_BUFFER_SIZE <= uiHead)
+            {
+                pBuffer->listOwner.removeFirst();
+            }
+            TraceOwner owner;
+            owner.uiStart = uiHead;
+            owner.nTid = ++r->nLastTid;
+            owner.strThreadName = threadName();
+            if (owner.strThreadName.isEmpty())
+            {
+                owner.strThreadName = QStringLiteral("Thread %1").arg(owner.nTid);
+            }
+            pBuffer->listOwner.append(owner);
+
+            TraceHolder *pHolder = new TraceHolder;
+            pHolder->pBuffer = pBuffer;
+            s_threadBuffer.setLocalData(pHolder);
+        }
+        return s_threadBuffer.localData()->pBuffer;
+    }
+
+    //复制缓冲区中有效的记录(所属线程可能同时在写入)
+    QVector<TraceEvent> readBuffer(TraceBuffer *pBuffer)
+    {
+        const quint64 uiHead = pBuffer->uiHead.load(std::memory_order_acquire);
+        quint64 uiStart = pBuffer->uiCleared.load(std::memory_order_relaxed);
+        if (uiHead > TRACE_BUFFER_SIZE)
+        {
+            uiStart = qMax(uiStart, uiHead - TRACE_BUFFER_SIZE);
+        }
+
+        QVector<TraceEvent> vecEvent;
+        vecEvent.reserve((int)(uiHead - qMin(uiStart, uiHead)));
+        for (quint64 i = uiStart; i < uiHead; ++i)
+        {
+            //复制前后序号不是第i条写完的序号：已被覆盖或正在被覆盖，丢弃
+            const TraceSlot& slot = pBuffer->slots[i % TRACE_BUFFER_SIZE];
+            const quint64 uiSeq = 2 * i + 2;
+            if (slot.uiSeq.load(std::memory_order_acquire) != uiSeq)
+            {
+                continue;
+            }
+            TraceEvent e;
+            e.name = slot.name.load(std::memory_order_relaxed);
+            e.category = slot.category.load(std::memory_order_relaxed);
+            e.iStartUs = slot.iStartUs.load(std::memory_order_relaxed);
+            e.iEndUs = slot.iEndUs.load(std::memory_order_relaxed);
+            e.uiId = slot.uiId.load(std::memory_order_relaxed);
+            e.uiBatchId = slot.uiBatchId.load(std::memory_order_relaxed);
+            e.bAsync = slot.bAsync.load(std::memory_order_relaxed);
+            e.uiIndex = i;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.uiSeq.load(std::memory_order_relaxed) != uiSeq)
+            {
+                continue;
+            }
+            vecEvent.append(e);
+        }
+        return vecEvent;
+    }
+
+    QByteArray jsonString(const QString& str)
+    {
+        QByteArray bytes = str.toUtf8();
+        bytes.replace('\\', "\\\\");
+        bytes.replace('"', "\\\"");
+        return '"' + bytes + '"';
+    }
+
+    QByteArray eventHead(const char *ph, const TraceEvent& e, int nTid, qint64 iTs)
+    {
+        QByteArray bytes;
+        bytes.append("{\"ph\":\"").append(ph).append("\",\"name\":\"").append(e.name);
+        bytes.append("\",\"cat\":\"").append(e.category).append("\",\"pid\":1,\"tid\":").append(QByteArray::number(nTid));
+        bytes.append(",\"ts\":").append(QByteArray::number(iTs));
+        return bytes;
+    }
+
+    QByteArray eventArgs(const TraceEvent& e)
+    {
+        return ",\"args\":{\"request\":" + QByteArray::number(e.uiId) + ",\"batch\":" + QByteArray::number(e.uiBatchId) + "}}";
+    }
+}
+
+void NetworkTracer::setEnabled(bool bEnable)
+{
+    ms_bEnabled.store(bEnable, std::memory_order_relaxed);
+}
+
+void NetworkTracer::setCurrentRequest(quint64 uiId, quint64 uiBatchId)
+{
+    if (isEnabled())
+    {
+        TraceBuffer *pBuffer = localBuffer();
+        pBuffer->uiCurrentId = uiId;
+        pBuffer->uiCurrentBatchId = uiBatchId;
+    }
+}
+
+void NetworkTracer::currentRequest(quint64& uiId, quint64& uiBatchId)
+{
+    if (!isEnabled())
+    {
+        uiId = 0;
+        uiBatchId = 0;
+        return;
+    }
+    TraceBuffer *pBuffer = localBuffer();
+    uiId = pBuffer->uiCurrentId;
+    uiBatchId = pBuffer->uiCurrentBatchId;
+}
+
+void NetworkTracer::record(const char *name, const char *category, qint64 iStartUs, qint64 iEndUs,
+    quint64 uiId, quint64 uiBatchId, bool bAsync)
+{
+    if (iStartUs <= 0 || iEndUs < iStartUs)
+    {
+        return;
+    }
+    TraceBuffer *pBuffer = localBuffer();
+    const quint64 uiHead = pBuffer->uiHead.load(std::memory_order_relaxed);
+    TraceSlot& slot = pBuffer->slots[uiHead % TRACE_BUFFER_SIZE];
+    //先标记为正在写入，读取的线程复制后检查序号
+    slot.uiSeq.store(2 * uiHead + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.category.store(category, std::memory_order_relaxed);
+    slot.iStartUs.store(iStartUs, std::memory_order_relaxed);
+    slot.iEndUs.store(iEndUs, std::memory_order_relaxed);
+    slot.uiId.store(uiId, std::memory_order_relaxed);
+    slot.uiBatchId.store(uiBatchId, std::memory_order_relaxed);
+    slot.bAsync.store(bAsync, std::memory_order_relaxed);
+    slot.uiSeq.store(2 * uiHead + 2, std::memory_order_release);
+    pBuffer->uiHead.store(uiHead + 1, std::memory_order_release);
+}
+
+bool NetworkTracer::writeChromeTrace(const QString& strFilePath, QString *pError /* = nullptr */)
+{
+    QFile file(strFilePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        const QString& strError = QStringLiteral("Error: QFile::open(%1) - %2").arg(strFilePath).arg(file.errorString());
+        LOG_ERROR(strError.toStdWString());
+        qWarning() << "[QMultiThreadNetwork]" << strError;
+        if (pError)
+        {
+            *pError = strError;
+        }
+        return false;
+    }
+
+    QList<TraceBuffer*> listBuffer;
+    QList<QList<TraceOwner>> listOwners;
+    Registry *r = registry();
+    {
+        QMutexLocker locker(&r->mutex);
+        listBuffer = r->listBuffer;
+    }
+
+    //时间戳以第一个记录为0点
+    QList<QVector<TraceEvent>> listEvents;
+    qint64 iBaseUs = 0;
+    for (TraceBuffer *p : listBuffer)
+    {
+        listEvents.append(readBuffer(p));
+        for (const TraceEvent& e : listEvents.last())
+        {
+            if (0 == iBaseUs || e.iStartUs < iBaseUs)
+            {
+                iBaseUs = e.iStartUs;
+            }
+        }
+    }
+    {
+        //读取记录之后再复制线程，读到的记录所属的线程都在列表中
+        QMutexLocker locker(&r->mutex);
+        for (TraceBuffer *p : listBuffer)
+        {
+            listOwners.append(p->listOwner);
+        }
+    }
+
+    QByteArray bytes;
+    bytes.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bytes.append("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"QMultiThreadNetwork\"}}");
+    quint64 uiAsyncId = 0;
+    for (int i = 0; i < listBuffer.size(); ++i)
+    {
+        const QList<TraceOwner>& listOwner = listOwners.at(i);
+        for (const TraceOwner& owner : listOwner)
+        {
+            bytes.append(",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":").append(QByteArray::number(owner.nTid));
+            bytes.append(",\"args\":{\"name\":").append(jsonString(owner.strThreadName)).append("}}");
+        }
+
+        //记录按序号升序，属于序号所在区间的线程
+        int nOwner = 0;
+        for (const TraceEvent& e : listEvents.at(i))
+        {
+            //读取后才被覆盖的旧线程的记录，线程已不在列表中
+            if (e.uiIndex < listOwner.first().uiStart)
+            {
+                continue;
+            }
+            while (nOwner + 1 < listOwner.size() && listOwner.at(nOwner + 1).uiStart <= e.uiIndex)
+            {
+                ++nOwner;
+            }
+            const int nTid = listOwner.at(nOwner).nTid;
+            if (e.bAsync)
+            {
+                //每个异步区间单独一个id，交叠的区间显示在不同的轨道
+                const QByteArray id = ",\"id\":" + QByteArray::number(++uiAsyncId);
+                bytes.append(",\n").append(eventHead("b", e, nTid, e.iStartUs - iBaseUs)).append(id).append(eventArgs(e));
+                bytes.append(",\n").append(eventHead("e", e, nTid, e.iEndUs - iBaseUs)).append(id).append("}");
+            }
+            else
+            {
+                bytes.append(",\n").append(eventHead("X", e, nTid, e.iStartUs - iBaseUs));
+                bytes.append(",\"dur\":").append(QByteArray::number(e.iEndUs - e.iStartUs)).append(eventArgs(e));
+            }
+        }
+
+        if (bytes.size() >= 1024 * 1024)
+        {
+            file.write(bytes);
+            bytes.clear();
+        }
+    }
+    bytes.append("\n]}\n");
+    file.write(bytes);
+
+    if (file.error() != QFileDevice::NoError)
+    {
+        const QString& strError = QStringLiteral("Error: write file(%1) failed - %2").arg(strFilePath).arg(file.errorString());
+        LOG_ERROR(strError.toStdWString());
+        qWarning() << "[QMultiThreadNetwork]" << strError;
+        if (pError)
+        {
+            *pError = strError;
+        }
+        return false;
+    }
+    return true;
+}
+
+void NetworkTracer::clear()
+{
+    Registry *r = registry();
+    QMutexLocker locker(&r->mutex);
+    for (TraceBuffer *p : r->listBuffer)
+    {
+        p->uiCleared.store(p->uiHead.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,57 @@
+﻿#ifndef NETWORKTRACER_H
+#define NETWORKTRACER_H
+
+#include <atomic>
+#include <QString>
+#include "networkaccessmanager.h"
+
+//请求各阶段的时间线 (NetworkManager::setTraceEnabled())
+//每个线程把区间记录到自己的环形缓冲区(无锁，只有该线程写入，满了覆盖最早的记录)，
+//writeChromeTrace()时合并所有线程的缓冲区，输出Chrome trace-event JSON，可用Perfetto/chrome://tracing打开.
+//未启用时每个记录点只读取一个原子变量
+class NetworkTracer
+{
+public:
+    static void setEnabled(bool bEnable);
+    static bool isEnabled() { return ms_bEnabled.load(std::memory_order_relaxed); }
+
+    //当前线程正在执行的请求(NetworkRunnable::run()设置)，之后本线程用addSpan()记录的区间都属于它
+    static void setCurrentRequest(quint64 uiId, quint64 uiBatchId);
+    static void currentRequest(quint64& uiId, quint64& uiBatchId);
+
+    //记录当前请求的一个区间. name/category必须是字符串常量(只保存指针)
+    //bAsync: 区间可能与本线程的其他区间交叠(排队、多通道下载的分段等)，输出为单独的异步轨道
+    static void addSpan(const char *name, const char *category, qint64 iStartUs, qint64 iEndUs, bool bAsync = false)
+    {
+        if (isEnabled())
+        {
+            quint64 uiId = 0;
+            quint64 uiBatchId = 0;
+            currentRequest(uiId, uiBatchId);
+            record(name, category, iStartUs, iEndUs, uiId, uiBatchId, bAsync);
+        }
+    }
+    //记录指定请求的区间(不在请求的线程中，如写文件线程、主线程)
+    static void addRequestSpan(const char *name, const char *category, qint64 iStartUs, qint64 iEndUs,
+        quint64 uiId, quint64 uiBatchId, bool bAsync = false)
+    {
+        if (isEnabled())
+        {
+            record(name, category, iStartUs, iEndUs, uiId, uiBatchId, bAsync);
+        }
+    }
+
+    //输出所有线程缓冲区中的记录
+    static bool writeChromeTrace(const QString& strFilePath, QString *pError = nullptr);
+    //丢弃已记录的区间
+    static void clear();
+
+private:
+    static void record(const char *name, const char *category, qint64 iStartUs, qint64 iEndUs,
+        quint64 uiId, quint64 uiBatchId, bool bAsync);
+
+private:
+    static std::atomic<bool> ms_bEnabled;
+};
+
+#endif // NETWORKTRACER_H
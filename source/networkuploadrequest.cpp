@@ -1,14 +1,29 @@
 ﻿#include "networkuploadrequest.h"
 #include <QDebug>
 #include <QFile>
+#include <QTemporaryFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QUrlQuery>
+#include <QUuid>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QCryptographicHash>
 #include <QCoreApplication>
 #include <QNetworkAccessManager>
 #include "Log4cplusWrapper.h"
 #include "networkmanager.h"
+#include "networkfilerangedevice.h"
+#include "networkcompressor.h"
+#include "networkredirectcache.h"
 
 
 NetworkUploadRequest::NetworkUploadRequest(QObject *parent /* = nullptr */)
     : NetworkRequest(parent)
+    , m_iFileSize(0)
+    , m_iUploadOffset(0)
+    , m_nRetry(0)
 {
 }
 
@@ -16,19 +31,18 @@ NetworkUploadRequest::~NetworkUploadRequest()
 {
 }
 
-bool NetworkUploadRequest::readLocalFile(const QString& strFilePath, QByteArray& bytes)
+QFile *NetworkUploadRequest::openLocalFile(const QString& strFilePath)
 {
     m_strError.clear();
     if (QFile::exists(strFilePath))
     {
-        QFile file(strFilePath);
-        if (file.open(QIODevice::ReadOnly))
+        QFile *pFile = new QFile(strFilePath);
+        if (pFile->open(QIODevice::ReadOnly))
         {
-            bytes = file.readAll();
-            file.close();
-            return true;
+            return pFile;
         }
-        m_strError = QStringLiteral("Error: QFile::open(%1) - %2").arg(strFilePath).arg(file.errorString());
+        m_strError = QStringLiteral("Error: QFile::open(%1) - %2").arg(strFilePath).arg(pFile->errorString());
+        delete pFile;
     }
     else
     {
@@ -36,15 +50,21 @@ bool NetworkUploadRequest::readLocalFile(const QString& strFilePath, QByteArray&
     }
     LOG_INFO(m_strError.toStdWString());
     qDebug() << "[QMultiThreadNetwork]" << m_strError;
-    return false;
+    return nullptr;
 }
 
 void NetworkUploadRequest::start()
 {
     __super::start();
 
-    QByteArray bytes;
-    if (readLocalFile(m_request.strReqArg, bytes))
+    if (resumable())
+    {
+        startResumable();
+        return;
+    }
+
+    QFile *pFile = openLocalFile(m_request.strReqArg);
+    if (pFile)
     {
         QUrl url;
         if (!redirected())
@@ -56,51 +76,37 @@ void NetworkUploadRequest::start()
             url = m_redirectUrl;
         }
 
-        if (nullptr == m_pNetworkManager)
-        {
-            m_pNetworkManager = new QNetworkAccessManager;
-        }
+        createNetworkManager();
         m_pNetworkManager->connectToHost(url.host(), url.port());
 
-        QNetworkRequest request(url);
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
-        request.setHeader(QNetworkRequest::ContentLengthHeader, bytes.length());
-        auto iter = m_request.mapRawHeader.cbegin();
-        for (; iter != m_request.mapRawHeader.cend(); ++iter)
+        QNetworkRequest request = createRequest(url);
+        QIODevice *pDevice = pFile;
+        if (!isFtpProxy(url.scheme()))
         {
-            request.setRawHeader(iter.key(), iter.value());
+            pDevice = compressLocalFile(pFile, request);
         }
+        request.setHeader(QNetworkRequest::ContentLengthHeader, pDevice->size());
 
         if (isFtpProxy(url.scheme()))
         {
-            m_pNetworkReply = m_pNetworkManager->put(request, bytes);
+            m_pNetworkReply = m_pNetworkManager->put(request, pDevice);
         }
         else // http / https
         {
-#ifndef QT_NO_SSL
-            if (isHttpsProxy(url.scheme()))
-            {
-                // 发送https请求前准备工作;
-                QSslConfiguration conf = request.sslConfiguration();
-                conf.setPeerVerifyMode(QSslSocket::VerifyNone);
-                conf.setProtocol(QSsl::TlsV1SslV3);
-                request.setSslConfiguration(conf);
-            }
-#endif
             if (m_request.bUploadUsePut)
             {
-                m_pNetworkReply = m_pNetworkManager->put(request, bytes);
+                m_pNetworkReply = m_pNetworkManager->put(request, pDevice);
             }
             else
             {
-                m_pNetworkReply = m_pNetworkManager->post(request, bytes);
+                m_pNetworkReply = m_pNetworkManager->post(request, pDevice);
             }
         }
+        //上传过程中reply从文件读取数据，随reply一起释放(重定向时旧的reply可能还在使用)
+        pDevice->setParent(m_pNetworkReply);
 
         connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onFinished()));
         connect(m_pNetworkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
-        connect(m_pNetworkManager, SIGNAL(authenticationRequired(QNetworkReply *, QAuthenticator *)),
-            SLOT(onAuthenticationRequired(QNetworkReply *, QAuthenticator *)));
         if (m_request.bShowProgress)
         {
             connect(m_pNetworkReply, SIGNAL(uploadProgress(qint64, qint64)), this, SLOT(onUploadProgress(qint64, qint64)));
@@ -112,6 +118,270 @@ void NetworkUploadRequest::start()
     }
 }
 
+QIODevice *NetworkUploadRequest::compressLocalFile(QFile *pFile, QNetworkRequest& request)
+{
+    if (m_request.eRequestEncoding == eEncodingIdentity || pFile->size() < m_request.iCompressMinSize)
+    {
+        return pFile;
+    }
+    if (!NetworkCompressor::supported(m_request.eRequestEncoding))
+    {
+        //不支持的格式按原样上传
+        LOG_INFO("Upload without compression, unsupported encoding: " << m_request.eRequestEncoding);
+        qDebug() << "[QMultiThreadNetwork] Upload without compression, unsupported encoding:" << m_request.eRequestEncoding;
+        return pFile;
+    }
+
+    //压缩到临时文件，随reply一起删除. 分块边读边压缩，内存占用与文件大小无关；
+    //压缩后的大小已知，带Content-Length发送(QNetworkAccessManager从文件分块读取，不缓存整个请求体)
+    QTemporaryFile *pTempFile = new QTemporaryFile(QDir::tempPath() + QStringLiteral("/QMultiThreadNetwork_XXXXXX.upload"));
+    NetworkCompressDevice compressDevice(new QFile(pFile->fileName()), m_request.eRequestEncoding);
+    QString strError;
+    if (!pTempFile->open())
+    {
+        strError = pTempFile->errorString();
+    }
+    else if (!compressDevice.open(QIODevice::ReadOnly))
+    {
+        strError = compressDevice.errorString();
+    }
+    else
+    {
+        QByteArray buffer(64 * 1024, Qt::Uninitialized);
+        while (!compressDevice.atEnd())
+        {
+            const qint64 nRead = compressDevice.read(buffer.data(), buffer.size());
+            if (nRead < 0)
+            {
+                strError = compressDevice.errorString();
+                break;
+            }
+            if (pTempFile->write(buffer.constData(), nRead) != nRead)
+            {
+                strError = pTempFile->errorString();
+                break;
+            }
+        }
+    }
+    if (!strError.isEmpty() || pTempFile->size() >= pFile->size())
+    {
+        //失败或压缩后没有变小，按原样上传
+        LOG_INFO("Upload without compression: " << strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork] Upload without compression:" << strError;
+        delete pTempFile;
+        pFile->seek(0);
+        return pFile;
+    }
+    pTempFile->seek(0);
+    delete pFile;
+    request.setRawHeader("Content-Encoding", NetworkCompressor::encodingName(m_request.eRequestEncoding));
+    return pTempFile;
+}
+
+QNetworkRequest NetworkUploadRequest::createRequest(const QUrl& url) const
+{
+    QNetworkRequest request = createNetworkRequest(url);
+    if (!request.header(QNetworkRequest::ContentTypeHeader).isValid())
+    {
+        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    }
+    return request;
+}
+
+bool NetworkUploadRequest::resumable() const
+{
+    return m_request.bResumableUpload && (isHttpProxy(m_request.url.scheme()) || isHttpsProxy(m_request.url.scheme()));
+}
+
+QUrl NetworkUploadRequest::resumableUrl(const QList<QPair<QString, QString>>& listQueryItem) const
+{
+    QUrl url = requestUrl();
+    QUrlQuery query(url);
+    query.addQueryItem(QStringLiteral("uploadid"), m_strUploadId);
+    query.addQueryItem(QStringLiteral("size"), QString::number(m_iFileSize));
+    for (const auto& item : listQueryItem)
+    {
+        query.addQueryItem(item.first, item.second);
+    }
+    url.setQuery(query);
+    return url;
+}
+
+void NetworkUploadRequest::loadUploadState()
+{
+    const QFileInfo fileInfo(m_request.strReqArg);
+    m_iFileSize = fileInfo.size();
+
+    //状态文件名由url和本地文件路径决定
+    const QByteArray& bytesKey = (m_request.url.toString() + QLatin1Char('|') + fileInfo.absoluteFilePath()).toUtf8();
+    const QString& strDir = QDir::tempPath() + QStringLiteral("/QMultiThreadNetwork/upload");
+    QDir().mkpath(strDir);
+    m_strStatePath = strDir + QLatin1Char('/')
+        + QString::fromLatin1(QCryptographicHash::hash(bytesKey, QCryptographicHash::Sha1).toHex()) + QStringLiteral(".json");
+
+    m_strUploadId.clear();
+    QFile file(m_strStatePath);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        const QJsonObject& obj = QJsonDocument::fromJson(file.readAll()).object();
+        //文件改变后不能续传
+        if (obj.value(QStringLiteral("size")).toVariant().toLongLong() == m_iFileSize
+            && obj.value(QStringLiteral("modified")).toVariant().toLongLong() == fileInfo.lastModified().toMSecsSinceEpoch())
+        {
+            m_strUploadId = obj.value(QStringLiteral("uploadid")).toString();
+        }
+        file.close();
+    }
+    if (m_strUploadId.isEmpty())
+    {
+        m_strUploadId = QUuid::createUuid().toString().remove('{').remove('}');
+        saveUploadState();
+    }
+}
+
+void NetworkUploadRequest::saveUploadState()
+{
+    const QFileInfo fileInfo(m_request.strReqArg);
+    QJsonObject obj;
+    obj.insert(QStringLiteral("url"), m_request.url.toString());
+    obj.insert(QStringLiteral("file"), fileInfo.absoluteFilePath());
+    obj.insert(QStringLiteral("size"), QString::number(m_iFileSize));
+    obj.insert(QStringLiteral("modified"), QString::number(fileInfo.lastModified().toMSecsSinceEpoch()));
+    obj.insert(QStringLiteral("uploadid"), m_strUploadId);
+
+    QFile file(m_strStatePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact)) < 0)
+    {
+        LOG_ERROR("Save upload state failed: " << m_strStatePath.toStdWString());
+        qDebug() << "[QMultiThreadNetwork] Save upload state failed:" << m_strStatePath;
+    }
+}
+
+void NetworkUploadRequest::removeUploadState()
+{
+    if (!m_strStatePath.isEmpty())
+    {
+        QFile::remove(m_strStatePath);
+    }
+}
+
+void NetworkUploadRequest::startResumable()
+{
+    m_strError.clear();
+    m_nRetry = 0;
+    if (!QFileInfo(m_request.strReqArg).isFile())
+    {
+        m_strError = QStringLiteral("Error: File is not exists(%1)").arg(m_request.strReqArg);
+        LOG_INFO(m_strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << m_strError;
+        emit requestFinished(false, QByteArray(), m_strError);
+        return;
+    }
+    loadUploadState();
+
+    createNetworkManager();
+    queryOffset();
+}
+
+void NetworkUploadRequest::queryOffset()
+{
+    QNetworkRequest request = createRequest(resumableUrl(QList<QPair<QString, QString>>()));
+    m_pNetworkReply = m_pNetworkManager->head(request);
+    connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onOffsetFinished()));
+}
+
+void NetworkUploadRequest::onOffsetFinished()
+{
+    if (m_bAbortManual || nullptr == m_pNetworkReply)
+    {
+        return;
+    }
+
+    const int statusCode = m_pNetworkReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const QByteArray& bytesOffset = m_pNetworkReply->rawHeader("Upload-Offset");
+    const QNetworkReply::NetworkError eError = m_pNetworkReply->error();
+    const QString& strReplyError = m_pNetworkReply->errorString();
+    m_pNetworkReply->deleteLater();
+    m_pNetworkReply = nullptr;
+
+    qint64 iOffset = 0;
+    if (eError == QNetworkReply::NoError && statusCode >= 200 && statusCode < 300)
+    {
+        bool bOk = false;
+        iOffset = bytesOffset.trimmed().toLongLong(&bOk);
+        if (!bOk || iOffset < 0 || iOffset > m_iFileSize)
+        {
+            //服务器的状态不可用，换一个上传id重新开始
+            LOG_INFO("Invalid Upload-Offset: " << bytesOffset.toStdString() << ", restart upload");
+            m_strUploadId = QUuid::createUuid().toString().remove('{').remove('}');
+            saveUploadState();
+            iOffset = 0;
+        }
+    }
+    else if (statusCode != 404)
+    {
+        //404：服务器没有这个上传id，从头开始
+        if (m_nRetry < m_request.nUploadPartRetry && (statusCode == 0 || statusCode >= 500))
+        {
+            m_nRetry++;
+            LOG_INFO("Query upload offset failed, retry " << m_nRetry);
+            queryOffset();
+            return;
+        }
+        m_strError = QStringLiteral("Query upload offset failed. HttpStatusCode: %1, %2").arg(statusCode).arg(strReplyError);
+        LOG_ERROR(m_strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << m_strError;
+        emit requestFinished(false, QByteArray(), m_strError);
+        return;
+    }
+
+    LOG_INFO("Resumable upload. [uploadid] " << m_strUploadId.toStdWString() << " [offset] " << iOffset << " [size] " << m_iFileSize);
+    qDebug() << "[QMultiThreadNetwork] Resumable upload. uploadid:" << m_strUploadId << "offset:" << iOffset << "size:" << m_iFileSize;
+    startUpload(iOffset);
+}
+
+void NetworkUploadRequest::startUpload(qint64 iOffset)
+{
+    //只上传服务器还没有的部分
+    m_iUploadOffset = iOffset;
+    NetworkFileRangeDevice *pDevice = new NetworkFileRangeDevice(m_request.strReqArg, iOffset, m_iFileSize - iOffset);
+    if (!pDevice->open(QIODevice::ReadOnly))
+    {
+        m_strError = QStringLiteral("Error: QFile::open(%1) - %2").arg(m_request.strReqArg).arg(pDevice->errorString());
+        LOG_INFO(m_strError.toStdWString());
+        qDebug() << "[QMultiThreadNetwork]" << m_strError;
+        delete pDevice;
+        emit requestFinished(false, QByteArray(), m_strError);
+        return;
+    }
+
+    QNetworkRequest request = createRequest(resumableUrl(QList<QPair<QString, QString>>()));
+    request.setHeader(QNetworkRequest::ContentLengthHeader, pDevice->size());
+    //没有剩余数据时(上次已全部发送但未收到响应)，用"bytes */size"让服务器完成上传
+    const QString& strRange = (iOffset < m_iFileSize)
+        ? QStringLiteral("bytes %1-%2/%3").arg(iOffset).arg(m_iFileSize - 1).arg(m_iFileSize)
+        : QStringLiteral("bytes */%1").arg(m_iFileSize);
+    request.setRawHeader("Content-Range", strRange.toLatin1());
+
+    if (m_request.bUploadUsePut)
+    {
+        m_pNetworkReply = m_pNetworkManager->put(request, pDevice);
+    }
+    else
+    {
+        m_pNetworkReply = m_pNetworkManager->post(request, pDevice);
+    }
+    pDevice->setParent(m_pNetworkReply);
+
+    connect(m_pNetworkReply, SIGNAL(finished()), this, SLOT(onFinished()));
+    connect(m_pNetworkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onError(QNetworkReply::NetworkError)));
+    if (m_request.bShowProgress)
+    {
+        connect(m_pNetworkReply, SIGNAL(uploadProgress(qint64, qint64)), this, SLOT(onUploadProgress(qint64, qint64)));
+    }
+}
+
 void NetworkUploadRequest::onFinished()
 {
     bool bSuccess = (m_pNetworkReply->error() == QNetworkReply::NoError);
@@ -120,15 +390,33 @@ void NetworkUploadRequest::onFinished()
     {
         bSuccess = bSuccess && (statusCode >= 200 && statusCode < 300);
     }
-    if (!bSuccess)
+    if (resumable() && !bSuccess && !m_bAbortManual && m_nRetry < m_request.nUploadPartRetry
+        && (statusCode == 0 || statusCode == 409 || statusCode >= 500))
     {
-        if (statusCode == 301 || statusCode == 302)
-        {//301,302重定向
+        //连接中断或位置不一致(409)：重新查询服务器已收到的字节数后继续
+        m_nRetry++;
+        LOG_INFO("Resumable upload interrupted, HttpStatusCode: " << statusCode << ", retry " << m_nRetry);
+        qDebug() << "[QMultiThreadNetwork] Resumable upload interrupted, HttpStatusCode:" << statusCode << "retry" << m_nRetry;
+        m_pNetworkReply->deleteLater();
+        m_pNetworkReply = nullptr;
+        m_strError.clear();
+        queryOffset();
+        return;
+    }
+    if (bSuccess && resumable())
+    {
+        removeUploadState();
+    }
+    if (!bSuccess && !resumable())
+    {
+        if (isRedirectStatus(statusCode))
+        {//301,302,307,308重定向
             const QVariant& redirectionTarget = m_pNetworkReply->attribute(QNetworkRequest::RedirectionTargetAttribute);
             if (!redirectionTarget.isNull())
             {
                 const QUrl& url = m_request.url;
                 const QUrl& redirectUrl = url.resolved(redirectionTarget.toUrl());
+                NetworkRedirectCache::insert(m_pNetworkReply->url(), redirectUrl, statusCode);
                 if (url != redirectUrl && m_redirectUrl != redirectUrl)
                 {
                     m_redirectUrl = redirectUrl;
@@ -187,6 +475,12 @@ void NetworkUploadRequest::onUploadProgress(qint64 iSent, qint64 iTotal)
         event->uiBatchId = m_request.uiBatchId;
         event->iBtyes = iSent;
         event->iTotalBtyes = iTotal;
+        if (resumable())
+        {
+            //续传时进度包含服务器已有的部分
+            event->iBtyes += m_iUploadOffset;
+            event->iTotalBtyes = m_iFileSize;
+        }
         QCoreApplication::postEvent(NetworkManager::globalInstance(), event);
     }
 }
@@ -19,10 +19,36 @@ public Q_SLOTS:
     void start() Q_DECL_OVERRIDE;
     void onFinished() Q_DECL_OVERRIDE;
     void onUploadProgress(qint64, qint64);
+    //断点续传：查询服务器已收到的字节数
+    void onOffsetFinished();
 
 private:
-    //读取本地文件的内容
-    bool readLocalFile(const QString& strFilePath, QByteArray& bytes);
+    //断点续传(RequestTask::bResumableUpload)
+    bool resumable() const;
+    void startResumable();
+    void queryOffset();
+    void startUpload(qint64 iOffset);
+    //读取/保存上传状态(上传id)，文件或url改变后重新开始
+    void loadUploadState();
+    void saveUploadState();
+    void removeUploadState();
+    QNetworkRequest createRequest(const QUrl& url) const;
+    QUrl resumableUrl(const QList<QPair<QString, QString>>& listQueryItem) const;
+
+    //打开要上传的本地文件，失败时返回nullptr
+    //上传时由QNetworkAccessManager从文件中分块读取，不把整个文件读入内存
+    QFile *openLocalFile(const QString& strFilePath);
+    //按RequestTask::eRequestEncoding压缩到临时文件并返回它(pFile被释放)，不压缩、失败或没有变小时返回pFile
+    QIODevice *compressLocalFile(QFile *pFile, QNetworkRequest& request);
+
+private:
+    QString m_strUploadId;
+    QString m_strStatePath;
+    qint64 m_iFileSize;
+    //本次上传的起始位置
+    qint64 m_iUploadOffset;
+    //断点续传已重试的次数
+    int m_nRetry;
 };
 
 #endif // NETWORKUPLOADREQUEST_H
\ No newline at end of file
@@ -1,3 +1,3 @@
 TEMPLATE = subdirs
 
-SUBDIRS += 
+SUBDIRS += tst_networkchecksum
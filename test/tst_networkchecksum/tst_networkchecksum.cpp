@@ -0,0 +1,114 @@
+﻿#include <QtTest>
+#include "networkchecksum.h"
+
+//CRC32C的已知结果，以及分段计算后合并的结果
+class TestNetworkChecksum : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QByteArray testBuffer(int nSize)
+    {
+        QByteArray bytes(nSize, Qt::Uninitialized);
+        for (int i = 0; i < nSize; i++)
+        {
+            bytes[i] = (char)(i * 31 + 7);
+        }
+        return bytes;
+    }
+
+private Q_SLOTS:
+    void knownAnswer_data();
+    void knownAnswer();
+    void hardwareMatchesSoftware();
+    void incremental();
+    void combine();
+    void hexDigest();
+};
+
+void TestNetworkChecksum::knownAnswer_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<quint32>("crc");
+
+    QTest::newRow("empty") << QByteArray() << quint32(0);
+    QTest::newRow("123456789") << QByteArray("123456789") << quint32(0xe3069283);
+    //RFC 3720 B.4
+    QTest::newRow("32 zeros") << QByteArray(32, '\0') << quint32(0x8a9136aa);
+    QTest::newRow("32 0xff") << QByteArray(32, '\xff') << quint32(0x62a8ab43);
+}
+
+void TestNetworkChecksum::knownAnswer()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(quint32, crc);
+
+    QCOMPARE(NetworkChecksum::crc32cSoftware(0, data.constData(), data.size()), crc);
+    //支持SSE4.2时是硬件计算
+    QCOMPARE(NetworkChecksum::crc32c(0, data.constData(), data.size()), crc);
+}
+
+void TestNetworkChecksum::hardwareMatchesSoftware()
+{
+    if (!NetworkChecksum::hardwareCrc32c())
+    {
+        QSKIP("CPU does not support SSE4.2");
+    }
+    const QByteArray& bytes = testBuffer(4096 + 13);
+    //不同的起始对齐和长度(覆盖8/4/1字节的分支)
+    for (int nOffset = 0; nOffset < 16; nOffset++)
+    {
+        for (int nSize = 0; nSize < 64; nSize++)
+        {
+            const char *data = bytes.constData() + nOffset;
+            QCOMPARE(NetworkChecksum::crc32c(0, data, nSize), NetworkChecksum::crc32cSoftware(0, data, nSize));
+        }
+    }
+    QCOMPARE(NetworkChecksum::crc32c(0, bytes.constData(), bytes.size()),
+        NetworkChecksum::crc32cSoftware(0, bytes.constData(), bytes.size()));
+}
+
+void TestNetworkChecksum::incremental()
+{
+    const QByteArray& bytes = testBuffer(1000);
+    const quint32 whole = NetworkChecksum::crc32cSoftware(0, bytes.constData(), bytes.size());
+    for (int nSplit = 0; nSplit <= bytes.size(); nSplit += 37)
+    {
+        const quint32 first = NetworkChecksum::crc32c(0, bytes.constData(), nSplit);
+        QCOMPARE(NetworkChecksum::crc32c(first, bytes.constData() + nSplit, bytes.size() - nSplit), whole);
+
+        const quint32 firstSoftware = NetworkChecksum::crc32cSoftware(0, bytes.constData(), nSplit);
+        QCOMPARE(NetworkChecksum::crc32cSoftware(firstSoftware, bytes.constData() + nSplit, bytes.size() - nSplit), whole);
+    }
+}
+
+void TestNetworkChecksum::combine()
+{
+    const QByteArray& bytes = testBuffer(1000);
+    const quint32 whole = NetworkChecksum::crc32c(0, bytes.constData(), bytes.size());
+    for (int nSplit = 0; nSplit <= bytes.size(); nSplit += 37)
+    {
+        const int nLen2 = bytes.size() - nSplit;
+        const quint32 crc1 = NetworkChecksum::crc32c(0, bytes.constData(), nSplit);
+        const quint32 crc2 = NetworkChecksum::crc32c(0, bytes.constData() + nSplit, nLen2);
+        QCOMPARE(NetworkChecksum::crc32cCombine(crc1, crc2, nLen2), whole);
+    }
+
+    //"12345" + "6789"
+    const quint32 crc1 = NetworkChecksum::crc32cSoftware(0, "12345", 5);
+    const quint32 crc2 = NetworkChecksum::crc32cSoftware(0, "6789", 4);
+    QCOMPARE(NetworkChecksum::crc32cCombine(crc1, crc2, 4), quint32(0xe3069283));
+}
+
+void TestNetworkChecksum::hexDigest()
+{
+    NetworkChecksum checksum(eHashCrc32c);
+    checksum.addData(QByteArray("1234"));
+    checksum.addData(QByteArray("56789"));
+    QCOMPARE(checksum.hexDigest(), QByteArray("e3069283"));
+    QCOMPARE(NetworkChecksum::crc32cHex(0x1234), QByteArray("00001234"));
+}
+
+QTEST_APPLESS_MAIN(TestNetworkChecksum)
+
+#include "tst_networkchecksum.moc"
@@ -0,0 +1,15 @@
+QT += testlib network
+QT -= gui
+CONFIG += console testcase
+CONFIG -= app_bundle
+TEMPLATE = app
+TARGET = tst_networkchecksum
+
+INCLUDEPATH += $$PWD/../../source \
+            $$PWD/../../source/inc
+
+DEFINES += UNICODE QT_MTNETWORK_STATIC
+
+HEADERS += $$PWD/../../source/networkchecksum.h
+SOURCES += tst_networkchecksum.cpp \
+           $$PWD/../../source/networkchecksum.cpp